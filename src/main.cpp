@@ -28,21 +28,24 @@ void print_usage(std::ostream& os) {
           "  polonio help                Show this help message\n"
           "  polonio version             Show version information\n"
           "  polonio --dump-ast <expr>   Dump AST for expression (dev)\n"
-          "  polonio run <file.pol>      Run a Polonio template\n"
+          "  polonio run [--engine=ast|vm] <file.pol>\n"
+          "                              Run a Polonio template\n"
           "  polonio <file.pol>          Shorthand for run\n"
-          "  polonio serve [--root DIR] [--port N]\n"
+          "  polonio serve [--root DIR] [--port N] [--workers N] [--no-compress]\n"
           "                              Start the local development server\n";
 }
 
 void print_serve_usage(std::ostream& os) {
-    os << "Usage: polonio serve [--root DIR] [--port N]\n"
+    os << "Usage: polonio serve [--root DIR] [--port N] [--workers N] [--no-compress]\n"
           "\n"
           "Serve a directory on http://127.0.0.1:PORT for local development.\n"
           "\n"
           "Options:\n"
-          "  --root DIR   Root directory to serve (default: current directory)\n"
-          "  --port N     Listening port (default: 8080)\n"
-          "  -h, --help   Show this help message\n"
+          "  --root DIR     Root directory to serve (default: current directory)\n"
+          "  --port N       Listening port (default: 8080)\n"
+          "  --workers N    Connections handled in parallel (default: 4)\n"
+          "  --no-compress  Send responses without gzip/deflate encoding\n"
+          "  -h, --help     Show this help message\n"
           "\n"
           "Behavior:\n"
           "  - Supports GET and POST requests.\n"
@@ -50,12 +53,28 @@ void print_serve_usage(std::ostream& os) {
           "  - Resolves extensionless paths to .pol files when available.\n"
           "  - Uses index.pol, then index.html, for directory requests.\n"
           "  - Renders 404.pol for missing paths when present.\n"
+          "  - Compresses text responses for clients that accept gzip or deflate.\n"
           "\n"
-          "This single-threaded, loopback-only server is for local development,\n"
+          "This loopback-only server is for local development,\n"
           "not public production deployment.\n";
 }
 
-int handle_run(const std::vector<std::string>& args) {
+int handle_run(const std::vector<std::string>& raw_args) {
+    std::vector<std::string> args;
+    auto engine = polonio::default_execution_engine();
+    for (const auto& arg : raw_args) {
+        if (arg.rfind("--engine=", 0) == 0) {
+            auto selected = polonio::parse_execution_engine(arg.substr(9));
+            if (!selected) {
+                std::cerr << "run: unknown engine: " << arg.substr(9) << '\n';
+                print_usage(std::cerr);
+                return EXIT_FAILURE;
+            }
+            engine = *selected;
+            continue;
+        }
+        args.push_back(arg);
+    }
     if (args.empty()) {
         std::cerr << "run: missing file argument\n";
         print_usage(std::cerr);
@@ -73,6 +92,7 @@ int handle_run(const std::vector<std::string>& args) {
     session.is_cgi = false;
     session.secret_missing = false;
     polonio::Interpreter interpreter(std::make_shared<polonio::Env>(), source.path());
+    interpreter.set_engine(engine);
     interpreter.set_session_context(&session);
     interpreter.set_output_sink([](const std::string& text) {
         std::cout << text;
@@ -126,6 +146,8 @@ bool is_known_command(const std::string& arg) {
 
 int handle_serve(const std::vector<std::string>& args) {
     int port = 8080;
+    int workers = 4;
+    bool compress = true;
     std::filesystem::path root = ".";
     for (std::size_t i = 0; i < args.size(); ++i) {
         const std::string& arg = args[i];
@@ -144,6 +166,20 @@ int handle_serve(const std::vector<std::string>& args) {
                 std::cerr << "serve: invalid port: " << value << '\n';
                 return EXIT_FAILURE;
             }
+        } else if (arg == "--workers") {
+            if (i + 1 >= args.size()) {
+                std::cerr << "serve: --workers requires a value\n";
+                return EXIT_FAILURE;
+            }
+            const std::string& value = args[++i];
+            try {
+                workers = std::stoi(value);
+            } catch (const std::exception&) {
+                std::cerr << "serve: invalid worker count: " << value << '\n';
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--no-compress") {
+            compress = false;
         } else if (arg == "--root") {
             if (i + 1 >= args.size()) {
                 std::cerr << "serve: --root requires a directory path\n";
@@ -161,6 +197,10 @@ int handle_serve(const std::vector<std::string>& args) {
         std::cerr << "serve: port must be between 1 and 65535\n";
         return EXIT_FAILURE;
     }
+    if (workers < 1 || workers > 256) {
+        std::cerr << "serve: workers must be between 1 and 256\n";
+        return EXIT_FAILURE;
+    }
 
     std::error_code ec;
     auto root_exists = std::filesystem::exists(root, ec);
@@ -180,6 +220,8 @@ int handle_serve(const std::vector<std::string>& args) {
 
     polonio::ServerConfig config;
     config.port = port;
+    config.workers = workers;
+    config.compress = compress;
     config.root = normalized;
     try {
         polonio::run_http_server(config);
@@ -193,12 +235,19 @@ int handle_serve(const std::vector<std::string>& args) {
 } // namespace
 
 int handle_cgi_request() {
+    polonio::ResponseContext response;
     try {
         auto ctx = polonio::build_cgi_context();
         polonio::Source source = polonio::Source::from_file(ctx.script_filename);
         polonio::Interpreter interpreter(std::make_shared<polonio::Env>(), ctx.script_filename);
-        polonio::ResponseContext response;
         interpreter.set_response_context(&response);
+        // After http_flush() output goes straight to the web server.
+        polonio::ResponseStream stream{
+            [](polonio::ResponseContext& committed) { committed.emit(std::cout); },
+            [](const std::string& text) { std::cout << text; },
+            [] { std::cout.flush(); },
+        };
+        interpreter.set_response_stream(&stream);
         polonio::SessionContext session;
         session.is_cgi = true;
         const char* secret_env = std::getenv("POLONIO_SESSION_SECRET");
@@ -238,13 +287,23 @@ int handle_cgi_request() {
             }
         }
         response.emit(std::cout);
-        std::cout << body;
+        if (response.status_code != 304) {
+            std::cout << body;
+        }
         return EXIT_SUCCESS;
     } catch (const polonio::PolonioError& err) {
-        std::cout << "Status: 500\r\nContent-Type: text/plain\r\n\r\n" << err.format();
+        // A streamed response already has its headers out; the error can
+        // only follow the partial body.
+        if (!response.headers_sent) {
+            std::cout << "Status: 500\r\nContent-Type: text/plain\r\n\r\n";
+        }
+        std::cout << err.format();
         return EXIT_FAILURE;
     } catch (const std::exception&) {
-        std::cout << "Status: 500\r\nContent-Type: text/plain\r\n\r\nInternalError: request failed";
+        if (!response.headers_sent) {
+            std::cout << "Status: 500\r\nContent-Type: text/plain\r\n\r\n";
+        }
+        std::cout << "InternalError: request failed";
         return EXIT_FAILURE;
     }
 }
@@ -7,67 +7,160 @@
 #include <vector>
 
 #include "polonio/common/location.h"
+#include "polonio/parser/scope.h"
 
 namespace polonio {
 
+class Value;
+struct Chunk;
+
+enum class ExprKind {
+    Literal,
+    Identifier,
+    Unary,
+    Binary,
+    ArrayLiteral,
+    ObjectLiteral,
+    Call,
+    Index,
+    Assignment,
+};
+
+// Nodes carry their kind so consumers can switch on it and static_cast,
+// rather than probing with dynamic_pointer_cast.
 class Expr {
 public:
+    explicit Expr(ExprKind kind) : kind_(kind) {}
     virtual ~Expr() = default;
     virtual std::string dump() const = 0;
+    ExprKind kind() const { return kind_; }
+
+private:
+    ExprKind kind_;
 };
 
 using ExprPtr = std::shared_ptr<Expr>;
 
+// Operators are resolved by the parser; the symbols are the source spelling
+// used by dump() and runtime error messages.
+enum class UnaryOp { Negate, Not };
+
+enum class BinaryOp {
+    Or,
+    And,
+    Equal,
+    NotEqual,
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Concat,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Modulo,
+};
+
+enum class AssignOp { Assign, Add, Subtract, Multiply, Divide, Modulo, Concat };
+
+inline const char* operator_symbol(UnaryOp op) {
+    return op == UnaryOp::Negate ? "-" : "not";
+}
+
+inline const char* operator_symbol(BinaryOp op) {
+    switch (op) {
+    case BinaryOp::Or: return "or";
+    case BinaryOp::And: return "and";
+    case BinaryOp::Equal: return "==";
+    case BinaryOp::NotEqual: return "!=";
+    case BinaryOp::Less: return "<";
+    case BinaryOp::LessEqual: return "<=";
+    case BinaryOp::Greater: return ">";
+    case BinaryOp::GreaterEqual: return ">=";
+    case BinaryOp::Concat: return "..";
+    case BinaryOp::Add: return "+";
+    case BinaryOp::Subtract: return "-";
+    case BinaryOp::Multiply: return "*";
+    case BinaryOp::Divide: return "/";
+    case BinaryOp::Modulo: return "%";
+    }
+    return "?";
+}
+
+inline const char* operator_symbol(AssignOp op) {
+    switch (op) {
+    case AssignOp::Assign: return "=";
+    case AssignOp::Add: return "+=";
+    case AssignOp::Subtract: return "-=";
+    case AssignOp::Multiply: return "*=";
+    case AssignOp::Divide: return "/=";
+    case AssignOp::Modulo: return "%=";
+    case AssignOp::Concat: return "..=";
+    }
+    return "?";
+}
+
+// `repr` is the dump spelling; `value` is the constant the parser decoded
+// from the token, so evaluation never reparses the source text. It is held
+// by pointer so the syntax tree does not depend on the runtime's Value.
 class LiteralExpr : public Expr {
 public:
-    explicit LiteralExpr(std::string repr) : repr_(std::move(repr)) {}
+    LiteralExpr(std::string repr, std::shared_ptr<const Value> value)
+        : Expr(ExprKind::Literal), repr_(std::move(repr)), value_(std::move(value)) {}
     std::string dump() const override { return repr_; }
     const std::string& repr() const { return repr_; }
+    const Value& value() const { return *value_; }
 
 private:
     std::string repr_;
+    std::shared_ptr<const Value> value_;
 };
 
 class IdentifierExpr : public Expr {
 public:
-    explicit IdentifierExpr(std::string name) : name_(std::move(name)) {}
+    explicit IdentifierExpr(std::string name) : Expr(ExprKind::Identifier), name_(std::move(name)) {}
     std::string dump() const override { return "ident(" + name_ + ")"; }
     const std::string& name() const { return name_; }
+    // Filled by the resolver; the default means "look the name up".
+    const SlotRef& slot() const { return slot_; }
+    void set_slot(SlotRef slot) { slot_ = slot; }
 
 private:
     std::string name_;
+    SlotRef slot_;
 };
 
 class UnaryExpr : public Expr {
 public:
-    UnaryExpr(std::string op, ExprPtr right)
-        : op_(std::move(op)), right_(std::move(right)) {}
+    UnaryExpr(UnaryOp op, ExprPtr right)
+        : Expr(ExprKind::Unary), op_(op), right_(std::move(right)) {}
 
     std::string dump() const override {
-        return "(" + op_ + " " + right_->dump() + ")";
+        return std::string("(") + operator_symbol(op_) + " " + right_->dump() + ")";
     }
-    const std::string& op() const { return op_; }
+    UnaryOp op() const { return op_; }
     const ExprPtr& right() const { return right_; }
 
 private:
-    std::string op_;
+    UnaryOp op_;
     ExprPtr right_;
 };
 
 class BinaryExpr : public Expr {
 public:
-    BinaryExpr(std::string op, ExprPtr left, ExprPtr right)
-        : op_(std::move(op)), left_(std::move(left)), right_(std::move(right)) {}
+    BinaryExpr(BinaryOp op, ExprPtr left, ExprPtr right)
+        : Expr(ExprKind::Binary), op_(op), left_(std::move(left)), right_(std::move(right)) {}
 
     std::string dump() const override {
-        return "(" + op_ + " " + left_->dump() + " " + right_->dump() + ")";
+        return std::string("(") + operator_symbol(op_) + " " + left_->dump() + " " + right_->dump() + ")";
     }
-    const std::string& op() const { return op_; }
+    BinaryOp op() const { return op_; }
     const ExprPtr& left() const { return left_; }
     const ExprPtr& right() const { return right_; }
 
 private:
-    std::string op_;
+    BinaryOp op_;
     ExprPtr left_;
     ExprPtr right_;
 };
@@ -75,7 +168,7 @@ private:
 class ArrayLiteralExpr : public Expr {
 public:
     explicit ArrayLiteralExpr(std::vector<ExprPtr> elements)
-        : elements_(std::move(elements)) {}
+        : Expr(ExprKind::ArrayLiteral), elements_(std::move(elements)) {}
 
     std::string dump() const override {
         std::string out = "array(";
@@ -92,10 +185,12 @@ private:
     std::vector<ExprPtr> elements_;
 };
 
+// Field names keep their quoted source spelling for dump(); keys() holds the
+// decoded strings in the same order.
 class ObjectLiteralExpr : public Expr {
 public:
-    explicit ObjectLiteralExpr(std::vector<std::pair<std::string, ExprPtr>> fields)
-        : fields_(std::move(fields)) {}
+    ObjectLiteralExpr(std::vector<std::pair<std::string, ExprPtr>> fields, std::vector<std::string> keys)
+        : Expr(ExprKind::ObjectLiteral), fields_(std::move(fields)), keys_(std::move(keys)) {}
 
     std::string dump() const override {
         std::string out = "object(";
@@ -107,15 +202,18 @@ public:
         return out;
     }
     const std::vector<std::pair<std::string, ExprPtr>>& fields() const { return fields_; }
+    const std::vector<std::string>& keys() const { return keys_; }
 
 private:
     std::vector<std::pair<std::string, ExprPtr>> fields_;
+    std::vector<std::string> keys_;
 };
 
 class CallExpr : public Expr {
 public:
     CallExpr(ExprPtr callee, std::vector<ExprPtr> args, Location location = Location::start())
-        : callee_(std::move(callee)), args_(std::move(args)), location_(location) {}
+        : Expr(ExprKind::Call), callee_(std::move(callee)), args_(std::move(args)),
+          location_(location) {}
 
     std::string dump() const override {
         std::string out = "call(" + callee_->dump();
@@ -138,7 +236,7 @@ private:
 class IndexExpr : public Expr {
 public:
     IndexExpr(ExprPtr object, ExprPtr index)
-        : object_(std::move(object)), index_(std::move(index)) {}
+        : Expr(ExprKind::Index), object_(std::move(object)), index_(std::move(index)) {}
 
     std::string dump() const override {
         return "index(" + object_->dump() + ", " + index_->dump() + ")";
@@ -154,26 +252,44 @@ private:
 
 class AssignmentExpr : public Expr {
 public:
-    AssignmentExpr(ExprPtr target, std::string op, ExprPtr value)
-        : target_(std::move(target)), op_(std::move(op)), value_(std::move(value)) {}
+    AssignmentExpr(ExprPtr target, AssignOp op, ExprPtr value)
+        : Expr(ExprKind::Assignment), target_(std::move(target)), op_(op), value_(std::move(value)) {}
 
     std::string dump() const override {
-        return "assign(" + target_->dump() + ", " + op_ + ", " + value_->dump() + ")";
+        return "assign(" + target_->dump() + ", " + operator_symbol(op_) + ", " + value_->dump() + ")";
     }
     const ExprPtr& target() const { return target_; }
-    const std::string& op() const { return op_; }
+    AssignOp op() const { return op_; }
     const ExprPtr& value() const { return value_; }
 
 private:
     ExprPtr target_;
-    std::string op_;
+    AssignOp op_;
     ExprPtr value_;
 };
 
+enum class StmtKind {
+    VarDecl,
+    Echo,
+    Expr,
+    Include,
+    If,
+    While,
+    For,
+    Return,
+    Attempt,
+    Function,
+};
+
 class Stmt {
 public:
+    explicit Stmt(StmtKind kind) : kind_(kind) {}
     virtual ~Stmt() = default;
     virtual std::string dump() const = 0;
+    StmtKind kind() const { return kind_; }
+
+private:
+    StmtKind kind_;
 };
 
 using StmtPtr = std::shared_ptr<Stmt>;
@@ -181,7 +297,7 @@ using StmtPtr = std::shared_ptr<Stmt>;
 class VarDeclStmt : public Stmt {
 public:
     VarDeclStmt(std::string name, ExprPtr initializer)
-        : name_(std::move(name)), initializer_(std::move(initializer)) {}
+        : Stmt(StmtKind::VarDecl), name_(std::move(name)), initializer_(std::move(initializer)) {}
 
     std::string dump() const override {
         if (initializer_) {
@@ -192,15 +308,18 @@ public:
     const std::string& name() const { return name_; }
     const ExprPtr& initializer() const { return initializer_; }
     bool has_initializer() const { return static_cast<bool>(initializer_); }
+    const SlotRef& slot() const { return slot_; }
+    void set_slot(SlotRef slot) { slot_ = slot; }
 
 private:
     std::string name_;
     ExprPtr initializer_;
+    SlotRef slot_;
 };
 
 class EchoStmt : public Stmt {
 public:
-    explicit EchoStmt(ExprPtr expr) : expr_(std::move(expr)) {}
+    explicit EchoStmt(ExprPtr expr) : Stmt(StmtKind::Echo), expr_(std::move(expr)) {}
 
     std::string dump() const override { return "Echo(" + expr_->dump() + ")"; }
     const ExprPtr& expr() const { return expr_; }
@@ -211,7 +330,7 @@ private:
 
 class ExprStmt : public Stmt {
 public:
-    explicit ExprStmt(ExprPtr expr) : expr_(std::move(expr)) {}
+    explicit ExprStmt(ExprPtr expr) : Stmt(StmtKind::Expr), expr_(std::move(expr)) {}
 
     std::string dump() const override { return "Expr(" + expr_->dump() + ")"; }
     const ExprPtr& expr() const { return expr_; }
@@ -223,7 +342,7 @@ private:
 class IncludeStmt : public Stmt {
 public:
     IncludeStmt(std::string path, Location location)
-        : path_(std::move(path)), location_(location) {}
+        : Stmt(StmtKind::Include), path_(std::move(path)), location_(location) {}
 
     std::string dump() const override { return "Include(" + path_ + ")"; }
     const std::string& path() const { return path_; }
@@ -240,6 +359,10 @@ public:
         : statements_(std::move(statements)) {}
 
     const std::vector<StmtPtr>& statements() const { return statements_; }
+    // Bytecode the VM compiled from this program, kept with it so a cached
+    // template compiles once. Server workers share programs, hence atomic.
+    std::shared_ptr<const Chunk> bytecode() const { return std::atomic_load(&bytecode_); }
+    void set_bytecode(std::shared_ptr<const Chunk> code) const { std::atomic_store(&bytecode_, std::move(code)); }
 
     std::string dump() const {
         std::string out = "Program(";
@@ -253,6 +376,7 @@ public:
 
 private:
     std::vector<StmtPtr> statements_;
+    mutable std::shared_ptr<const Chunk> bytecode_;
 };
 
 struct IfBranch {
@@ -263,7 +387,7 @@ struct IfBranch {
 class IfStmt : public Stmt {
 public:
     IfStmt(std::vector<IfBranch> branches, std::vector<StmtPtr> else_body)
-        : branches_(std::move(branches)), else_body_(std::move(else_body)) {}
+        : Stmt(StmtKind::If), branches_(std::move(branches)), else_body_(std::move(else_body)) {}
 
     std::string dump() const override {
         std::string out = "If(";
@@ -298,7 +422,7 @@ private:
 class WhileStmt : public Stmt {
 public:
     WhileStmt(ExprPtr condition, std::vector<StmtPtr> body)
-        : condition_(std::move(condition)), body_(std::move(body)) {}
+        : Stmt(StmtKind::While), condition_(std::move(condition)), body_(std::move(body)) {}
 
     std::string dump() const override {
         std::string out = "While(" + condition_->dump() + ", [";
@@ -323,7 +447,7 @@ public:
             std::string value_name,
             ExprPtr iterable,
             std::vector<StmtPtr> body)
-        : index_name_(std::move(index_name)),
+        : Stmt(StmtKind::For), index_name_(std::move(index_name)),
           value_name_(std::move(value_name)),
           iterable_(std::move(iterable)),
           body_(std::move(body)) {}
@@ -346,17 +470,20 @@ public:
     const std::string& value_name() const { return value_name_; }
     const ExprPtr& iterable() const { return iterable_; }
     const std::vector<StmtPtr>& body() const { return body_; }
+    const std::shared_ptr<const ScopeLayout>& scope() const { return scope_; }
+    void set_scope(std::shared_ptr<const ScopeLayout> scope) { scope_ = std::move(scope); }
 
 private:
     std::optional<std::string> index_name_;
     std::string value_name_;
     ExprPtr iterable_;
     std::vector<StmtPtr> body_;
+    std::shared_ptr<const ScopeLayout> scope_;
 };
 
 class ReturnStmt : public Stmt {
 public:
-    explicit ReturnStmt(ExprPtr value) : value_(std::move(value)) {}
+    explicit ReturnStmt(ExprPtr value) : Stmt(StmtKind::Return), value_(std::move(value)) {}
 
     std::string dump() const override {
         if (value_) {
@@ -379,7 +506,7 @@ public:
                 Span attempt_span,
                 Span recover_span,
                 std::optional<Span> binding_span)
-        : attempt_body_(std::move(attempt_body)),
+        : Stmt(StmtKind::Attempt), attempt_body_(std::move(attempt_body)),
           recover_binding_(std::move(recover_binding)),
           recover_body_(std::move(recover_body)),
           attempt_span_(attempt_span), recover_span_(recover_span),
@@ -406,6 +533,8 @@ public:
     const Span& attempt_span() const { return attempt_span_; }
     const Span& recover_span() const { return recover_span_; }
     const std::optional<Span>& binding_span() const { return binding_span_; }
+    const std::shared_ptr<const ScopeLayout>& recover_scope() const { return recover_scope_; }
+    void set_recover_scope(std::shared_ptr<const ScopeLayout> scope) { recover_scope_ = std::move(scope); }
 
 private:
     std::vector<StmtPtr> attempt_body_;
@@ -414,6 +543,7 @@ private:
     Span attempt_span_;
     Span recover_span_;
     std::optional<Span> binding_span_;
+    std::shared_ptr<const ScopeLayout> recover_scope_;
 };
 
 class FunctionStmt : public Stmt {
@@ -421,7 +551,7 @@ public:
     FunctionStmt(std::string name,
                  std::vector<std::string> params,
                  std::vector<StmtPtr> body)
-        : name_(std::move(name)),
+        : Stmt(StmtKind::Function), name_(std::move(name)),
           params_(std::move(params)),
           body_(std::move(body)) {}
 
@@ -442,11 +572,23 @@ public:
     const std::string& name() const { return name_; }
     const std::vector<std::string>& params() const { return params_; }
     const std::vector<StmtPtr>& body() const { return body_; }
+    // Slot binding the function's name where it is declared, and the layout
+    // of its call scope.
+    const SlotRef& slot() const { return slot_; }
+    void set_slot(SlotRef slot) { slot_ = slot; }
+    const std::shared_ptr<const ScopeLayout>& scope() const { return scope_; }
+    void set_scope(std::shared_ptr<const ScopeLayout> scope) { scope_ = std::move(scope); }
+    // Bytecode of the body, compiled once like Program::bytecode.
+    std::shared_ptr<const Chunk> bytecode() const { return std::atomic_load(&bytecode_); }
+    void set_bytecode(std::shared_ptr<const Chunk> code) const { std::atomic_store(&bytecode_, std::move(code)); }
 
 private:
     std::string name_;
     std::vector<std::string> params_;
     std::vector<StmtPtr> body_;
+    SlotRef slot_;
+    std::shared_ptr<const ScopeLayout> scope_;
+    mutable std::shared_ptr<const Chunk> bytecode_;
 };
 
 } // namespace polonio
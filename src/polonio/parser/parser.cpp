@@ -1,12 +1,53 @@
 #include "polonio/parser/parser.h"
+#include "polonio/parser/resolver.h"
+#include "polonio/runtime/value.h"
 
 #include <algorithm>
 #include <initializer_list>
 #include <optional>
+#include <stdexcept>
+#include <string>
 #include <utility>
 
 namespace polonio {
 
+namespace {
+
+BinaryOp binary_op(TokenKind kind) {
+    switch (kind) {
+    case TokenKind::Or: return BinaryOp::Or;
+    case TokenKind::And: return BinaryOp::And;
+    case TokenKind::EqualEqual: return BinaryOp::Equal;
+    case TokenKind::NotEqual: return BinaryOp::NotEqual;
+    case TokenKind::Less: return BinaryOp::Less;
+    case TokenKind::LessEqual: return BinaryOp::LessEqual;
+    case TokenKind::Greater: return BinaryOp::Greater;
+    case TokenKind::GreaterEqual: return BinaryOp::GreaterEqual;
+    case TokenKind::DotDot: return BinaryOp::Concat;
+    case TokenKind::Plus: return BinaryOp::Add;
+    case TokenKind::Minus: return BinaryOp::Subtract;
+    case TokenKind::Star: return BinaryOp::Multiply;
+    case TokenKind::Slash: return BinaryOp::Divide;
+    case TokenKind::Percent: return BinaryOp::Modulo;
+    default: throw PolonioError(ErrorCategory::Internal, "parser: token is not a binary operator");
+    }
+}
+
+AssignOp assign_op(TokenKind kind) {
+    switch (kind) {
+    case TokenKind::PlusEqual: return AssignOp::Add;
+    case TokenKind::MinusEqual: return AssignOp::Subtract;
+    case TokenKind::StarEqual: return AssignOp::Multiply;
+    case TokenKind::SlashEqual: return AssignOp::Divide;
+    case TokenKind::PercentEqual: return AssignOp::Modulo;
+    case TokenKind::DotDotEqual: return AssignOp::Concat;
+    case TokenKind::Equal: return AssignOp::Assign;
+    default: throw PolonioError(ErrorCategory::Internal, "parser: token is not an assignment operator");
+    }
+}
+
+} // namespace
+
 Parser::Parser(std::vector<Token> tokens, std::string path)
     : tokens_(std::move(tokens)), path_(std::move(path)) {}
 
@@ -24,7 +65,9 @@ Program Parser::parse_program() {
         statements.push_back(declaration());
         match(TokenKind::Semicolon);
     }
-    return Program(std::move(statements));
+    Program program(std::move(statements));
+    resolve_program(program);
+    return program;
 }
 
 ExprPtr Parser::expression() { return or_expr(); }
@@ -35,13 +78,10 @@ ExprPtr Parser::assignment() {
     if (match({TokenKind::Equal, TokenKind::PlusEqual, TokenKind::MinusEqual,
                TokenKind::StarEqual, TokenKind::SlashEqual, TokenKind::PercentEqual,
                TokenKind::DotDotEqual})) {
-        std::string op = previous().lexeme;
+        AssignOp op = assign_op(previous().kind);
         auto value = assignment();
 
-        if (auto ident = std::dynamic_pointer_cast<IdentifierExpr>(expr)) {
-            return std::make_shared<AssignmentExpr>(expr, op, value);
-        }
-        if (auto index = std::dynamic_pointer_cast<IndexExpr>(expr)) {
+        if (expr->kind() == ExprKind::Identifier || expr->kind() == ExprKind::Index) {
             return std::make_shared<AssignmentExpr>(expr, op, value);
         }
         error(previous(), "invalid assignment target");
@@ -53,7 +93,7 @@ ExprPtr Parser::assignment() {
 ExprPtr Parser::or_expr() {
     auto expr = and_expr();
     while (match(TokenKind::Or)) {
-        std::string op = previous().lexeme;
+        BinaryOp op = binary_op(previous().kind);
         auto right = and_expr();
         expr = std::make_shared<BinaryExpr>(op, expr, right);
     }
@@ -63,7 +103,7 @@ ExprPtr Parser::or_expr() {
 ExprPtr Parser::and_expr() {
     auto expr = equality();
     while (match(TokenKind::And)) {
-        std::string op = previous().lexeme;
+        BinaryOp op = binary_op(previous().kind);
         auto right = equality();
         expr = std::make_shared<BinaryExpr>(op, expr, right);
     }
@@ -73,7 +113,7 @@ ExprPtr Parser::and_expr() {
 ExprPtr Parser::equality() {
     auto expr = comparison();
     while (match({TokenKind::EqualEqual, TokenKind::NotEqual})) {
-        std::string op = previous().lexeme;
+        BinaryOp op = binary_op(previous().kind);
         auto right = comparison();
         expr = std::make_shared<BinaryExpr>(op, expr, right);
     }
@@ -83,7 +123,7 @@ ExprPtr Parser::equality() {
 ExprPtr Parser::comparison() {
     auto expr = concat();
     while (match({TokenKind::Less, TokenKind::LessEqual, TokenKind::Greater, TokenKind::GreaterEqual})) {
-        std::string op = previous().lexeme;
+        BinaryOp op = binary_op(previous().kind);
         auto right = concat();
         expr = std::make_shared<BinaryExpr>(op, expr, right);
     }
@@ -93,7 +133,7 @@ ExprPtr Parser::comparison() {
 ExprPtr Parser::concat() {
     auto expr = addition();
     while (match(TokenKind::DotDot)) {
-        std::string op = previous().lexeme;
+        BinaryOp op = binary_op(previous().kind);
         auto right = addition();
         expr = std::make_shared<BinaryExpr>(op, expr, right);
     }
@@ -103,7 +143,7 @@ ExprPtr Parser::concat() {
 ExprPtr Parser::addition() {
     auto expr = multiplication();
     while (match({TokenKind::Plus, TokenKind::Minus})) {
-        std::string op = previous().lexeme;
+        BinaryOp op = binary_op(previous().kind);
         auto right = multiplication();
         expr = std::make_shared<BinaryExpr>(op, expr, right);
     }
@@ -113,7 +153,7 @@ ExprPtr Parser::addition() {
 ExprPtr Parser::multiplication() {
     auto expr = unary();
     while (match({TokenKind::Star, TokenKind::Slash, TokenKind::Percent})) {
-        std::string op = previous().lexeme;
+        BinaryOp op = binary_op(previous().kind);
         auto right = unary();
         expr = std::make_shared<BinaryExpr>(op, expr, right);
     }
@@ -122,14 +162,12 @@ ExprPtr Parser::multiplication() {
 
 ExprPtr Parser::unary() {
     if (match(TokenKind::Not)) {
-        std::string op = previous().lexeme;
         auto right = unary();
-        return std::make_shared<UnaryExpr>(op, right);
+        return std::make_shared<UnaryExpr>(UnaryOp::Not, right);
     }
     if (match(TokenKind::Minus)) {
-        std::string op = previous().lexeme;
         auto right = unary();
-        return std::make_shared<UnaryExpr>(op, right);
+        return std::make_shared<UnaryExpr>(UnaryOp::Negate, right);
     }
     return postfix();
 }
@@ -162,19 +200,27 @@ ExprPtr Parser::postfix() {
 
 ExprPtr Parser::primary() {
     if (match(TokenKind::Number)) {
-        return std::make_shared<LiteralExpr>("num(" + previous().lexeme + ")");
+        const Token& token = previous();
+        double number = 0.0;
+        try {
+            number = std::stod(token.lexeme);
+        } catch (const std::out_of_range&) {
+            error(token, "number literal out of range");
+        }
+        return std::make_shared<LiteralExpr>("num(" + token.lexeme + ")", std::make_shared<const Value>(number));
     }
     if (match(TokenKind::String)) {
-        return std::make_shared<LiteralExpr>("str(" + previous().lexeme + ")");
+        return std::make_shared<LiteralExpr>("str(" + previous().lexeme + ")",
+                                             std::make_shared<const Value>(string_value(previous())));
     }
     if (match(TokenKind::True)) {
-        return std::make_shared<LiteralExpr>("bool(true)");
+        return std::make_shared<LiteralExpr>("bool(true)", std::make_shared<const Value>(true));
     }
     if (match(TokenKind::False)) {
-        return std::make_shared<LiteralExpr>("bool(false)");
+        return std::make_shared<LiteralExpr>("bool(false)", std::make_shared<const Value>(false));
     }
     if (match(TokenKind::Null)) {
-        return std::make_shared<LiteralExpr>("null");
+        return std::make_shared<LiteralExpr>("null", std::make_shared<const Value>());
     }
     if (match(TokenKind::Identifier)) {
         return std::make_shared<IdentifierExpr>(previous().lexeme);
@@ -207,19 +253,21 @@ ExprPtr Parser::array_literal() {
 
 ExprPtr Parser::object_literal() {
     std::vector<std::pair<std::string, ExprPtr>> fields;
+    std::vector<std::string> keys;
     if (!check(TokenKind::RightBrace)) {
         do {
             if (!match(TokenKind::String)) {
                 error(peek(), "expected string key in object literal");
             }
             std::string key = previous().lexeme;
+            keys.push_back(string_value(previous()));
             consume(TokenKind::Colon, "expected ':' after object key");
             auto value = expression();
             fields.emplace_back(key, value);
         } while (match(TokenKind::Comma));
     }
     consume(TokenKind::RightBrace, "expected '}' after object literal");
-    return std::make_shared<ObjectLiteralExpr>(std::move(fields));
+    return std::make_shared<ObjectLiteralExpr>(std::move(fields), std::move(keys));
 }
 
 StmtPtr Parser::declaration() {
@@ -0,0 +1,234 @@
+#include "polonio/parser/resolver.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace polonio {
+
+std::optional<std::uint32_t> ScopeLayout::slot_of(const std::string& name) const {
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        if (names[i] == name) {
+            return static_cast<std::uint32_t>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+namespace {
+
+class Resolver {
+public:
+    void block(const std::vector<StmtPtr>& statements) {
+        for (const auto& stmt : statements) {
+            statement(*stmt);
+        }
+    }
+
+private:
+    static std::uint32_t declare(ScopeLayout& layout, const std::string& name) {
+        if (auto slot = layout.slot_of(name)) {
+            return *slot;
+        }
+        layout.names.push_back(name);
+        return static_cast<std::uint32_t>(layout.names.size() - 1);
+    }
+
+    // `var` and `function` bind in the nearest scope, so declarations inside
+    // if, while, and attempt blocks belong to the enclosing layout. Every name
+    // is known before the body is resolved, since a loop can read a local on
+    // a later pass than the one that declares it.
+    static void hoist(ScopeLayout& layout, const std::vector<StmtPtr>& statements) {
+        for (const auto& stmt : statements) {
+            switch (stmt->kind()) {
+            case StmtKind::VarDecl:
+                declare(layout, static_cast<const VarDeclStmt&>(*stmt).name());
+                break;
+            case StmtKind::Function:
+                declare(layout, static_cast<const FunctionStmt&>(*stmt).name());
+                break;
+            case StmtKind::If: {
+                const auto& if_stmt = static_cast<const IfStmt&>(*stmt);
+                for (const auto& branch : if_stmt.branches()) {
+                    hoist(layout, branch.body);
+                }
+                hoist(layout, if_stmt.else_body());
+                break;
+            }
+            case StmtKind::While:
+                hoist(layout, static_cast<const WhileStmt&>(*stmt).body());
+                break;
+            case StmtKind::Attempt:
+                hoist(layout, static_cast<const AttemptStmt&>(*stmt).attempt_body());
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    std::shared_ptr<const ScopeLayout> scoped(const std::vector<std::string>& bound,
+                                              const std::vector<StmtPtr>& body) {
+        auto layout = std::make_shared<ScopeLayout>();
+        for (const auto& name : bound) {
+            layout->bindings.push_back(declare(*layout, name));
+        }
+        hoist(*layout, body);
+        scopes_.push_back(layout.get());
+        block(body);
+        scopes_.pop_back();
+        return layout;
+    }
+
+    SlotRef lookup(const std::string& name) const {
+        const auto depth = static_cast<std::uint32_t>(scopes_.size());
+        for (std::uint32_t hop = 0; hop < depth; ++hop) {
+            if (auto slot = scopes_[depth - 1 - hop]->slot_of(name)) {
+                return SlotRef{hop, *slot};
+            }
+        }
+        return SlotRef{depth, SlotRef::kOutside};
+    }
+
+    SlotRef local(const std::string& name) const {
+        if (scopes_.empty()) {
+            return SlotRef{};
+        }
+        return SlotRef{0, *scopes_.back()->slot_of(name)};
+    }
+
+    void statement(Stmt& stmt) {
+        switch (stmt.kind()) {
+        case StmtKind::VarDecl: {
+            auto& var = static_cast<VarDeclStmt&>(stmt);
+            if (var.has_initializer()) {
+                expression(*var.initializer());
+            }
+            var.set_slot(local(var.name()));
+            return;
+        }
+        case StmtKind::Echo:
+            expression(*static_cast<EchoStmt&>(stmt).expr());
+            return;
+        case StmtKind::Expr:
+            expression(*static_cast<ExprStmt&>(stmt).expr());
+            return;
+        case StmtKind::Include:
+            return;
+        case StmtKind::If: {
+            auto& if_stmt = static_cast<IfStmt&>(stmt);
+            for (const auto& branch : if_stmt.branches()) {
+                expression(*branch.condition);
+                block(branch.body);
+            }
+            block(if_stmt.else_body());
+            return;
+        }
+        case StmtKind::While: {
+            auto& while_stmt = static_cast<WhileStmt&>(stmt);
+            expression(*while_stmt.condition());
+            block(while_stmt.body());
+            return;
+        }
+        case StmtKind::For: {
+            auto& for_stmt = static_cast<ForStmt&>(stmt);
+            expression(*for_stmt.iterable());
+            std::vector<std::string> bound;
+            if (for_stmt.index_name()) {
+                bound.push_back(*for_stmt.index_name());
+            }
+            bound.push_back(for_stmt.value_name());
+            for_stmt.set_scope(scoped(bound, for_stmt.body()));
+            return;
+        }
+        case StmtKind::Return: {
+            auto& ret = static_cast<ReturnStmt&>(stmt);
+            if (ret.has_value()) {
+                expression(*ret.value());
+            }
+            return;
+        }
+        case StmtKind::Attempt: {
+            auto& attempt = static_cast<AttemptStmt&>(stmt);
+            block(attempt.attempt_body());
+            std::vector<std::string> bound;
+            if (attempt.recover_binding()) {
+                bound.push_back(*attempt.recover_binding());
+            }
+            attempt.set_recover_scope(scoped(bound, attempt.recover_body()));
+            return;
+        }
+        case StmtKind::Function: {
+            auto& fn = static_cast<FunctionStmt&>(stmt);
+            fn.set_slot(local(fn.name()));
+            std::vector<std::string> bound = fn.params();
+            bound.push_back(fn.name());
+            fn.set_scope(scoped(bound, fn.body()));
+            return;
+        }
+        }
+    }
+
+    void expression(Expr& expr) {
+        switch (expr.kind()) {
+        case ExprKind::Literal:
+            return;
+        case ExprKind::Identifier: {
+            auto& ident = static_cast<IdentifierExpr&>(expr);
+            ident.set_slot(lookup(ident.name()));
+            return;
+        }
+        case ExprKind::Unary:
+            expression(*static_cast<UnaryExpr&>(expr).right());
+            return;
+        case ExprKind::Binary: {
+            auto& binary = static_cast<BinaryExpr&>(expr);
+            expression(*binary.left());
+            expression(*binary.right());
+            return;
+        }
+        case ExprKind::ArrayLiteral:
+            for (const auto& element : static_cast<ArrayLiteralExpr&>(expr).elements()) {
+                expression(*element);
+            }
+            return;
+        case ExprKind::ObjectLiteral:
+            for (const auto& field : static_cast<ObjectLiteralExpr&>(expr).fields()) {
+                expression(*field.second);
+            }
+            return;
+        case ExprKind::Call: {
+            auto& call = static_cast<CallExpr&>(expr);
+            expression(*call.callee());
+            for (const auto& arg : call.args()) {
+                expression(*arg);
+            }
+            return;
+        }
+        case ExprKind::Index: {
+            auto& index = static_cast<IndexExpr&>(expr);
+            expression(*index.object());
+            expression(*index.index());
+            return;
+        }
+        case ExprKind::Assignment: {
+            auto& assignment = static_cast<AssignmentExpr&>(expr);
+            expression(*assignment.target());
+            expression(*assignment.value());
+            return;
+        }
+        }
+    }
+
+    std::vector<const ScopeLayout*> scopes_;
+};
+
+} // namespace
+
+void resolve_program(Program& program) {
+    Resolver().block(program.statements());
+}
+
+} // namespace polonio
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "polonio/parser/ast.h"
+
+namespace polonio {
+
+// Assigns slots to the parameters and locals of every function, for-loop
+// iteration, and recover block in `program`, and records on each identifier
+// where its binding lives. Top-level names keep the hash path: they are
+// globals, and an included file's top level runs in whichever scope includes it.
+void resolve_program(Program& program);
+
+} // namespace polonio
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace polonio {
+
+// Locals of a function, loop iteration, or recover block, fixed by the resolver
+// before execution. `bindings` lists the slots filled on entry: parameters then
+// the function's own name, the loop index and value, or the recover binding.
+struct ScopeLayout {
+    std::vector<std::string> names;
+    std::vector<std::uint32_t> bindings;
+
+    std::optional<std::uint32_t> slot_of(const std::string& name) const;
+};
+
+// Where the resolver found a variable: slot `index` of the scope `depth` levels
+// out, or, for kOutside, past `depth` resolved scopes in the global/host chain.
+struct SlotRef {
+    static constexpr std::uint32_t kOutside = UINT32_MAX;
+
+    std::uint32_t depth = 0;
+    std::uint32_t index = kOutside;
+};
+
+} // namespace polonio
@@ -25,6 +25,7 @@
 #include "polonio/runtime/interpreter.h"
 #include "polonio/runtime/output.h"
 #include "polonio/runtime/cgi.h"
+#include "polonio/runtime/http_request_utils.h"
 #include "polonio/runtime/json_utils.h"
 #include "polonio/runtime/session.h"
 #include "polonio/runtime/storage_ops.h"
@@ -176,16 +177,6 @@ bool is_reserved_mail_header(const std::string& name) {
     return std::find(reserved.begin(), reserved.end(), lower) != reserved.end();
 }
 
-struct SQLiteStatementDeleter {
-    void operator()(sqlite3_stmt* stmt) const {
-        if (stmt) {
-            sqlite3_finalize(stmt);
-        }
-    }
-};
-
-using SQLiteStatementPtr = std::unique_ptr<sqlite3_stmt, SQLiteStatementDeleter>;
-
 bool is_integral_double(double value) { return std::floor(value) == value; }
 
 bool fits_int64(double value) {
@@ -193,6 +184,62 @@ bool fits_int64(double value) {
            value <= static_cast<double>(std::numeric_limits<sqlite3_int64>::max());
 }
 
+// Reads db_connect's options object over the defaults. Unknown keys are
+// ignored, as send_file does.
+DatabaseOptions parse_db_options(const Value& value, Interpreter& interp, const Location& loc) {
+    if (!std::holds_alternative<Value::ObjectPtr>(value.storage())) {
+        throw PolonioError(ErrorKind::Runtime, "db_connect: opts must be object", interp.path(), loc);
+    }
+    DatabaseOptions options;
+    auto opts = std::get<Value::ObjectPtr>(value.storage());
+    if (!opts) {
+        return options;
+    }
+    auto choice = [&](const char* key, std::string& target, const std::vector<std::string>& allowed) {
+        auto it = opts->find(key);
+        if (it == opts->end()) return;
+        std::string text;
+        if (std::holds_alternative<std::string>(it->second.storage())) {
+            text = to_lower_ascii(std::get<std::string>(it->second.storage()));
+        }
+        if (std::find(allowed.begin(), allowed.end(), text) == allowed.end()) {
+            std::string list;
+            for (const auto& name : allowed) {
+                list += (list.empty() ? "" : ", ") + name;
+            }
+            throw PolonioError(ErrorKind::Runtime,
+                               std::string("db_connect: ") + key + " must be one of " + list,
+                               interp.path(),
+                               loc);
+        }
+        target = text;
+    };
+    auto integer = [&](const char* key, std::int64_t& target, bool allow_negative) {
+        auto it = opts->find(key);
+        if (it == opts->end()) return;
+        const auto& storage = it->second.storage();
+        if (!std::holds_alternative<double>(storage) || !is_integral_double(std::get<double>(storage)) ||
+            !fits_int64(std::get<double>(storage)) || (!allow_negative && std::get<double>(storage) < 0)) {
+            throw PolonioError(ErrorKind::Runtime,
+                               std::string("db_connect: ") + key +
+                                   (allow_negative ? " must be an integer" : " must be a non-negative integer"),
+                               interp.path(),
+                               loc);
+        }
+        target = static_cast<std::int64_t>(std::get<double>(storage));
+    };
+    choice("journal_mode", options.journal_mode, {"wal", "delete", "truncate", "persist", "memory", "off"});
+    choice("synchronous", options.synchronous, {"off", "normal", "full", "extra"});
+    choice("temp_store", options.temp_store, {"default", "file", "memory"});
+    integer("cache_size", options.cache_size, true);
+    integer("mmap_size", options.mmap_size, false);
+    integer("busy_timeout", options.busy_timeout_ms, false);
+    if (options.busy_timeout_ms > std::numeric_limits<int>::max()) {
+        throw PolonioError(ErrorKind::Runtime, "db_connect: busy_timeout is too large", interp.path(), loc);
+    }
+    return options;
+}
+
 void bind_sqlite_value(sqlite3_stmt* stmt,
                        int index,
                        const Value& value,
@@ -258,47 +305,6 @@ void bind_sqlite_parameters(sqlite3_stmt* stmt,
     }
 }
 
-Value sqlite_value_from_column(sqlite3_stmt* stmt, int index) {
-    int column_type = sqlite3_column_type(stmt, index);
-    switch (column_type) {
-        case SQLITE_INTEGER:
-            return Value(static_cast<double>(sqlite3_column_int64(stmt, index)));
-        case SQLITE_FLOAT:
-            return Value(sqlite3_column_double(stmt, index));
-        case SQLITE_TEXT: {
-            const unsigned char* text = sqlite3_column_text(stmt, index);
-            int len = sqlite3_column_bytes(stmt, index);
-            if (!text) {
-                return Value(std::string());
-            }
-            return Value(std::string(reinterpret_cast<const char*>(text), static_cast<std::size_t>(len)));
-        }
-        case SQLITE_BLOB: {
-            const void* blob = sqlite3_column_blob(stmt, index);
-            int len = sqlite3_column_bytes(stmt, index);
-            if (!blob) {
-                return Value(std::string());
-            }
-            return Value(std::string(reinterpret_cast<const char*>(blob), static_cast<std::size_t>(len)));
-        }
-        case SQLITE_NULL:
-        default:
-            return Value();
-    }
-}
-
-Value make_row_value(sqlite3_stmt* stmt) {
-    Value::Object object;
-    int column_count = sqlite3_column_count(stmt);
-    for (int i = 0; i < column_count; ++i) {
-        const char* name = sqlite3_column_name(stmt, i);
-        std::string key = name ? std::string(name) : ("column" + std::to_string(i));
-        object[key] = sqlite_value_from_column(stmt, i);
-    }
-    return Value(std::move(object));
-}
-
-
 void write_output_values(Interpreter& interp, const std::vector<Value>& args) {
     for (const auto& value : args) {
         interp.write_text(OutputBuffer::value_to_string(value));
@@ -333,12 +339,21 @@ constexpr int kPasswordHashKeyLen = 32;
 constexpr int kPasswordHashMaxIterations = 10000000;
 
 std::mt19937_64& global_rng() {
-    static std::mt19937_64 rng(0xC0FFEE);
+    // One generator per thread: dev server workers run scripts concurrently.
+    thread_local std::mt19937_64 rng(0xC0FFEE);
     return rng;
 }
 
 CGIContext* current_cgi_context(Interpreter& interp) { return interp.cgi_context(); }
 
+// Builtins that copy the whole body onto the heap refuse one past the buffered
+// limit; only multipart uploads may be larger.
+void require_buffered_body(const CGIContext& ctx, const std::string& name, Interpreter& interp, const Location& loc) {
+    if (ctx.body.size() > RequestBody::kMaxBufferedBytes) {
+        throw PolonioError(ErrorKind::Runtime, name + ": request body too large", interp.path(), loc);
+    }
+}
+
 std::string normalize_header_lookup(const std::string& name) {
     std::string normalized;
     normalized.reserve(name.size());
@@ -432,6 +447,7 @@ Value builtin_db_connect(Interpreter& interp, const std::vector<Value>& args, co
 Value builtin_db_close(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
 Value builtin_db_query(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
 Value builtin_db_exec(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
+Value builtin_db_cursor(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
 Value builtin_db_last_insert_id(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
 Value builtin_db_begin(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
 Value builtin_db_commit(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
@@ -461,6 +477,8 @@ Value builtin_status(Interpreter& interp, const std::vector<Value>& args, const
 Value builtin_header(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
 Value builtin_http_content_type(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
 Value builtin_redirect(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
+Value builtin_http_etag(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
+Value builtin_http_flush(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
 Value builtin_urlencode(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
 Value builtin_urldecode(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
 Value builtin_htmlspecialchars(Interpreter& interp, const std::vector<Value>& args, const Location& loc);
@@ -603,6 +621,8 @@ std::string describe_value_for_debug(const Value& value) {
                 return "object(len=" + std::to_string(len) + ")";
             } else if constexpr (std::is_same_v<T, BuiltinFunction>) {
                 return "function(name=" + alt.name + ")";
+            } else if constexpr (std::is_same_v<T, Value::IteratorPtr>) {
+                return alt ? alt->type_name() : "null";
             } else {
                 std::string name = alt.name.empty() ? "<anon>" : alt.name;
                 return "function(name=" + name + ")";
@@ -1296,6 +1316,66 @@ Value builtin_date_parse(Interpreter& interp, const std::vector<Value>& args, co
     return Value(static_cast<double>(seconds));
 }
 
+Value builtin_http_etag(Interpreter& interp, const std::vector<Value>& args, const Location& loc) {
+    auto* ctx = require_cgi_context("http_etag", interp, loc);
+    std::string tag = trim(OutputBuffer::value_to_string(ensure_arg("http_etag", 0, args, interp, loc)));
+    if (tag.empty()) {
+        throw PolonioError(ErrorKind::Runtime, "http_etag: expected tag", interp.path(), loc);
+    }
+    bool quoted = tag.size() >= 2 && tag.back() == '"' &&
+                  (tag.front() == '"' || (tag.size() >= 4 && tag.compare(0, 3, "W/\"") == 0));
+    if (!quoted) {
+        tag = "\"" + tag + "\"";
+    }
+    std::size_t opaque_start = tag.find('"') + 1;
+    for (std::size_t i = opaque_start; i + 1 < tag.size(); ++i) {
+        unsigned char ch = static_cast<unsigned char>(tag[i]);
+        if (ch == '"' || ch < 0x21 || ch == 0x7f) {
+            throw PolonioError(ErrorKind::Runtime, "http_etag: invalid tag", interp.path(), loc);
+        }
+    }
+    // One validator per response: a later call replaces the earlier tag.
+    ctx->headers.erase(std::remove_if(ctx->headers.begin(), ctx->headers.end(),
+                                      [](const auto& header) { return http::to_lower_copy(header.first) == "etag"; }),
+                       ctx->headers.end());
+    ctx->add_header("ETag", tag);
+    auto* request = current_cgi_context(interp);
+    if (!request) {
+        return Value(false);
+    }
+    // Only a safe request may be answered from the client's copy; for other
+    // methods If-None-Match calls for 412 (RFC 9110 13.1.2), never 304, so
+    // the page must still handle the request.
+    std::string method = http::to_lower_copy(request->request_method);
+    if (!method.empty() && method != "get" && method != "head") {
+        return Value(false);
+    }
+    auto it = request->headers.find("if-none-match");
+    if (it == request->headers.end() ||
+        !http::if_none_match_matches(OutputBuffer::value_to_string(it->second), tag)) {
+        return Value(false);
+    }
+    ctx->set_status(304);
+    return Value(true);
+}
+
+Value builtin_http_flush(Interpreter& interp, const std::vector<Value>& args, const Location& loc) {
+    if (!args.empty()) {
+        throw PolonioError(ErrorKind::Runtime, "http_flush: expected 0 arguments", interp.path(), loc);
+    }
+    // Unlike the other response helpers this stays callable once headers are
+    // sent: every call after the first pushes out the output since the last.
+    if (!interp.response_context()) {
+        ErrorDetails details;
+        details.capability = "web-response";
+        details.operation = "http_flush";
+        details.builtin_reason = BuiltinFailureReason::Context;
+        throw PolonioError(ErrorCategory::Capability, "http_flush: CGI mode only", interp.path(), loc,
+                           std::move(details));
+    }
+    return Value(interp.flush_response());
+}
+
 Value builtin_request_body(Interpreter& interp, const std::vector<Value>& args, const Location& loc) {
     if (!args.empty()) {
         throw PolonioError(ErrorKind::Runtime, "request_body: expected 0 arguments", interp.path(), loc);
@@ -1304,7 +1384,8 @@ Value builtin_request_body(Interpreter& interp, const std::vector<Value>& args,
     if (!ctx) {
         return Value(std::string());
     }
-    return Value(ctx->body);
+    require_buffered_body(*ctx, "request_body", interp, loc);
+    return Value(ctx->body.str());
 }
 
 Value builtin_request_header(Interpreter& interp, const std::vector<Value>& args, const Location& loc) {
@@ -1348,7 +1429,10 @@ Value builtin_request_json(Interpreter& interp, const std::vector<Value>& args,
         throw PolonioError(ErrorKind::Runtime, "request_json: expected 0 arguments", interp.path(), loc);
     }
     auto* ctx = current_cgi_context(interp);
-    std::string body = ctx ? ctx->body : std::string();
+    if (ctx) {
+        require_buffered_body(*ctx, "request_json", interp, loc);
+    }
+    std::string body = ctx ? ctx->body.str() : std::string();
     if (body.empty()) {
         return Value();
     }
@@ -1700,26 +1784,20 @@ Value builtin_keys(Interpreter& interp, const std::vector<Value>& args, const Lo
     Value object_value = ensure_arg("keys", 0, args, interp, loc);
     if (std::holds_alternative<Value::ReadOnlyObjectPtr>(object_value.storage())) {
         const auto& obj = std::get<Value::ReadOnlyObjectPtr>(object_value.storage());
-        std::vector<std::string> names; if (obj) for (const auto& entry : *obj) names.push_back(entry.first);
-        std::sort(names.begin(), names.end()); Value::Array values; for (const auto& name : names) values.emplace_back(name);
+        Value::Array values; if (obj) for (const auto& entry : *obj) values.emplace_back(entry.first);
         return Value(std::move(values));
     }
     if (!std::holds_alternative<Value::ObjectPtr>(object_value.storage())) {
         throw PolonioError(ErrorKind::Runtime, "keys: expected object", interp.path(), loc);
     }
     auto obj = std::get<Value::ObjectPtr>(object_value.storage());
-    std::vector<std::string> keys;
+    Value::Array values;
     if (obj) {
-        keys.reserve(obj->size());
+        values.reserve(obj->size());
         for (const auto& entry : *obj) {
-            keys.push_back(entry.first);
+            values.emplace_back(entry.first);
         }
     }
-    std::sort(keys.begin(), keys.end());
-    Value::Array values;
-    for (const auto& key : keys) {
-        values.emplace_back(key);
-    }
     return Value(std::move(values));
 }
 
@@ -1790,29 +1868,18 @@ Value builtin_values(Interpreter& interp, const std::vector<Value>& args, const
     Value object_value = ensure_arg("values", 0, args, interp, loc);
     if (std::holds_alternative<Value::ReadOnlyObjectPtr>(object_value.storage())) {
         const auto& obj = std::get<Value::ReadOnlyObjectPtr>(object_value.storage());
-        std::vector<std::string> names; if (obj) for (const auto& entry : *obj) names.push_back(entry.first);
-        std::sort(names.begin(), names.end()); Value::Array result; if (obj) for (const auto& name : names) result.emplace_back(obj->at(name));
+        Value::Array result; if (obj) for (const auto& entry : *obj) result.emplace_back(entry.second);
         return Value(std::move(result));
     }
     if (!std::holds_alternative<Value::ObjectPtr>(object_value.storage())) {
         throw PolonioError(ErrorKind::Runtime, "values: expected object", interp.path(), loc);
     }
     auto obj = std::get<Value::ObjectPtr>(object_value.storage());
-    std::vector<std::string> keys;
-    if (obj) {
-        keys.reserve(obj->size());
-        for (const auto& entry : *obj) {
-            keys.push_back(entry.first);
-        }
-    }
-    std::sort(keys.begin(), keys.end());
     Value::Array result;
     if (obj) {
-        for (const auto& key : keys) {
-            auto it = obj->find(key);
-            if (it != obj->end()) {
-                result.emplace_back(it->second);
-            }
+        result.reserve(obj->size());
+        for (const auto& entry : *obj) {
+            result.emplace_back(entry.second);
         }
     }
     return Value(std::move(result));
@@ -1928,16 +1995,20 @@ Value builtin_dir_exists(Interpreter& interp, const std::vector<Value>& args, co
 }
 
 Value builtin_db_connect(Interpreter& interp, const std::vector<Value>& args, const Location& loc) {
-    if (args.size() != 1) {
-        throw PolonioError(ErrorKind::Runtime, "db_connect: expected 1 argument", interp.path(), loc);
+    if (args.size() < 1 || args.size() > 2) {
+        throw PolonioError(ErrorKind::Runtime, "db_connect: expected 1 or 2 arguments", interp.path(), loc);
     }
     const Value& path_value = ensure_arg("db_connect", 0, args, interp, loc);
     std::string relative = require_storage_path_arg("db_connect", path_value, interp, loc);
+    DatabaseOptions options;
+    if (args.size() == 2) {
+        options = parse_db_options(ensure_arg("db_connect", 1, args, interp, loc), interp, loc);
+    }
     auto* conn = interp.db_connection();
     if (!conn) {
         throw PolonioError(ErrorKind::Runtime, "db_connect: database unavailable", interp.path(), loc);
     }
-    conn->connect_relative(relative, interp, "db_connect", loc);
+    conn->connect_relative(relative, options, interp, "db_connect", loc);
     return Value();
 }
 
@@ -1964,21 +2035,15 @@ Value builtin_db_query(Interpreter& interp, const std::vector<Value>& args, cons
         const Value& params_value = ensure_arg("db_query", 1, args, interp, loc);
         params = require_array_value("db_query", params_value, interp, loc, "params must be array");
     }
-    sqlite3* db = require_db_handle(interp, "db_query", loc);
-    sqlite3_stmt* raw_stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &raw_stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        std::string message = sqlite3_errmsg(db);
-        throw PolonioError(ErrorKind::Runtime,
-                           "db_query: sqlite prepare failed: " + message,
-                           interp.path(),
-                           loc);
-    }
-    SQLiteStatementPtr stmt(raw_stmt);
+    DatabaseConnection& conn = require_db_connection(interp, "db_query", loc);
+    sqlite3* db = conn.handle();
+    PreparedStatement stmt = conn.prepare(sql, "db_query", interp, loc);
+    int rc;
     bind_sqlite_parameters(stmt.get(), params, "db_query", interp, loc);
+    RowSchema schema(stmt.get());
     Value::Array rows;
     while ((rc = sqlite3_step(stmt.get())) == SQLITE_ROW) {
-        rows.emplace_back(make_row_value(stmt.get()));
+        rows.emplace_back(schema.row(stmt.get()));
     }
     if (rc != SQLITE_DONE) {
         std::string message = sqlite3_errmsg(db);
@@ -1990,6 +2055,25 @@ Value builtin_db_query(Interpreter& interp, const std::vector<Value>& args, cons
     return Value(std::move(rows));
 }
 
+// Rows are stepped one at a time as a `for` loop asks for them, so a large
+// result never has to fit in memory at once.
+Value builtin_db_cursor(Interpreter& interp, const std::vector<Value>& args, const Location& loc) {
+    if (args.size() < 1 || args.size() > 2) {
+        throw PolonioError(ErrorKind::Runtime, "db_cursor: expected 1 or 2 arguments", interp.path(), loc);
+    }
+    const Value& sql_value = ensure_arg("db_cursor", 0, args, interp, loc);
+    std::string sql = require_string_value("db_cursor", sql_value, interp, loc, "sql must be string");
+    Value::ArrayPtr params;
+    if (args.size() == 2) {
+        const Value& params_value = ensure_arg("db_cursor", 1, args, interp, loc);
+        params = require_array_value("db_cursor", params_value, interp, loc, "params must be array");
+    }
+    DatabaseConnection& conn = require_db_connection(interp, "db_cursor", loc);
+    PreparedStatement stmt = conn.prepare(sql, "db_cursor", interp, loc);
+    bind_sqlite_parameters(stmt.get(), params, "db_cursor", interp, loc);
+    return Value(Value::IteratorPtr(std::make_shared<DatabaseCursor>(std::move(stmt), interp.path(), loc)));
+}
+
 Value builtin_db_exec(Interpreter& interp, const std::vector<Value>& args, const Location& loc) {
     if (args.size() < 1 || args.size() > 2) {
         throw PolonioError(ErrorKind::Runtime, "db_exec: expected 1 or 2 arguments", interp.path(), loc);
@@ -2001,17 +2085,10 @@ Value builtin_db_exec(Interpreter& interp, const std::vector<Value>& args, const
         const Value& params_value = ensure_arg("db_exec", 1, args, interp, loc);
         params = require_array_value("db_exec", params_value, interp, loc, "params must be array");
     }
-    sqlite3* db = require_db_handle(interp, "db_exec", loc);
-    sqlite3_stmt* raw_stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &raw_stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        std::string message = sqlite3_errmsg(db);
-        throw PolonioError(ErrorKind::Runtime,
-                           "db_exec: sqlite prepare failed: " + message,
-                           interp.path(),
-                           loc);
-    }
-    SQLiteStatementPtr stmt(raw_stmt);
+    DatabaseConnection& conn = require_db_connection(interp, "db_exec", loc);
+    sqlite3* db = conn.handle();
+    PreparedStatement stmt = conn.prepare(sql, "db_exec", interp, loc);
+    int rc;
     bind_sqlite_parameters(stmt.get(), params, "db_exec", interp, loc);
     while ((rc = sqlite3_step(stmt.get())) == SQLITE_ROW) {
         // ignore rows for exec
@@ -2023,7 +2100,9 @@ Value builtin_db_exec(Interpreter& interp, const std::vector<Value>& args, const
                            interp.path(),
                            loc);
     }
-    return Value(static_cast<double>(sqlite3_changes(db)));
+    // sqlite3_changes still holds the last write's count, possibly from an
+    // earlier request on a pooled handle, after a statement that wrote nothing.
+    return Value(static_cast<double>(sqlite3_stmt_readonly(stmt.get()) ? 0 : sqlite3_changes(db)));
 }
 
 Value builtin_db_last_insert_id(Interpreter& interp, const std::vector<Value>& args, const Location& loc) {
@@ -2122,9 +2201,32 @@ Value builtin_send_file(Interpreter& interp, const std::vector<Value>& args, con
         }
     }
     auto* ctx = require_cgi_context("send_file", interp, loc);
-    std::string body = storage_file_read(relative, interp, "send_file", loc);
+    // A single byte range gets a 206 with just that slice read from disk.
+    // send_file sends no validators, so a request carrying If-Range cannot
+    // prove its partial copy is current and gets the whole file.
+    http::ByteRange range;
+    std::uint64_t size = 0;
+    auto* request = current_cgi_context(interp);
+    if (request && request->headers.count("if-range") == 0) {
+        auto it = request->headers.find("range");
+        if (it != request->headers.end()) {
+            size = storage_file_size(relative, interp, "send_file", loc);
+            range = http::resolve_byte_range(OutputBuffer::value_to_string(it->second), size);
+        }
+    }
+    std::string body;
+    if (range.kind == http::ByteRange::Kind::Whole) {
+        body = storage_file_read(relative, interp, "send_file", loc);
+    } else if (range.kind == http::ByteRange::Kind::Partial) {
+        body = storage_file_read_range(relative, range.offset, range.length, interp, "send_file", loc);
+    }
     std::string content_type = content_type_override.empty() ? infer_mime_type(relative) : content_type_override;
     ctx->add_header("Content-Type", content_type);
+    ctx->add_header("Accept-Ranges", "bytes");
+    if (range.kind != http::ByteRange::Kind::Whole) {
+        ctx->set_status(range.kind == http::ByteRange::Kind::Partial ? 206 : 416);
+        ctx->add_header("Content-Range", http::content_range_value(range, size));
+    }
     if (!download_name.empty()) {
         std::string disposition = inline_requested ? "inline" : "attachment";
         disposition += "; filename=\"" + download_name + "\"";
@@ -2260,7 +2362,7 @@ Value builtin_send_mail(Interpreter& interp, const std::vector<Value>& args, con
 #if defined(_WIN32)
     gmtime_s(&tm, &tt);
 #else
-    tm = *std::gmtime(&tt);
+    gmtime_r(&tt, &tm);
 #endif
     std::ostringstream date_stream;
     date_stream << std::put_time(&tm, "%Y-%m-%d %H:%M:%S +0000");
@@ -2293,6 +2395,16 @@ Value builtin_send_mail(Interpreter& interp, const std::vector<Value>& args, con
 
 } // namespace
 
+std::shared_ptr<Env> builtin_environment() {
+    static const std::shared_ptr<Env> root = [] {
+        auto env = std::make_shared<Env>();
+        install_builtins(*env);
+        env->freeze();
+        return env;
+    }();
+    return root;
+}
+
 void install_builtins(Env& env) {
     env.set_local("type", Value(BuiltinFunction{"type", builtin_type}));
     env.set_local("tostring", Value(BuiltinFunction{"tostring", builtin_tostring, "to_string"}));
@@ -2327,6 +2439,7 @@ void install_builtins(Env& env) {
     env.set_local("db_connect", Value(BuiltinFunction{"db_connect", builtin_db_connect}));
     env.set_local("db_close", Value(BuiltinFunction{"db_close", builtin_db_close}));
     env.set_local("db_query", Value(BuiltinFunction{"db_query", builtin_db_query}));
+    env.set_local("db_cursor", Value(BuiltinFunction{"db_cursor", builtin_db_cursor}));
     env.set_local("db_exec", Value(BuiltinFunction{"db_exec", builtin_db_exec}));
     env.set_local("db_last_insert_id",
                   Value(BuiltinFunction{"db_last_insert_id", builtin_db_last_insert_id}));
@@ -2374,6 +2487,8 @@ void install_builtins(Env& env) {
     env.set_local("http_header", Value(BuiltinFunction{"http_header", builtin_header}));
     env.set_local("http_content_type", Value(BuiltinFunction{"http_content_type", builtin_http_content_type}));
     env.set_local("redirect", Value(BuiltinFunction{"redirect", builtin_redirect}));
+    env.set_local("http_etag", Value(BuiltinFunction{"http_etag", builtin_http_etag}));
+    env.set_local("http_flush", Value(BuiltinFunction{"http_flush", builtin_http_flush}));
     env.set_local("urlencode", Value(BuiltinFunction{"urlencode", builtin_urlencode}));
     env.set_local("urldecode", Value(BuiltinFunction{"urldecode", builtin_urldecode}));
     env.set_local("date_parts", Value(BuiltinFunction{"date_parts", builtin_date_parts}));
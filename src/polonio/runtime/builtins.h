@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 
 #include "polonio/runtime/value.h"
@@ -11,5 +12,8 @@ class Interpreter;
 struct Location;
 
 void install_builtins(Env& env);
+// Every builtin, installed once per process into a frozen scope that
+// interpreters chain their global scope onto.
+std::shared_ptr<Env> builtin_environment();
 
 }
@@ -0,0 +1,337 @@
+#include "polonio/runtime/bytecode.h"
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+
+namespace polonio {
+
+namespace {
+
+OpCode binary_opcode(BinaryOp op) {
+    switch (op) {
+    case BinaryOp::Add: return OpCode::Add;
+    case BinaryOp::Subtract: return OpCode::Subtract;
+    case BinaryOp::Multiply: return OpCode::Multiply;
+    case BinaryOp::Divide: return OpCode::Divide;
+    case BinaryOp::Modulo: return OpCode::Modulo;
+    case BinaryOp::Concat: return OpCode::Concat;
+    case BinaryOp::Equal: return OpCode::Equal;
+    case BinaryOp::NotEqual: return OpCode::NotEqual;
+    case BinaryOp::Less: return OpCode::Less;
+    case BinaryOp::LessEqual: return OpCode::LessEqual;
+    case BinaryOp::Greater: return OpCode::Greater;
+    case BinaryOp::GreaterEqual: return OpCode::GreaterEqual;
+    case BinaryOp::And:
+    case BinaryOp::Or:
+        break; // lowered to jumps by the caller
+    }
+    return OpCode::Fail;
+}
+
+// Lowers statements to a Chunk. Constructs the AST walker cannot execute are
+// compiled to Fail so they still report the same error at the same point.
+class BytecodeCompiler {
+public:
+    explicit BytecodeCompiler(bool function_body) : chunk_(std::make_shared<Chunk>()) {
+        chunk_->function_body = function_body;
+    }
+
+    std::shared_ptr<const Chunk> compile(const std::vector<StmtPtr>& statements) {
+        block(statements);
+        emit(OpCode::Halt);
+        return chunk_;
+    }
+
+private:
+    std::uint32_t emit(OpCode op, std::uint32_t a = 0, std::uint32_t b = 0) {
+        chunk_->code.push_back(Instruction{op, a, b});
+        return static_cast<std::uint32_t>(chunk_->code.size() - 1);
+    }
+
+    std::uint32_t here() const { return static_cast<std::uint32_t>(chunk_->code.size()); }
+    void patch(std::uint32_t at) { chunk_->code[at].a = here(); }
+
+    std::uint32_t name(const std::string& text) {
+        auto it = name_slots_.find(text);
+        if (it != name_slots_.end()) {
+            return it->second;
+        }
+        chunk_->names.push_back(text);
+        auto slot = static_cast<std::uint32_t>(chunk_->names.size() - 1);
+        name_slots_.emplace(text, slot);
+        return slot;
+    }
+
+    std::uint32_t variable(const std::string& text, const SlotRef& slot) {
+        auto& variables = chunk_->variables;
+        for (std::size_t i = 0; i < variables.size(); ++i) {
+            const auto& existing = variables[i];
+            if (existing.slot.depth == slot.depth && existing.slot.index == slot.index && existing.name == text) {
+                return static_cast<std::uint32_t>(i);
+            }
+        }
+        variables.push_back(Variable{text, slot});
+        return static_cast<std::uint32_t>(variables.size() - 1);
+    }
+
+    std::uint32_t location(const Location& loc) {
+        chunk_->locations.push_back(loc);
+        return static_cast<std::uint32_t>(chunk_->locations.size() - 1);
+    }
+
+    void fail(const std::string& message) { emit(OpCode::Fail, name(message)); }
+
+    void block(const std::vector<StmtPtr>& statements) {
+        for (const auto& stmt : statements) {
+            statement(stmt);
+        }
+    }
+
+    void statement(const StmtPtr& stmt) {
+        switch (stmt->kind()) {
+        case StmtKind::VarDecl: {
+            const auto& var = static_cast<const VarDeclStmt&>(*stmt);
+            if (var.has_initializer()) {
+                expression(var.initializer());
+            } else {
+                emit(OpCode::Null);
+            }
+            emit(OpCode::DefineName, variable(var.name(), var.slot()));
+            return;
+        }
+        case StmtKind::Echo: {
+            const auto& echo = static_cast<const EchoStmt&>(*stmt);
+            expression(echo.expr());
+            emit(OpCode::Echo);
+            return;
+        }
+        case StmtKind::Expr: {
+            const auto& expr_stmt = static_cast<const ExprStmt&>(*stmt);
+            expression(expr_stmt.expr());
+            emit(OpCode::Pop);
+            return;
+        }
+        case StmtKind::Return: {
+            const auto& ret = static_cast<const ReturnStmt&>(*stmt);
+            emit(OpCode::CheckReturn);
+            if (ret.has_value()) {
+                expression(ret.value());
+            } else {
+                emit(OpCode::Null);
+            }
+            emit(OpCode::Return);
+            return;
+        }
+        case StmtKind::Function: {
+            const auto& fn = static_cast<const FunctionStmt&>(*stmt);
+            FunctionProto proto;
+            proto.name = fn.name();
+            proto.params = fn.params();
+            proto.body = fn.body();
+            proto.code = compile_function_bytecode(fn);
+            proto.slot = fn.slot();
+            proto.scope = fn.scope();
+            chunk_->functions.push_back(std::move(proto));
+            emit(OpCode::Function, static_cast<std::uint32_t>(chunk_->functions.size() - 1));
+            return;
+        }
+        case StmtKind::If: {
+            const auto& if_stmt = static_cast<const IfStmt&>(*stmt);
+            std::vector<std::uint32_t> exits;
+            for (const auto& branch : if_stmt.branches()) {
+                expression(branch.condition);
+                auto skip = emit(OpCode::JumpIfFalse);
+                block(branch.body);
+                exits.push_back(emit(OpCode::Jump));
+                patch(skip);
+            }
+            block(if_stmt.else_body());
+            for (auto exit : exits) {
+                patch(exit);
+            }
+            return;
+        }
+        case StmtKind::While: {
+            const auto& while_stmt = static_cast<const WhileStmt&>(*stmt);
+            auto start = here();
+            expression(while_stmt.condition());
+            auto exit = emit(OpCode::JumpIfFalse);
+            block(while_stmt.body());
+            emit(OpCode::Jump, start);
+            patch(exit);
+            return;
+        }
+        case StmtKind::For: {
+            const auto& for_stmt = static_cast<const ForStmt&>(*stmt);
+            expression(for_stmt.iterable());
+            auto prepare = emit(OpCode::ForPrepare);
+            chunk_->loops.push_back(ForLoopInfo{for_stmt.index_name(), for_stmt.value_name(), for_stmt.scope()});
+            auto next = emit(OpCode::ForNext, 0, static_cast<std::uint32_t>(chunk_->loops.size() - 1));
+            block(for_stmt.body());
+            emit(OpCode::PopScope);
+            emit(OpCode::Jump, next);
+            patch(next);
+            emit(OpCode::ForExit);
+            patch(prepare);
+            return;
+        }
+        case StmtKind::Attempt: {
+            const auto& attempt = static_cast<const AttemptStmt&>(*stmt);
+            chunk_->recovers.push_back(RecoverInfo{attempt.recover_binding(), attempt.recover_scope()});
+            auto handler = emit(OpCode::TryBegin, 0, static_cast<std::uint32_t>(chunk_->recovers.size() - 1));
+            block(attempt.attempt_body());
+            emit(OpCode::TryEnd);
+            auto exit = emit(OpCode::Jump);
+            patch(handler);
+            block(attempt.recover_body());
+            emit(OpCode::PopScope);
+            patch(exit);
+            return;
+        }
+        case StmtKind::Include: {
+            const auto& include_stmt = static_cast<const IncludeStmt&>(*stmt);
+            emit(OpCode::Include, name(include_stmt.path()), location(include_stmt.location()));
+            return;
+        }
+        }
+        fail("statement type not supported yet");
+    }
+
+    void expression(const ExprPtr& expr) {
+        switch (expr->kind()) {
+        case ExprKind::Literal: {
+            const auto& literal = static_cast<const LiteralExpr&>(*expr);
+            const auto& storage = literal.value().storage();
+            if (std::holds_alternative<std::monostate>(storage)) {
+                emit(OpCode::Null);
+            } else if (std::holds_alternative<bool>(storage)) {
+                emit(std::get<bool>(storage) ? OpCode::True : OpCode::False);
+            } else {
+                constant(literal.value());
+            }
+            return;
+        }
+        case ExprKind::Identifier: {
+            const auto& ident = static_cast<const IdentifierExpr&>(*expr);
+            emit(OpCode::LoadName, variable(ident.name(), ident.slot()));
+            return;
+        }
+        case ExprKind::Unary: {
+            const auto& unary = static_cast<const UnaryExpr&>(*expr);
+            expression(unary.right());
+            emit(unary.op() == UnaryOp::Negate ? OpCode::Negate : OpCode::Not);
+            return;
+        }
+        case ExprKind::Binary: {
+            const auto& binary = static_cast<const BinaryExpr&>(*expr);
+            const BinaryOp op = binary.op();
+            if (op == BinaryOp::And || op == BinaryOp::Or) {
+                expression(binary.left());
+                auto short_circuit = emit(op == BinaryOp::And ? OpCode::JumpIfFalse : OpCode::JumpIfTrue);
+                expression(binary.right());
+                emit(OpCode::ToBool);
+                auto exit = emit(OpCode::Jump);
+                patch(short_circuit);
+                emit(op == BinaryOp::And ? OpCode::False : OpCode::True);
+                patch(exit);
+                return;
+            }
+            expression(binary.left());
+            expression(binary.right());
+            emit(binary_opcode(op), static_cast<std::uint32_t>(op));
+            return;
+        }
+        case ExprKind::Assignment: {
+            const auto& assignment = static_cast<const AssignmentExpr&>(*expr);
+            if (assignment.target()->kind() == ExprKind::Index) {
+                fail("index assignment not supported yet");
+                return;
+            }
+            if (assignment.target()->kind() != ExprKind::Identifier) {
+                fail("assignment target must be an identifier");
+                return;
+            }
+            const auto& ident = static_cast<const IdentifierExpr&>(*assignment.target());
+            expression(assignment.value());
+            auto target = variable(ident.name(), ident.slot());
+            if (assignment.op() == AssignOp::Assign) {
+                emit(OpCode::StoreName, target);
+            } else {
+                emit(OpCode::CompoundStore, target, static_cast<std::uint32_t>(assignment.op()));
+            }
+            return;
+        }
+        case ExprKind::Call: {
+            const auto& call = static_cast<const CallExpr&>(*expr);
+            expression(call.callee());
+            for (const auto& arg : call.args()) {
+                expression(arg);
+            }
+            emit(OpCode::Call, static_cast<std::uint32_t>(call.args().size()), location(call.location()));
+            return;
+        }
+        case ExprKind::Index: {
+            const auto& index = static_cast<const IndexExpr&>(*expr);
+            expression(index.object());
+            expression(index.index());
+            emit(OpCode::Index);
+            return;
+        }
+        case ExprKind::ArrayLiteral: {
+            const auto& array = static_cast<const ArrayLiteralExpr&>(*expr);
+            for (const auto& element : array.elements()) {
+                expression(element);
+            }
+            emit(OpCode::MakeArray, static_cast<std::uint32_t>(array.elements().size()));
+            return;
+        }
+        case ExprKind::ObjectLiteral: {
+            const auto& object = static_cast<const ObjectLiteralExpr&>(*expr);
+            for (const auto& field : object.fields()) {
+                expression(field.second);
+            }
+            chunk_->object_keys.push_back(object.keys());
+            emit(OpCode::MakeObject, static_cast<std::uint32_t>(chunk_->object_keys.size() - 1));
+            return;
+        }
+        }
+        fail("expression type not supported yet");
+    }
+
+    void constant(Value value) {
+        chunk_->constants.push_back(std::move(value));
+        emit(OpCode::Constant, static_cast<std::uint32_t>(chunk_->constants.size() - 1));
+    }
+
+    std::shared_ptr<Chunk> chunk_;
+    std::unordered_map<std::string, std::uint32_t> name_slots_;
+};
+
+} // namespace
+
+std::shared_ptr<const Chunk> compile_bytecode(const Program& program) {
+    // Two threads may both compile a new program; either result is correct.
+    auto code = program.bytecode();
+    if (!code) {
+        code = BytecodeCompiler(false).compile(program.statements());
+        program.set_bytecode(code);
+    }
+    return code;
+}
+
+std::shared_ptr<const Chunk> compile_function_bytecode(const FunctionStmt& function) {
+    auto code = function.bytecode();
+    if (!code) {
+        code = compile_function_bytecode(function.body());
+        function.set_bytecode(code);
+    }
+    return code;
+}
+
+std::shared_ptr<const Chunk> compile_function_bytecode(const std::vector<StmtPtr>& body) {
+    return BytecodeCompiler(true).compile(body);
+}
+
+} // namespace polonio
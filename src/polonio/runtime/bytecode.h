@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "polonio/common/location.h"
+#include "polonio/parser/ast.h"
+#include "polonio/runtime/value.h"
+
+namespace polonio {
+
+// Stack machine instruction set. Operand meaning is listed per opcode; unused
+// operands are zero. Arithmetic and comparison opcodes carry their BinaryOp in
+// `a` so slow paths can defer to the interpreter.
+enum class OpCode : std::uint8_t {
+    Constant,      // push constants[a]
+    Null,          // push null
+    True,          // push true
+    False,         // push false
+    Pop,           // discard top
+    LoadName,      // push variables[a]
+    DefineName,    // pop into a new local variables[a]
+    StoreName,     // assign top to variables[a]; value stays on the stack
+    CompoundStore, // variables[a] = variables[a] <b> pop; push result (b is an AssignOp)
+    Negate,
+    Not,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Modulo,
+    Concat,
+    Equal,
+    NotEqual,
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    ToBool,        // replace top with its truthiness
+    Jump,          // pc = a
+    JumpIfFalse,   // pop; pc = a when falsy
+    JumpIfTrue,    // pop; pc = a when truthy
+    Index,         // pop index and collection; push element
+    MakeArray,     // pop a values; push array
+    MakeObject,    // pop values for object_keys[a]; push object
+    Call,          // pop a arguments and callee; push result (b = locations index)
+    Echo,          // pop and write to the response
+    Function,      // bind functions[a] in the current scope
+    Include,       // include names[a] (b = locations index)
+    CheckReturn,   // fail when not inside a function call
+    Return,        // pop and return from the current function
+    ForPrepare,    // pop iterable and start a loop; pc = a when it is a null collection
+    ForNext,       // bind the next element of loops[b] in a new scope, or pc = a when done
+    ForExit,       // drop the innermost loop state
+    PopScope,      // leave the innermost loop or recover scope
+    TryBegin,      // install the recover handler recovers[b] at a
+    TryEnd,        // remove the innermost recover handler
+    Fail,          // raise a runtime error with message names[a]
+    Halt,          // end of code; returns null
+};
+
+struct Instruction {
+    OpCode op;
+    std::uint32_t a = 0;
+    std::uint32_t b = 0;
+};
+
+// A variable reference with the slot the resolver gave it.
+struct Variable {
+    std::string name;
+    SlotRef slot;
+};
+
+struct ForLoopInfo {
+    std::optional<std::string> index_name;
+    std::string value_name;
+    std::shared_ptr<const ScopeLayout> scope;
+};
+
+struct RecoverInfo {
+    std::optional<std::string> binding;
+    std::shared_ptr<const ScopeLayout> scope;
+};
+
+struct Chunk;
+
+struct FunctionProto {
+    std::string name;
+    std::vector<std::string> params;
+    std::vector<StmtPtr> body;
+    std::shared_ptr<const Chunk> code;
+    SlotRef slot;
+    std::shared_ptr<const ScopeLayout> scope;
+};
+
+struct Chunk {
+    std::vector<Instruction> code;
+    std::vector<Value> constants;
+    std::vector<std::string> names;
+    std::vector<Variable> variables;
+    std::vector<Location> locations;
+    std::vector<std::vector<std::string>> object_keys;
+    std::vector<ForLoopInfo> loops;
+    std::vector<RecoverInfo> recovers;
+    std::vector<FunctionProto> functions;
+    // Function bodies return with Return; a program reaching Return is an
+    // included file executing inside a caller, which unwinds to that call.
+    bool function_body = false;
+};
+
+// Both compile on first use and return the chunk kept on the node after that.
+std::shared_ptr<const Chunk> compile_bytecode(const Program& program);
+std::shared_ptr<const Chunk> compile_function_bytecode(const FunctionStmt& function);
+// Compiles `body` afresh; for function values that did not come from a
+// FunctionStmt the caller can keep.
+std::shared_ptr<const Chunk> compile_function_bytecode(const std::vector<StmtPtr>& body);
+
+} // namespace polonio
@@ -1,10 +1,11 @@
 #include "polonio/runtime/cgi.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <sstream>
 #include <string>
 
 #include "polonio/common/error.h"
@@ -12,6 +13,7 @@
 #include "polonio/runtime/interpreter.h"
 #include "polonio/runtime/storage.h"
 #include "polonio/runtime/http_request_utils.h"
+#include "polonio/runtime/multipart.h"
 
 extern char** environ;
 
@@ -88,17 +90,24 @@ Value::Object build_headers_object() {
     return headers;
 }
 
-std::string read_request_body(const std::string& content_length) {
+// Reads the body in fixed-size pieces so a large upload spools to disk
+// instead of being held in memory.
+RequestBody read_request_body(const std::string& content_length) {
+    RequestBody body;
     if (content_length.empty()) {
-        return std::string();
+        return body;
     }
-    std::size_t len = static_cast<std::size_t>(std::strtoul(content_length.c_str(), nullptr, 10));
-    if (len == 0) {
-        return std::string();
+    std::uint64_t remaining = std::strtoull(content_length.c_str(), nullptr, 10);
+    char chunk[64 * 1024];
+    while (remaining > 0) {
+        std::cin.read(chunk, static_cast<std::streamsize>(std::min<std::uint64_t>(remaining, sizeof(chunk))));
+        std::size_t got = static_cast<std::size_t>(std::cin.gcount());
+        if (got == 0) {
+            break;
+        }
+        body.append(chunk, got);
+        remaining -= got;
     }
-    std::string body(len, '\0');
-    std::cin.read(&body[0], len);
-    body.resize(static_cast<std::size_t>(std::cin.gcount()));
     return body;
 }
 
@@ -122,7 +131,6 @@ CGIContext build_cgi_context() {
     ctx.cookie = http::parse_cookie_header(get_env("HTTP_COOKIE"));
     ctx.post = Value::Object();
     ctx.files = Value::Object();
-    ctx.body.clear();
 
     ctx.request_method = get_env("REQUEST_METHOD");
     ctx.content_type = get_env("CONTENT_TYPE");
@@ -152,7 +160,10 @@ void process_request_body(CGIContext& ctx, Interpreter& interpreter) {
     }
     std::string lowered = http::to_lower_copy(content_type);
     if (lowered.rfind("application/x-www-form-urlencoded", 0) == 0) {
-        ctx.post = http::parse_post_body(ctx.body);
+        if (ctx.body.size() > RequestBody::kMaxBufferedBytes) {
+            throw PolonioError(ErrorKind::Runtime, "request body too large", interpreter.path(), Location::start());
+        }
+        ctx.post = http::parse_post_body(ctx.body.str());
         return;
     }
     if (lowered.rfind("multipart/form-data", 0) != 0) {
@@ -180,11 +191,6 @@ void process_request_body(CGIContext& ctx, Interpreter& interpreter) {
     if (ctx.body.empty()) {
         return;
     }
-    std::string marker = "--" + boundary;
-    const std::string& body = ctx.body;
-    if (body.compare(0, marker.size(), marker) != 0) {
-        runtime_error("invalid multipart body");
-    }
     std::string root = storage_root(interpreter, "multipart upload", Location::start());
     std::filesystem::path root_path(root);
     std::filesystem::path uploads_rel = std::filesystem::path("tmp") / "uploads";
@@ -194,124 +200,82 @@ void process_request_body(CGIContext& ctx, Interpreter& interpreter) {
     if (ec) {
         runtime_error("unable to create upload directory");
     }
-    std::size_t pos = marker.size();
-    if (body.compare(pos, 2, "--") == 0) {
-        return;
-    }
-    if (body.compare(pos, 2, "\r\n") != 0) {
-        runtime_error("invalid multipart body");
-    }
-    pos += 2;
-    while (true) {
-        std::size_t headers_end = body.find("\r\n\r\n", pos);
-        if (headers_end == std::string::npos) {
-            runtime_error("invalid multipart body");
+
+    // The part being received. File contents go straight to their upload
+    // file; only text field values are held in memory.
+    struct Part {
+        http::MultipartParser::PartHeaders headers;
+        std::string text;
+        std::ofstream file;
+        std::filesystem::path relative_file;
+        std::uint64_t size = 0;
+    } part;
+    http::MultipartParser::Handler handler;
+    handler.begin_part = [&](const http::MultipartParser::PartHeaders& headers) {
+        part.headers = headers;
+        part.text.clear();
+        part.size = 0;
+        if (headers.filename.empty()) {
+            return;
         }
-        std::string header_block = body.substr(pos, headers_end - pos);
-        pos = headers_end + 4;
-        std::size_t delim = body.find("\r\n" + marker, pos);
-        if (delim == std::string::npos) {
-            runtime_error("invalid multipart body");
+        std::string extension;
+        auto dot = headers.filename.find_last_of('.');
+        if (dot != std::string::npos) {
+            extension = headers.filename.substr(dot);
         }
-        std::string data = body.substr(pos, delim - pos);
-        pos = delim + 2 + marker.size();
-        bool final = false;
-        if (pos <= body.size() && body.compare(pos, 2, "--") == 0) {
-            pos += 2;
-            final = true;
-            if (pos <= body.size() && body.compare(pos, 2, "\r\n") == 0) {
-                pos += 2;
-            }
-        } else if (pos <= body.size() && body.compare(pos, 2, "\r\n") == 0) {
-            pos += 2;
-        } else if (pos == body.size()) {
-            final = true;
-        } else {
-            runtime_error("invalid multipart body");
+        std::string random_name = random_hex_string(16, interpreter);
+        part.relative_file = uploads_rel / (random_name + extension);
+        part.file.open(root_path / part.relative_file, std::ios::binary | std::ios::trunc);
+        if (!part.file) {
+            runtime_error("unable to write upload");
         }
-
-        std::string field_name;
-        std::string filename;
-        std::string part_type;
-
-        std::size_t line_start = 0;
-        while (line_start < header_block.size()) {
-            std::size_t line_end = header_block.find("\r\n", line_start);
-            std::string line = header_block.substr(
-                line_start,
-                (line_end == std::string::npos ? header_block.size() : line_end) - line_start);
-            if (line_end == std::string::npos) {
-                line_start = header_block.size();
-            } else {
-                line_start = line_end + 2;
-            }
-            if (line.empty()) continue;
-            auto colon = line.find(':');
-            if (colon == std::string::npos) {
-                runtime_error("invalid multipart body");
-            }
-            std::string key = http::to_lower_copy(http::trim_whitespace(line.substr(0, colon)));
-            std::string value = http::trim_whitespace(line.substr(colon + 1));
-            if (key == "content-disposition") {
-                std::stringstream ss(value);
-                std::string token;
-                bool first_token = true;
-                while (std::getline(ss, token, ';')) {
-                    token = http::trim_whitespace(token);
-                    if (token.empty()) continue;
-                    if (first_token) {
-                        first_token = false;
-                        continue;
-                    }
-                    auto eq = token.find('=');
-                    if (eq == std::string::npos) continue;
-                    std::string param_key = http::to_lower_copy(http::trim_whitespace(token.substr(0, eq)));
-                    std::string param_value = http::trim_whitespace(token.substr(eq + 1));
-                    if (!param_value.empty() && param_value.front() == '"' && param_value.back() == '"') {
-                        param_value = param_value.substr(1, param_value.size() - 2);
-                    }
-                    if (param_key == "name") {
-                        field_name = param_value;
-                    } else if (param_key == "filename") {
-                        filename = param_value;
-                    }
-                }
-            } else if (key == "content-type") {
-                part_type = value;
-            }
+    };
+    handler.part_data = [&](const char* data, std::size_t size) {
+        part.size += size;
+        if (part.headers.filename.empty()) {
+            part.text.append(data, size);
+            return;
         }
-
-        if (field_name.empty()) {
-            runtime_error("invalid multipart body");
+        part.file.write(data, static_cast<std::streamsize>(size));
+        if (!part.file) {
+            runtime_error("unable to write upload");
         }
-
-        if (filename.empty()) {
-            http::append_form_value(ctx.post, field_name, Value(data));
-        } else {
-            std::string extension;
-            auto dot = filename.find_last_of('.');
-            if (dot != std::string::npos) {
-                extension = filename.substr(dot);
-            }
-            std::string random_name = random_hex_string(16, interpreter);
-            std::filesystem::path relative_file = uploads_rel / (random_name + extension);
-            std::filesystem::path absolute_file = root_path / relative_file;
-            std::ofstream out(absolute_file, std::ios::binary);
-            out.write(data.data(), static_cast<std::streamsize>(data.size()));
-            if (!out) {
-                runtime_error("unable to write upload");
-            }
-            Value::Object file_entry;
-            file_entry["name"] = Value(filename);
-            file_entry["type"] = Value(part_type.empty() ? std::string("application/octet-stream") : part_type);
-            file_entry["size"] = Value(static_cast<double>(data.size()));
-            file_entry["tmp_path"] = Value(relative_file.generic_string());
-            http::append_form_value(ctx.files, field_name, Value(std::move(file_entry)));
+    };
+    handler.end_part = [&]() {
+        if (part.headers.filename.empty()) {
+            http::append_form_value(ctx.post, part.headers.name, Value(std::move(part.text)));
+            return;
         }
+        part.file.close();
+        if (!part.file) {
+            runtime_error("unable to write upload");
+        }
+        Value::Object file_entry;
+        file_entry["name"] = Value(part.headers.filename);
+        file_entry["type"] = Value(part.headers.content_type.empty() ? std::string("application/octet-stream")
+                                                                     : part.headers.content_type);
+        file_entry["size"] = Value(static_cast<double>(part.size));
+        file_entry["tmp_path"] = Value(part.relative_file.generic_string());
+        http::append_form_value(ctx.files, part.headers.name, Value(std::move(file_entry)));
+    };
 
-        if (final) {
-            break;
+    http::MultipartParser parser(boundary, std::move(handler));
+    char chunk[64 * 1024];
+    try {
+        std::uint64_t offset = 0;
+        while (std::size_t got = ctx.body.read(offset, chunk, sizeof(chunk))) {
+            parser.feed(chunk, got);
+            offset += got;
         }
+        parser.finish();
+    } catch (const PolonioError&) {
+        throw;
+    } catch (const std::runtime_error&) {
+        if (part.file.is_open()) {
+            part.file.close();
+            std::filesystem::remove(root_path / part.relative_file, ec);
+        }
+        runtime_error("invalid multipart body");
     }
 }
 
@@ -3,6 +3,7 @@
 #include <string>
 #include <utility>
 
+#include "polonio/runtime/request_body.h"
 #include "polonio/runtime/value.h"
 
 namespace polonio {
@@ -14,7 +15,7 @@ struct CGIContext {
     Value::Object cookie;
     Value::Object server;
     Value::Object headers;
-    std::string body;
+    RequestBody body;
     std::string script_filename;
     std::string request_method;
     std::string content_type;
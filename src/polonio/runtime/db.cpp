@@ -1,8 +1,14 @@
 #include "polonio/runtime/db.h"
 
+#include <sys/stat.h>
+
+#include <algorithm>
 #include <filesystem>
+#include <iterator>
 #include <limits>
+#include <list>
 #include <string>
+#include <unordered_map>
 
 #include "polonio/common/error.h"
 #include "polonio/runtime/interpreter.h"
@@ -10,17 +16,416 @@
 
 namespace polonio {
 
+// Idle statements for one connection, keyed by SQL text. A statement in use
+// is out of the cache, so a second use of the same SQL while the first is
+// still stepping compiles its own copy.
+class StatementCache {
+public:
+    StatementCache(sqlite3* handle, std::size_t capacity) : handle_(handle), capacity_(capacity) {}
+    ~StatementCache() { close(); }
+    StatementCache(const StatementCache&) = delete;
+    StatementCache& operator=(const StatementCache&) = delete;
+
+    // Returns an idle statement for `sql`, or null when it must be compiled.
+    sqlite3_stmt* take(const std::string& sql) {
+        auto it = index_.find(sql);
+        if (it == index_.end()) {
+            ++misses_;
+            return nullptr;
+        }
+        ++hits_;
+        ++outstanding_;
+        sqlite3_stmt* stmt = it->second->stmt;
+        entries_.erase(it->second);
+        index_.erase(it);
+        return stmt;
+    }
+
+    // Records a statement compiled after a miss, which comes back through
+    // give_back like a cached one.
+    void lend_new() { ++outstanding_; }
+
+    void give_back(const std::string& sql, sqlite3_stmt* stmt) {
+        --outstanding_;
+        // After close the connection is going away; nothing is kept.
+        if (!handle_ || index_.count(sql) != 0) {
+            sqlite3_finalize(stmt);
+            return;
+        }
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        entries_.push_front(Entry{sql, stmt});
+        index_[sql] = entries_.begin();
+        if (entries_.size() > capacity_) {
+            index_.erase(entries_.back().sql);
+            sqlite3_finalize(entries_.back().stmt);
+            entries_.pop_back();
+        }
+    }
+
+    void close() {
+        for (auto& entry : entries_) {
+            sqlite3_finalize(entry.stmt);
+        }
+        entries_.clear();
+        index_.clear();
+        handle_ = nullptr;
+    }
+
+    StatementCacheStats stats() const { return StatementCacheStats{hits_, misses_, entries_.size()}; }
+    bool open() const { return handle_ != nullptr; }
+    // Statements checked out and not yet given back.
+    std::size_t outstanding() const { return outstanding_; }
+
+private:
+    struct Entry {
+        std::string sql;
+        sqlite3_stmt* stmt;
+    };
+
+    sqlite3* handle_;
+    std::size_t capacity_;
+    // Most recently used first.
+    std::list<Entry> entries_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    std::size_t hits_ = 0;
+    std::size_t misses_ = 0;
+    std::size_t outstanding_ = 0;
+};
+
+PreparedStatement::~PreparedStatement() { release(); }
+
+PreparedStatement::PreparedStatement(PreparedStatement&& other) noexcept
+    : cache_(std::move(other.cache_)), sql_(std::move(other.sql_)), stmt_(other.stmt_) {
+    other.stmt_ = nullptr;
+}
+
+PreparedStatement& PreparedStatement::operator=(PreparedStatement&& other) noexcept {
+    if (this != &other) {
+        release();
+        cache_ = std::move(other.cache_);
+        sql_ = std::move(other.sql_);
+        stmt_ = other.stmt_;
+        other.stmt_ = nullptr;
+    }
+    return *this;
+}
+
+void PreparedStatement::release() {
+    if (stmt_) {
+        cache_->give_back(sql_, stmt_);
+        stmt_ = nullptr;
+    }
+    cache_.reset();
+}
+
+bool PreparedStatement::connected() const { return cache_ && cache_->open(); }
+
+namespace {
+
+Value sqlite_value_from_column(sqlite3_stmt* stmt, int index) {
+    int column_type = sqlite3_column_type(stmt, index);
+    switch (column_type) {
+        case SQLITE_INTEGER:
+            return Value(static_cast<double>(sqlite3_column_int64(stmt, index)));
+        case SQLITE_FLOAT:
+            return Value(sqlite3_column_double(stmt, index));
+        case SQLITE_TEXT: {
+            const unsigned char* text = sqlite3_column_text(stmt, index);
+            int len = sqlite3_column_bytes(stmt, index);
+            if (!text) {
+                return Value(std::string());
+            }
+            return Value(std::string(reinterpret_cast<const char*>(text), static_cast<std::size_t>(len)));
+        }
+        case SQLITE_BLOB: {
+            const void* blob = sqlite3_column_blob(stmt, index);
+            int len = sqlite3_column_bytes(stmt, index);
+            if (!blob) {
+                return Value(std::string());
+            }
+            return Value(std::string(reinterpret_cast<const char*>(blob), static_cast<std::size_t>(len)));
+        }
+        case SQLITE_NULL:
+        default:
+            return Value();
+    }
+}
+
+} // namespace
+
+RowSchema::RowSchema(sqlite3_stmt* stmt) {
+    int column_count = sqlite3_column_count(stmt);
+    columns_.reserve(static_cast<std::size_t>(column_count));
+    for (int i = 0; i < column_count; ++i) {
+        const char* name = sqlite3_column_name(stmt, i);
+        columns_.emplace_back(name ? std::string(name) : ("column" + std::to_string(i)), i);
+    }
+    // Lay the keys out in object order once; a repeated name keeps its last
+    // column, as it would if each row were built entry by entry.
+    std::stable_sort(columns_.begin(), columns_.end(),
+                     [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+    auto out = columns_.begin();
+    for (auto it = columns_.begin(); it != columns_.end(); ++it) {
+        auto next = std::next(it);
+        if (next != columns_.end() && next->first == it->first) {
+            continue;
+        }
+        if (out != it) {
+            *out = std::move(*it);
+        }
+        ++out;
+    }
+    columns_.erase(out, columns_.end());
+}
+
+Value RowSchema::row(sqlite3_stmt* stmt) const {
+    std::vector<Value::Object::value_type> entries;
+    entries.reserve(columns_.size());
+    for (const auto& [key, index] : columns_) {
+        entries.emplace_back(key, sqlite_value_from_column(stmt, index));
+    }
+    return Value(Value::Object::from_sorted(std::move(entries)));
+}
+
+bool DatabaseCursor::next(Value& index, Value& element) {
+    if (!statement_.get()) {
+        return false;
+    }
+    if (!statement_.connected()) {
+        statement_ = PreparedStatement();
+        ErrorDetails details;
+        details.capability = "sqlite";
+        details.operation = "cursor-step";
+        details.builtin_reason = BuiltinFailureReason::Configuration;
+        details.configuration_name = "database-connection";
+        throw PolonioError(ErrorCategory::Capability, "db_cursor: database connection closed", path_, location_,
+                           std::move(details));
+    }
+    int rc = sqlite3_step(statement_.get());
+    if (rc == SQLITE_ROW) {
+        index = Value(static_cast<double>(row_++));
+        element = schema_.row(statement_.get());
+        return true;
+    }
+    std::string message = rc == SQLITE_DONE ? std::string() : sqlite3_errmsg(sqlite3_db_handle(statement_.get()));
+    // Done or failed: hand the statement back so it stops holding a read
+    // transaction.
+    statement_ = PreparedStatement();
+    if (rc != SQLITE_DONE) {
+        throw PolonioError(ErrorKind::Runtime, "db_cursor: sqlite step failed: " + message, path_, location_);
+    }
+    return false;
+}
+
 DatabaseConnection::~DatabaseConnection() { close(); }
 
 void DatabaseConnection::close() {
     if (handle_) {
-        sqlite3_close(handle_);
+        DatabasePool::shared().release(path_, std::move(pooled_));
+        pooled_ = DatabasePool::Handle();
         handle_ = nullptr;
+        path_.clear();
     }
     transaction_active_ = false;
 }
 
+PreparedStatement DatabaseConnection::prepare(const std::string& sql,
+                                              const std::string& builtin_name,
+                                              Interpreter& interp,
+                                              const Location& loc) {
+    const auto& statements = pooled_.statements;
+    if (sqlite3_stmt* cached = statements->take(sql)) {
+        return PreparedStatement(statements, sql, cached);
+    }
+    sqlite3_stmt* stmt = nullptr;
+    int rc = sqlite3_prepare_v2(handle_, sql.c_str(), static_cast<int>(sql.size()), &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        std::string message = sqlite3_errmsg(handle_);
+        throw PolonioError(ErrorKind::Runtime,
+                           builtin_name + ": sqlite prepare failed: " + message,
+                           interp.path(),
+                           loc);
+    }
+    statements->lend_new();
+    return PreparedStatement(statements, sql, stmt);
+}
+
+StatementCacheStats DatabaseConnection::statement_cache_stats() const {
+    return pooled_.statements ? pooled_.statements->stats() : StatementCacheStats{};
+}
+
+DatabasePool& DatabasePool::shared() {
+    static DatabasePool pool;
+    return pool;
+}
+
+DatabasePool::~DatabasePool() {
+    for (auto& database : databases_) {
+        for (auto& handle : database.second.idle) {
+            close_handle(handle);
+        }
+    }
+}
+
+namespace {
+
+bool stat_identity(const std::string& path, std::uint64_t& device, std::uint64_t& inode) {
+    struct stat info {};
+    if (::stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    device = static_cast<std::uint64_t>(info.st_dev);
+    inode = static_cast<std::uint64_t>(info.st_ino);
+    return true;
+}
+
+int note_pragma_assignment(void* assigned, int action, const char*, const char* value, const char*, const char*) {
+    if (action == SQLITE_PRAGMA && value) {
+        *static_cast<bool*>(assigned) = true;
+    }
+    return SQLITE_OK;
+}
+
+// True when `sql` yields a row, or fails.
+bool yields_row(sqlite3* db, const char* sql) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return true;
+    }
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return rc != SQLITE_DONE;
+}
+
+// TEMP tables and attached databases are visible to whoever uses the handle
+// next, so a handle holding either is not reused.
+bool holds_request_schema(sqlite3* db) {
+    return yields_row(db, "SELECT 1 FROM temp.sqlite_master LIMIT 1") ||
+           yields_row(db, "SELECT 1 FROM pragma_database_list WHERE name NOT IN ('main', 'temp') LIMIT 1");
+}
+
+} // namespace
+
+DatabasePool::Status DatabasePool::acquire(const std::string& path, Handle& handle) {
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    const bool exists = stat_identity(path, device, inode);
+    std::unique_lock<std::mutex> lock(mutex_);
+    Database& database = databases_[path];
+    while (true) {
+        while (!database.idle.empty()) {
+            Handle candidate = std::move(database.idle.back());
+            database.idle.pop_back();
+            if (exists && candidate.device == device && candidate.inode == inode) {
+                // A fresh handle reports no insert yet.
+                sqlite3_set_last_insert_rowid(candidate.db, 0);
+                ++reused_;
+                handle = std::move(candidate);
+                return Status::Ok;
+            }
+            // The file was removed or replaced since this handle opened it.
+            close_handle(candidate);
+            database.open -= 1;
+        }
+        if (database.open < max_per_database_) {
+            break;
+        }
+        if (!returned_.wait_for(lock, wait_, [&] {
+                return !database.idle.empty() || database.open < max_per_database_;
+            })) {
+            return Status::Exhausted;
+        }
+    }
+    database.open += 1;
+    lock.unlock();
+
+    sqlite3* db = nullptr;
+    if (sqlite3_open(path.c_str(), &db) != SQLITE_OK) {
+        sqlite3_close(db);
+        lock.lock();
+        databases_[path].open -= 1;
+        returned_.notify_one();
+        return Status::OpenFailed;
+    }
+    handle = Handle();
+    handle.db = db;
+    handle.statements = std::make_shared<StatementCache>(db, DatabaseConnection::kStatementCacheCapacity);
+    handle.pragma_assigned = std::make_shared<bool>(false);
+    sqlite3_set_authorizer(db, note_pragma_assignment, handle.pragma_assigned.get());
+    stat_identity(path, handle.device, handle.inode);
+    lock.lock();
+    ++opened_;
+    return Status::Ok;
+}
+
+void DatabasePool::release(const std::string& path, Handle handle) {
+    // Leave nothing from the last request behind: a transaction it left open
+    // is rolled back, and a handle with statements still checked out, one
+    // that cannot roll back, or one carrying session state is not reused.
+    bool reusable = handle.statements->outstanding() == 0 && !*handle.pragma_assigned;
+    if (reusable && !sqlite3_get_autocommit(handle.db)) {
+        reusable = sqlite3_exec(handle.db, "ROLLBACK", nullptr, nullptr, nullptr) == SQLITE_OK;
+    }
+    if (reusable) {
+        reusable = !holds_request_schema(handle.db);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    Database& database = databases_[path];
+    if (reusable) {
+        database.idle.push_back(std::move(handle));
+    } else {
+        close_handle(handle);
+        database.open -= 1;
+    }
+    returned_.notify_one();
+}
+
+DatabasePoolStats DatabasePool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DatabasePoolStats stats;
+    stats.opened = opened_;
+    stats.reused = reused_;
+    for (const auto& database : databases_) {
+        stats.idle += database.second.idle.size();
+    }
+    return stats;
+}
+
+void DatabasePool::close_handle(Handle& handle) {
+    handle.statements->close();
+    // Statements still checked out are finalized when released; until then
+    // sqlite keeps the handle alive.
+    sqlite3_close_v2(handle.db);
+    handle = Handle();
+}
+
+namespace {
+
+// Applies `options` to a handle, returning the failing statement's message
+// or an empty string.
+std::string configure_handle(sqlite3* handle, const DatabaseOptions& options) {
+    sqlite3_busy_timeout(handle, static_cast<int>(options.busy_timeout_ms));
+    const std::string pragmas = "PRAGMA journal_mode=" + options.journal_mode +
+                                ";PRAGMA synchronous=" + options.synchronous +
+                                ";PRAGMA cache_size=" + std::to_string(options.cache_size) +
+                                ";PRAGMA mmap_size=" + std::to_string(options.mmap_size) +
+                                ";PRAGMA temp_store=" + options.temp_store + ";";
+    char* errmsg = nullptr;
+    if (sqlite3_exec(handle, pragmas.c_str(), nullptr, nullptr, &errmsg) != SQLITE_OK) {
+        std::string message = errmsg ? errmsg : sqlite3_errmsg(handle);
+        sqlite3_free(errmsg);
+        return message.empty() ? std::string("unknown error") : message;
+    }
+    return std::string();
+}
+
+} // namespace
+
 void DatabaseConnection::connect_relative(const std::string& relative_path,
+                                          const DatabaseOptions& options,
                                           Interpreter& interp,
                                           const std::string& builtin_name,
                                           const Location& loc) {
@@ -41,25 +446,42 @@ void DatabaseConnection::connect_relative(const std::string& relative_path,
                            loc);
     }
     close();
-    sqlite3* new_handle = nullptr;
-    int rc = sqlite3_open(resolved.c_str(), &new_handle);
-    if (rc != SQLITE_OK) {
-        std::string message = "unknown error";
-        if (new_handle) {
-            message = sqlite3_errmsg(new_handle);
-            sqlite3_close(new_handle);
-        }
+    DatabasePool::Handle handle;
+    DatabasePool::Status status = DatabasePool::shared().acquire(resolved, handle);
+    if (status != DatabasePool::Status::Ok) {
+        const bool exhausted = status == DatabasePool::Status::Exhausted;
         ErrorDetails details;
         details.resource = "sqlite";
-        details.operation = "open-database";
+        details.operation = exhausted ? "acquire-connection" : "open-database";
         details.builtin_reason = BuiltinFailureReason::Operation;
         throw PolonioError(ErrorCategory::Resource,
-                           builtin_name + ": failed to open database",
+                           builtin_name + (exhausted ? ": no database connection available"
+                                                     : ": failed to open database"),
                            interp.path(),
                            loc, std::move(details));
     }
-    handle_ = new_handle;
+    pooled_ = std::move(handle);
+    handle_ = pooled_.db;
+    path_ = resolved;
     transaction_active_ = false;
+    if (!pooled_.configured || pooled_.options != options) {
+        std::string failure = configure_handle(handle_, options);
+        if (!failure.empty()) {
+            close();
+            ErrorDetails details;
+            details.resource = "sqlite";
+            details.operation = "configure-database";
+            details.builtin_reason = BuiltinFailureReason::Operation;
+            throw PolonioError(ErrorCategory::Resource,
+                               builtin_name + ": failed to configure database: " + failure,
+                               interp.path(),
+                               loc, std::move(details));
+        }
+        pooled_.configured = true;
+        pooled_.options = options;
+        // Our own settings are kept with the handle.
+        *pooled_.pragma_assigned = false;
+    }
 }
 
 namespace {
@@ -156,9 +578,9 @@ void DatabaseConnection::rollback_transaction(const std::string& builtin_name,
     transaction_active_ = false;
 }
 
-sqlite3* require_db_handle(Interpreter& interp,
-                           const std::string& builtin_name,
-                           const Location& loc) {
+DatabaseConnection& require_db_connection(Interpreter& interp,
+                                          const std::string& builtin_name,
+                                          const Location& loc) {
     (void)builtin_name;
     auto* conn = interp.db_connection();
     if (!conn || !conn->is_open()) {
@@ -168,7 +590,13 @@ sqlite3* require_db_handle(Interpreter& interp,
         details.configuration_name = "database-connection";
         throw PolonioError(ErrorCategory::Capability, "database not connected", interp.path(), loc, std::move(details));
     }
-    return conn->handle();
+    return *conn;
+}
+
+sqlite3* require_db_handle(Interpreter& interp,
+                           const std::string& builtin_name,
+                           const Location& loc) {
+    return require_db_connection(interp, builtin_name, loc).handle();
 }
 
 } // namespace polonio
@@ -1,20 +1,159 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <sqlite3.h>
 
+#include "polonio/common/location.h"
+#include "polonio/runtime/value.h"
+
 namespace polonio {
 
 class Interpreter;
 struct Location;
+class StatementCache;
+
+struct StatementCacheStats {
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t entries = 0;
+};
+
+// A prepared statement checked out of a connection's statement cache. Only
+// its holder uses it; on destruction it is reset, its bindings are cleared,
+// and it goes back to the cache for the next use of the same SQL.
+class PreparedStatement {
+public:
+    PreparedStatement() = default;
+    ~PreparedStatement();
+    PreparedStatement(PreparedStatement&& other) noexcept;
+    PreparedStatement& operator=(PreparedStatement&& other) noexcept;
+    PreparedStatement(const PreparedStatement&) = delete;
+    PreparedStatement& operator=(const PreparedStatement&) = delete;
+
+    sqlite3_stmt* get() const { return stmt_; }
+    // False once the connection it came from has been closed.
+    bool connected() const;
+
+private:
+    friend class DatabaseConnection;
+
+    PreparedStatement(std::shared_ptr<StatementCache> cache, std::string sql, sqlite3_stmt* stmt)
+        : cache_(std::move(cache)), sql_(std::move(sql)), stmt_(stmt) {}
+    void release();
+
+    std::shared_ptr<StatementCache> cache_;
+    std::string sql_;
+    sqlite3_stmt* stmt_ = nullptr;
+};
+
+// Per-connection SQLite settings chosen by db_connect. The defaults suit
+// several workers sharing one file: WAL lets readers run beside a writer,
+// and a busy timeout makes a contended writer wait instead of failing with
+// SQLITE_BUSY.
+struct DatabaseOptions {
+    std::string journal_mode = "wal";
+    std::string synchronous = "normal";
+    // Pages when positive, KiB when negative, as PRAGMA cache_size takes it.
+    std::int64_t cache_size = -8192;
+    std::int64_t mmap_size = 64 * 1024 * 1024;
+    std::int64_t busy_timeout_ms = 5000;
+    std::string temp_store = "memory";
+
+    bool operator==(const DatabaseOptions& other) const {
+        return journal_mode == other.journal_mode && synchronous == other.synchronous &&
+               cache_size == other.cache_size && mmap_size == other.mmap_size &&
+               busy_timeout_ms == other.busy_timeout_ms && temp_store == other.temp_store;
+    }
+    bool operator!=(const DatabaseOptions& other) const { return !(*this == other); }
+};
+
+struct DatabasePoolStats {
+    std::size_t opened = 0;
+    std::size_t reused = 0;
+    std::size_t idle = 0;
+};
+
+// Open SQLite handles kept for reuse across requests, keyed by resolved
+// database path, so a page that connects finds the schema and page cache
+// already loaded. Each handle carries its statement cache. A handle belongs
+// to one connection at a time, and at most `max_per_database` are open per
+// path; further connects wait for one to be returned. Safe to share between
+// threads.
+class DatabasePool {
+public:
+    struct Handle {
+        sqlite3* db = nullptr;
+        std::shared_ptr<StatementCache> statements;
+        // Identity of the file when it was opened; a handle whose path now
+        // names a different file is closed instead of reused.
+        std::uint64_t device = 0;
+        std::uint64_t inode = 0;
+        // The options last applied, so a reused handle is only reconfigured
+        // when a connect asks for different ones.
+        bool configured = false;
+        DatabaseOptions options;
+        // Set by the handle's authorizer when a statement assigns a PRAGMA,
+        // a setting that would outlive the request.
+        std::shared_ptr<bool> pragma_assigned;
+    };
+
+    enum class Status { Ok, OpenFailed, Exhausted };
+
+    // The pool used by every DatabaseConnection in the process.
+    static DatabasePool& shared();
+
+    explicit DatabasePool(std::size_t max_per_database = 8,
+                          std::chrono::milliseconds wait = std::chrono::seconds(5))
+        : max_per_database_(max_per_database), wait_(wait) {}
+    ~DatabasePool();
+    DatabasePool(const DatabasePool&) = delete;
+    DatabasePool& operator=(const DatabasePool&) = delete;
+
+    // Hands out an idle handle for `path` or opens one. Exhausted means the
+    // limit was still reached after waiting.
+    Status acquire(const std::string& path, Handle& handle);
+    // Takes a handle back, rolling back any open transaction. A handle that
+    // cannot be cleaned up is closed, as is one holding TEMP objects, attached
+    // databases, or PRAGMAs the script changed.
+    void release(const std::string& path, Handle handle);
+    DatabasePoolStats stats() const;
 
+private:
+    struct Database {
+        std::vector<Handle> idle;
+        std::size_t open = 0;
+    };
+
+    void close_handle(Handle& handle);
+
+    mutable std::mutex mutex_;
+    std::condition_variable returned_;
+    std::unordered_map<std::string, Database> databases_;
+    std::size_t max_per_database_;
+    std::chrono::milliseconds wait_;
+    std::size_t opened_ = 0;
+    std::size_t reused_ = 0;
+};
+
+// The database a script is connected to. Its handle is borrowed from the
+// shared DatabasePool on connect and returned on close.
 class DatabaseConnection {
 public:
     DatabaseConnection() = default;
     ~DatabaseConnection();
 
     void connect_relative(const std::string& relative_path,
+                          const DatabaseOptions& options,
                           Interpreter& interp,
                           const std::string& builtin_name,
                           const Location& loc);
@@ -32,11 +171,65 @@ public:
                               const Location& loc);
     bool transaction_active() const { return transaction_active_; }
 
+    // Idle prepared statements kept per connection, least recently used
+    // first out.
+    static constexpr std::size_t kStatementCacheCapacity = 64;
+
+    // Compiles `sql`, or reuses an idle statement compiled from the same text.
+    PreparedStatement prepare(const std::string& sql,
+                              const std::string& builtin_name,
+                              Interpreter& interp,
+                              const Location& loc);
+    // Counts for the current connection; zero while closed.
+    StatementCacheStats statement_cache_stats() const;
+
 private:
     sqlite3* handle_ = nullptr;
     bool transaction_active_ = false;
+    std::string path_;
+    DatabasePool::Handle pooled_;
+};
+
+// The result columns of a statement, resolved once so that each row object is
+// built from the sorted key layout without re-reading or re-sorting names.
+// Rows do not share the layout: each object still owns a copy of every key.
+class RowSchema {
+public:
+    explicit RowSchema(sqlite3_stmt* stmt);
+
+    // The current row as an object keyed by column name.
+    Value row(sqlite3_stmt* stmt) const;
+
+private:
+    // Object keys in order, each with the column it reads.
+    std::vector<std::pair<std::string, int>> columns_;
+};
+
+// Rows of a query read one at a time as `for` asks for them, so a large
+// result is never held in memory whole. The statement is handed back as soon
+// as the last row has been read.
+class DatabaseCursor : public ValueIterator {
+public:
+    DatabaseCursor(PreparedStatement statement, std::string path, Location location)
+        : statement_(std::move(statement)), schema_(statement_.get()), path_(std::move(path)),
+          location_(location) {}
+
+    const char* type_name() const override { return "cursor"; }
+    // Throws a PolonioError when stepping fails or the connection was closed.
+    bool next(Value& index, Value& element) override;
+
+private:
+    PreparedStatement statement_;
+    RowSchema schema_;
+    // Where db_cursor was called, for errors raised while stepping.
+    std::string path_;
+    Location location_;
+    std::size_t row_ = 0;
 };
 
+DatabaseConnection& require_db_connection(Interpreter& interp,
+                                          const std::string& builtin_name,
+                                          const Location& loc);
 sqlite3* require_db_handle(Interpreter& interp,
                            const std::string& builtin_name,
                            const Location& loc);
@@ -1,50 +1,154 @@
 #include "polonio/runtime/env.h"
 
+#include <stdexcept>
 #include <utility>
 
 namespace polonio {
 
-Env::Env(std::shared_ptr<Env> parent) : parent_(std::move(parent)) {}
+Env::Env(std::shared_ptr<Env> parent, std::shared_ptr<const ScopeLayout> layout)
+    : parent_(std::move(parent)), layout_(std::move(layout)) {
+    if (layout_) {
+        slots_.resize(layout_->names.size());
+    }
+}
 
 std::shared_ptr<Env> Env::parent() const { return parent_; }
 
 void Env::set_local(const std::string& name, Value value) {
-    values_[name] = std::move(value);
+    if (frozen_) {
+        throw std::logic_error("frozen scope cannot bind: " + name);
+    }
+    if (layout_) {
+        if (auto slot = layout_->slot_of(name)) {
+            if (!slots_[*slot]) {
+                ++names_version_;
+            }
+            slots_[*slot] = std::move(value);
+            return;
+        }
+    }
+    if (values_.insert_or_assign(name, std::move(value)).second) {
+        ++names_version_;
+    }
 }
 
 bool Env::has_local(const std::string& name) const {
+    if (layout_) {
+        if (auto slot = layout_->slot_of(name)) {
+            return slots_[*slot].has_value();
+        }
+    }
     return values_.find(name) != values_.end();
 }
 
 Value* Env::find(const std::string& name) {
-    auto it = values_.find(name);
-    if (it != values_.end()) {
-        return &it->second;
-    }
-    if (parent_) {
-        return parent_->find(name);
+    const Env* self = this;
+    return const_cast<Value*>(self->find(name));
+}
+
+const Value* Env::find_local(const std::string& name) const {
+    if (layout_) {
+        if (auto slot = layout_->slot_of(name)) {
+            return slots_[*slot] ? &*slots_[*slot] : nullptr;
+        }
     }
-    return nullptr;
+    auto it = values_.find(name);
+    return it != values_.end() ? &it->second : nullptr;
 }
 
 const Value* Env::find(const std::string& name) const {
-    auto it = values_.find(name);
-    if (it != values_.end()) {
-        return &it->second;
-    }
-    if (parent_) {
-        const Env* parent = parent_.get();
-        return parent->find(name);
+    for (const Env* env = this; env; env = env->parent_.get()) {
+        if (const Value* value = env->find_local(name)) {
+            return value;
+        }
     }
     return nullptr;
 }
 
 void Env::assign(const std::string& name, Value value) {
-    if (auto* existing = find(name)) {
-        *existing = std::move(value);
+    Env* below_frozen = nullptr;
+    for (Env* env = this; env; env = env->parent_.get()) {
+        if (env->frozen_) {
+            if (below_frozen && env->find_local(name)) {
+                below_frozen->set_local(name, std::move(value));
+                return;
+            }
+            break;
+        }
+        if (auto* existing = const_cast<Value*>(env->find_local(name))) {
+            *existing = std::move(value);
+            return;
+        }
+        below_frozen = env;
+    }
+    set_local(name, std::move(value));
+}
+
+Value* Env::find(const SlotRef& ref, const std::string& name) {
+    if (ref.index == SlotRef::kOutside) {
+        Env* env = this;
+        for (std::uint32_t hop = 0; hop < ref.depth; ++hop) {
+            if (!env->values_.empty() || !env->parent_) {
+                return find(name);
+            }
+            env = env->parent_.get();
+        }
+        return env->find(name);
+    }
+    if (auto* slot = resolved_slot(ref)) {
+        return slot;
+    }
+    return find(name);
+}
+
+void Env::define(const SlotRef& ref, const std::string& name, Value value) {
+    if (ref.depth == 0 && ref.index < slots_.size()) {
+        if (!slots_[ref.index]) {
+            ++names_version_;
+        }
+        slots_[ref.index] = std::move(value);
+        return;
+    }
+    set_local(name, std::move(value));
+}
+
+void Env::assign(const SlotRef& ref, const std::string& name, Value value) {
+    if (auto* slot = resolved_slot(ref)) {
+        *slot = std::move(value);
+        return;
+    }
+    assign(name, std::move(value));
+}
+
+void Env::bind(std::size_t position, const std::string& name, Value value) {
+    if (layout_ && position < layout_->bindings.size()) {
+        auto& slot = slots_[layout_->bindings[position]];
+        if (!slot) {
+            ++names_version_;
+        }
+        slot = std::move(value);
         return;
     }
     set_local(name, std::move(value));
 }
 
+void Env::clear() {
+    for (auto& slot : slots_) {
+        slot.reset();
+    }
+    values_.clear();
+    ++names_version_;
+}
+
+void Env::reset(std::shared_ptr<Env> parent, std::shared_ptr<const ScopeLayout> layout) {
+    parent_ = std::move(parent);
+    layout_ = std::move(layout);
+    slots_.clear();
+    if (layout_) {
+        slots_.resize(layout_->names.size());
+    }
+    values_.clear();
+    ++names_version_;
+}
+
 } // namespace polonio
@@ -1,18 +1,34 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
+#include "polonio/parser/scope.h"
 #include "polonio/runtime/value.h"
 
 namespace polonio {
 
 class Env {
 public:
-    explicit Env(std::shared_ptr<Env> parent = nullptr);
+    explicit Env(std::shared_ptr<Env> parent = nullptr, std::shared_ptr<const ScopeLayout> layout = nullptr);
 
     std::shared_ptr<Env> parent() const;
+    void set_parent(std::shared_ptr<Env> parent) {
+        parent_ = std::move(parent);
+        ++names_version_;
+    }
+    // The parent without taking a reference, for walks that do not keep it.
+    Env* parent_scope() const { return parent_.get(); }
+
+    // A frozen scope is shared read-only, like the process-wide builtins.
+    // Assigning to one of its names defines the name in the scope just below
+    // it instead.
+    void freeze() { frozen_ = true; }
+    bool frozen() const { return frozen_; }
 
     void set_local(const std::string& name, Value value);
     bool has_local(const std::string& name) const;
@@ -22,9 +38,49 @@ public:
 
     void assign(const std::string& name, Value value);
 
+    // Resolved access. Falls back to the name path when the slot is not bound
+    // yet or an include declared names into a scope on the way.
+    Value* find(const SlotRef& ref, const std::string& name);
+    void define(const SlotRef& ref, const std::string& name, Value value);
+    void assign(const SlotRef& ref, const std::string& name, Value value);
+    // Fills layout binding `position`, or `name` when the scope is unresolved.
+    void bind(std::size_t position, const std::string& name, Value value);
+    // Unbinds every local so a loop can enter the same scope again.
+    void clear();
+    // Unbinds every local and rebuilds the scope for `layout` under `parent`,
+    // so a call scope nothing kept can serve the next call.
+    void reset(std::shared_ptr<Env> parent, std::shared_ptr<const ScopeLayout> layout);
+
+    // The bound slot `ref` names, or null when the name path has to decide.
+    Value* resolved_slot(const SlotRef& ref) {
+        Env* env = this;
+        for (std::uint32_t hop = 0; hop < ref.depth; ++hop) {
+            if (!env->values_.empty() || !env->parent_) {
+                return nullptr;
+            }
+            env = env->parent_.get();
+        }
+        if (ref.index < env->slots_.size() && env->slots_[ref.index]) {
+            return &*env->slots_[ref.index];
+        }
+        return nullptr;
+    }
+    // Bumped whenever a name is bound here for the first time or the scope is
+    // cleared, so a cached pointer to one of its values can be revalidated.
+    std::uint32_t names_version() const { return names_version_; }
+    // This scope's own binding for `name`, without walking parents.
+    Value* find_local_value(const std::string& name) { return const_cast<Value*>(find_local(name)); }
+    bool has_names() const { return !values_.empty(); }
+
 private:
+    const Value* find_local(const std::string& name) const;
+
     std::shared_ptr<Env> parent_;
+    std::shared_ptr<const ScopeLayout> layout_;
+    std::vector<std::optional<Value>> slots_;
     std::unordered_map<std::string, Value> values_;
+    bool frozen_ = false;
+    std::uint32_t names_version_ = 0;
 };
 
 } // namespace polonio
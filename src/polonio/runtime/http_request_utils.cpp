@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cstdio>
 #include <cstdlib>
 #include <memory>
 #include <sstream>
@@ -15,6 +16,56 @@ namespace {
 
 using EntryMap = std::unordered_map<std::string, std::vector<std::string>>;
 
+constexpr const char* kWeekdays[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+constexpr const char* kMonths[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+// Days since 1970-01-01 for a proleptic Gregorian date (Howard Hinnant's
+// days_from_civil), so HTTP dates need neither timegm nor the TZ setting.
+std::int64_t days_from_civil(std::int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    const std::int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned year_of_era = static_cast<unsigned>(year - era * 400);
+    const unsigned day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + static_cast<std::int64_t>(day_of_era) - 719468;
+}
+
+void civil_from_days(std::int64_t days, std::int64_t& year, unsigned& month, unsigned& day) {
+    days += 719468;
+    const std::int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned day_of_era = static_cast<unsigned>(days - era * 146097);
+    const unsigned year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    const unsigned day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    const unsigned mp = (5 * day_of_year + 2) / 153;
+    day = day_of_year - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = static_cast<std::int64_t>(year_of_era) + era * 400 + (month <= 2);
+}
+
+// Parses a run of decimal digits; nullopt when empty, not all digits, or too
+// long to fit.
+std::optional<std::uint64_t> parse_byte_position(const std::string& text) {
+    if (text.empty() || text.size() > 18) {
+        return std::nullopt;
+    }
+    std::uint64_t value = 0;
+    for (char ch : text) {
+        if (ch < '0' || ch > '9') {
+            return std::nullopt;
+        }
+        value = value * 10 + static_cast<std::uint64_t>(ch - '0');
+    }
+    return value;
+}
+
+std::string strip_weak_prefix(const std::string& tag) {
+    if (tag.size() >= 2 && tag[0] == 'W' && tag[1] == '/') {
+        return tag.substr(2);
+    }
+    return tag;
+}
+
 EntryMap parse_urlencoded_entries(const std::string& data) {
     EntryMap entries;
     std::size_t start = 0;
@@ -155,4 +206,127 @@ std::string normalize_header_key(const std::string& name) {
     return normalized;
 }
 
+ByteRange resolve_byte_range(const std::string& header, std::uint64_t size) {
+    ByteRange range;
+    std::string spec = trim_whitespace(header);
+    if (to_lower_copy(spec.substr(0, 6)) != "bytes=") {
+        return range;
+    }
+    spec = trim_whitespace(spec.substr(6));
+    std::size_t dash = spec.find('-');
+    if (dash == std::string::npos || spec.find(',') != std::string::npos) {
+        return range;
+    }
+    std::string first_text = trim_whitespace(spec.substr(0, dash));
+    std::string last_text = trim_whitespace(spec.substr(dash + 1));
+    if (first_text.empty()) {
+        // Suffix range: the final N bytes.
+        auto suffix = parse_byte_position(last_text);
+        if (!suffix) {
+            return range;
+        }
+        if (*suffix == 0 || size == 0) {
+            range.kind = ByteRange::Kind::Unsatisfiable;
+            return range;
+        }
+        range.kind = ByteRange::Kind::Partial;
+        range.length = std::min(*suffix, size);
+        range.offset = size - range.length;
+        return range;
+    }
+    auto first = parse_byte_position(first_text);
+    if (!first) {
+        return range;
+    }
+    std::uint64_t last = size == 0 ? 0 : size - 1;
+    if (!last_text.empty()) {
+        auto parsed_last = parse_byte_position(last_text);
+        if (!parsed_last || *parsed_last < *first) {
+            return range;
+        }
+        last = std::min(last, *parsed_last);
+    }
+    if (*first >= size) {
+        range.kind = ByteRange::Kind::Unsatisfiable;
+        return range;
+    }
+    range.kind = ByteRange::Kind::Partial;
+    range.offset = *first;
+    range.length = last - *first + 1;
+    return range;
+}
+
+std::string content_range_value(const ByteRange& range, std::uint64_t size) {
+    if (range.kind != ByteRange::Kind::Partial) {
+        return "bytes */" + std::to_string(size);
+    }
+    return "bytes " + std::to_string(range.offset) + "-" + std::to_string(range.offset + range.length - 1) + "/" +
+           std::to_string(size);
+}
+
+bool if_none_match_matches(const std::string& header, const std::string& etag) {
+    const std::string wanted = strip_weak_prefix(etag);
+    std::size_t pos = 0;
+    while (pos <= header.size()) {
+        std::size_t comma = header.find(',', pos);
+        std::string candidate =
+            trim_whitespace(header.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos));
+        if (candidate == "*" || (!candidate.empty() && strip_weak_prefix(candidate) == wanted)) {
+            return true;
+        }
+        if (comma == std::string::npos) {
+            break;
+        }
+        pos = comma + 1;
+    }
+    return false;
+}
+
+std::string format_http_date(std::int64_t seconds_since_epoch) {
+    std::int64_t days = seconds_since_epoch / 86400;
+    std::int64_t remainder = seconds_since_epoch % 86400;
+    if (remainder < 0) {
+        remainder += 86400;
+        days -= 1;
+    }
+    std::int64_t year = 0;
+    unsigned month = 0;
+    unsigned day = 0;
+    civil_from_days(days, year, month, day);
+    const int weekday = static_cast<int>(((days % 7) + 11) % 7); // 1970-01-01 was a Thursday
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%s, %02u %s %04lld %02d:%02d:%02d GMT", kWeekdays[weekday], day,
+                  kMonths[month - 1], static_cast<long long>(year), static_cast<int>(remainder / 3600),
+                  static_cast<int>(remainder % 3600 / 60), static_cast<int>(remainder % 60));
+    return buffer;
+}
+
+std::optional<std::int64_t> parse_http_date(const std::string& text) {
+    char weekday[4] = {};
+    char month_name[4] = {};
+    unsigned day = 0;
+    int year = 0;
+    int hour = 0;
+    int minute = 0;
+    int second = 0;
+    char zone[4] = {};
+    int consumed = 0;
+    if (std::sscanf(text.c_str(), "%3s, %u %3s %d %d:%d:%d %3s%n", weekday, &day, month_name, &year, &hour, &minute,
+                    &second, zone, &consumed) != 8 ||
+        static_cast<std::size_t>(consumed) != text.size() || std::string(zone) != "GMT") {
+        return std::nullopt;
+    }
+    unsigned month = 0;
+    for (unsigned i = 0; i < 12; ++i) {
+        if (month_name == std::string(kMonths[i])) {
+            month = i + 1;
+        }
+    }
+    if (month == 0 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60 || hour < 0 || minute < 0 ||
+        second < 0) {
+        return std::nullopt;
+    }
+    return days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+}
+
 } // namespace polonio::http
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <optional>
 #include <string>
 
 #include "polonio/runtime/value.h"
@@ -15,4 +17,27 @@ std::string trim_whitespace(const std::string& input);
 std::string to_lower_copy(std::string value);
 std::string normalize_header_key(const std::string& name);
 
+// A `Range` request resolved against a representation's length.
+struct ByteRange {
+    enum class Kind { Whole, Partial, Unsatisfiable };
+    Kind kind = Kind::Whole;
+    std::uint64_t offset = 0;
+    std::uint64_t length = 0;
+};
+
+// Resolves a Range header for a representation of `size` bytes. Only a single
+// `bytes=` range is honoured; an absent or malformed header, another unit, or
+// several ranges yield Whole, and the caller sends the full representation.
+ByteRange resolve_byte_range(const std::string& header, std::uint64_t size);
+// Content-Range value for a Partial or Unsatisfiable range.
+std::string content_range_value(const ByteRange& range, std::uint64_t size);
+
+// Weak comparison of `etag` against an If-None-Match value: a comma-separated
+// list of entity tags, or `*`.
+bool if_none_match_matches(const std::string& header, const std::string& etag);
+// IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+std::string format_http_date(std::int64_t seconds_since_epoch);
+// Accepts IMF-fixdate only; obsolete HTTP date forms yield nullopt.
+std::optional<std::int64_t> parse_http_date(const std::string& text);
+
 } // namespace polonio::http
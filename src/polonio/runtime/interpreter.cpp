@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <cctype>
 #include <cmath>
+#include <cstdlib>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
@@ -13,6 +14,7 @@
 #include "polonio/common/error.h"
 #include "polonio/runtime/builtins.h"
 #include "polonio/runtime/db.h"
+#include "polonio/runtime/vm.h"
 
 namespace polonio {
 
@@ -79,64 +81,116 @@ void ResponseContext::emit(std::ostream& os) {
     headers_sent = true;
 }
 
-Interpreter::Interpreter(std::shared_ptr<Env> env, std::string path)
-    : env_(env ? std::move(env) : std::make_shared<Env>()), path_(std::move(path)) {
+std::optional<ExecutionEngine> parse_execution_engine(const std::string& name) {
+    if (name == "ast") {
+        return ExecutionEngine::Ast;
+    }
+    if (name == "vm") {
+        return ExecutionEngine::Vm;
+    }
+    return std::nullopt;
+}
+
+ExecutionEngine default_execution_engine() {
+    const char* name = std::getenv("POLONIO_ENGINE");
+    if (name) {
+        if (auto engine = parse_execution_engine(name)) {
+            return *engine;
+        }
+    }
+    return ExecutionEngine::Ast;
+}
+
+Interpreter::Interpreter(std::shared_ptr<Env> env, std::string path, bool link_builtins)
+    : env_(env ? std::move(env) : std::make_shared<Env>()), path_(std::move(path)),
+      engine_(default_execution_engine()) {
     db_connection_ = std::make_unique<DatabaseConnection>();
-    if (!env_->parent() && !env_->has_local("type")) {
-        install_builtins(*env_);
+    if (link_builtins) {
+        auto builtins = builtin_environment();
+        Env* outermost = env_.get();
+        while (outermost->parent_scope()) {
+            outermost = outermost->parent_scope();
+        }
+        if (outermost != builtins.get()) {
+            outermost->set_parent(std::move(builtins));
+        }
     }
 }
 
+Interpreter::~Interpreter() = default;
+
+void Interpreter::reset(std::string path) {
+    env_ = std::make_shared<Env>(builtin_environment());
+    output_.set_sink(nullptr, true);
+    output_.clear();
+    path_ = std::move(path);
+    call_depth_ = 0;
+    return_value_ = Value();
+    include_callback_ = nullptr;
+    response_context_ = nullptr;
+    cgi_context_ = nullptr;
+    session_context_ = nullptr;
+    response_stream_ = nullptr;
+    db_connection_->close();
+    storage_root_.clear();
+    response_finalized_ = false;
+    finalized_body_.clear();
+}
+
 Value Interpreter::eval_expr(const ExprPtr& expr) { return eval_expr_internal(expr); }
 
 void Interpreter::exec_stmt(const StmtPtr& stmt) {
-    if (auto var = std::dynamic_pointer_cast<VarDeclStmt>(stmt)) {
-        exec_var(*var);
-        return;
-    }
-    if (auto echo = std::dynamic_pointer_cast<EchoStmt>(stmt)) {
-        exec_echo(*echo);
-        return;
-    }
-    if (auto expr_stmt = std::dynamic_pointer_cast<ExprStmt>(stmt)) {
-        exec_expr_stmt(*expr_stmt);
-        return;
-    }
-    if (auto ret = std::dynamic_pointer_cast<ReturnStmt>(stmt)) {
-        exec_return(*ret);
-        return;
-    }
-    if (auto fn = std::dynamic_pointer_cast<FunctionStmt>(stmt)) {
-        exec_function(*fn);
-        return;
-    }
-    if (auto if_stmt = std::dynamic_pointer_cast<IfStmt>(stmt)) {
-        exec_if(*if_stmt);
-        return;
-    }
-    if (auto while_stmt = std::dynamic_pointer_cast<WhileStmt>(stmt)) {
-        exec_while(*while_stmt);
-        return;
-    }
-    if (auto for_stmt = std::dynamic_pointer_cast<ForStmt>(stmt)) {
-        exec_for(*for_stmt);
-        return;
-    }
-    if (auto attempt = std::dynamic_pointer_cast<AttemptStmt>(stmt)) {
-        exec_attempt(*attempt);
-        return;
-    }
-    if (auto include_stmt = std::dynamic_pointer_cast<IncludeStmt>(stmt)) {
+    if (exec_stmt_internal(stmt) == Completion::Return) {
+        // `return` at the top level of a file included inside a function call
+        // leaves the included program; the call catches the signal.
+        throw ReturnSignal(std::move(return_value_));
+    }
+}
+
+Interpreter::Completion Interpreter::exec_stmt_internal(const StmtPtr& stmt) {
+    switch (stmt->kind()) {
+    case StmtKind::VarDecl:
+        exec_var(static_cast<const VarDeclStmt&>(*stmt));
+        return Completion::Normal;
+    case StmtKind::Echo:
+        exec_echo(static_cast<const EchoStmt&>(*stmt));
+        return Completion::Normal;
+    case StmtKind::Expr:
+        exec_expr_stmt(static_cast<const ExprStmt&>(*stmt));
+        return Completion::Normal;
+    case StmtKind::Return:
+        return exec_return(static_cast<const ReturnStmt&>(*stmt));
+    case StmtKind::Function:
+        exec_function(static_cast<const FunctionStmt&>(*stmt));
+        return Completion::Normal;
+    case StmtKind::If:
+        return exec_if(static_cast<const IfStmt&>(*stmt));
+    case StmtKind::While:
+        return exec_while(static_cast<const WhileStmt&>(*stmt));
+    case StmtKind::For:
+        return exec_for(static_cast<const ForStmt&>(*stmt));
+    case StmtKind::Attempt:
+        return exec_attempt(static_cast<const AttemptStmt&>(*stmt));
+    case StmtKind::Include: {
+        const auto& include_stmt = static_cast<const IncludeStmt&>(*stmt);
         if (!include_callback_) {
             runtime_error("include not supported here");
         }
-        include_callback_(include_stmt->path(), include_stmt->location());
-        return;
+        include_callback_(include_stmt.path(), include_stmt.location());
+        return Completion::Normal;
+    }
     }
     runtime_error("statement type not supported yet");
 }
 
 void Interpreter::exec_program(const Program& program) {
+    if (engine_ == ExecutionEngine::Vm) {
+        if (!vm_) {
+            vm_ = std::make_unique<Vm>(*this);
+        }
+        vm_->run_program(program);
+        return;
+    }
     for (const auto& stmt : program.statements()) {
         exec_stmt(stmt);
     }
@@ -154,77 +208,53 @@ void Interpreter::clear_output() {
 }
 
 Value Interpreter::eval_expr_internal(const ExprPtr& expr) {
-    if (auto literal = std::dynamic_pointer_cast<LiteralExpr>(expr)) {
-        return eval_literal(*literal);
-    }
-    if (auto ident = std::dynamic_pointer_cast<IdentifierExpr>(expr)) {
-        return eval_identifier(*ident);
-    }
-    if (auto unary = std::dynamic_pointer_cast<UnaryExpr>(expr)) {
-        return eval_unary(*unary);
-    }
-    if (auto binary = std::dynamic_pointer_cast<BinaryExpr>(expr)) {
-        return eval_binary(*binary);
-    }
-    if (auto assignment = std::dynamic_pointer_cast<AssignmentExpr>(expr)) {
-        return eval_assignment(*assignment);
-    }
-    if (auto call = std::dynamic_pointer_cast<CallExpr>(expr)) {
-        return eval_call(*call);
-    }
-    if (auto index = std::dynamic_pointer_cast<IndexExpr>(expr)) {
-        return eval_index(*index);
-    }
-    if (auto array = std::dynamic_pointer_cast<ArrayLiteralExpr>(expr)) {
-        return eval_array(*array);
-    }
-    if (auto object = std::dynamic_pointer_cast<ObjectLiteralExpr>(expr)) {
-        return eval_object(*object);
+    switch (expr->kind()) {
+    case ExprKind::Literal:
+        return eval_literal(static_cast<const LiteralExpr&>(*expr));
+    case ExprKind::Identifier:
+        return eval_identifier(static_cast<const IdentifierExpr&>(*expr));
+    case ExprKind::Unary:
+        return eval_unary(static_cast<const UnaryExpr&>(*expr));
+    case ExprKind::Binary:
+        return eval_binary(static_cast<const BinaryExpr&>(*expr));
+    case ExprKind::Assignment:
+        return eval_assignment(static_cast<const AssignmentExpr&>(*expr));
+    case ExprKind::Call:
+        return eval_call(static_cast<const CallExpr&>(*expr));
+    case ExprKind::Index:
+        return eval_index(static_cast<const IndexExpr&>(*expr));
+    case ExprKind::ArrayLiteral:
+        return eval_array(static_cast<const ArrayLiteralExpr&>(*expr));
+    case ExprKind::ObjectLiteral:
+        return eval_object(static_cast<const ObjectLiteralExpr&>(*expr));
     }
     runtime_error("expression type not supported yet");
 }
 
-Value Interpreter::eval_literal(const LiteralExpr& literal) {
-    const std::string& repr = literal.repr();
-    if (repr == "null") {
-        return Value();
-    }
-    if (repr == "bool(true)") {
-        return Value(true);
-    }
-    if (repr == "bool(false)") {
-        return Value(false);
-    }
-    if (repr.rfind("num(", 0) == 0 && repr.back() == ')') {
-        std::string inner = repr.substr(4, repr.size() - 5);
-        return Value(std::stod(inner));
-    }
-    if (repr.rfind("str(", 0) == 0 && repr.back() == ')') {
-        std::string inner = repr.substr(4, repr.size() - 5);
-        return Value(decode_string(inner));
-    }
-    runtime_error("unknown literal: " + repr);
-}
+Value Interpreter::eval_literal(const LiteralExpr& literal) { return literal.value(); }
 
 Value Interpreter::eval_identifier(const IdentifierExpr& ident) {
-    return lookup_identifier(ident.name());
+    return lookup_identifier(ident.slot(), ident.name());
 }
 
 Value Interpreter::eval_unary(const UnaryExpr& unary) {
     Value right = eval_expr_internal(unary.right());
-    if (unary.op() == "-") {
-        double number = require_number(right, "unary '-'");
-        return Value(-number);
-    }
-    if (unary.op() == "not") {
+    return apply_unary(unary.op(), right);
+}
+
+Value Interpreter::apply_unary(UnaryOp op, const Value& right) {
+    switch (op) {
+    case UnaryOp::Negate:
+        return Value(-require_number(right, "unary '-'"));
+    case UnaryOp::Not:
         return Value(!right.is_truthy());
     }
-    runtime_error("unsupported unary operator: " + unary.op());
+    runtime_error(std::string("unsupported unary operator: ") + operator_symbol(op));
 }
 
 Value Interpreter::eval_binary(const BinaryExpr& binary) {
-    const std::string& op = binary.op();
-    if (op == "and") {
+    const BinaryOp op = binary.op();
+    if (op == BinaryOp::And) {
         Value left = eval_expr_internal(binary.left());
         if (!left.is_truthy()) {
             return Value(false);
@@ -232,7 +262,7 @@ Value Interpreter::eval_binary(const BinaryExpr& binary) {
         Value right = eval_expr_internal(binary.right());
         return Value(right.is_truthy());
     }
-    if (op == "or") {
+    if (op == BinaryOp::Or) {
         Value left = eval_expr_internal(binary.left());
         if (left.is_truthy()) {
             return Value(true);
@@ -243,24 +273,25 @@ Value Interpreter::eval_binary(const BinaryExpr& binary) {
 
     Value left = eval_expr_internal(binary.left());
     Value right = eval_expr_internal(binary.right());
+    return apply_binary(op, left, right);
+}
 
-    if (op == "+") {
+Value Interpreter::apply_binary(BinaryOp op, const Value& left, const Value& right) {
+    switch (op) {
+    case BinaryOp::Add:
         return Value(require_number(left, "+") + require_number(right, "+"));
-    }
-    if (op == "-") {
+    case BinaryOp::Subtract:
         return Value(require_number(left, "-") - require_number(right, "-"));
-    }
-    if (op == "*") {
+    case BinaryOp::Multiply:
         return Value(require_number(left, "*") * require_number(right, "*"));
-    }
-    if (op == "/") {
+    case BinaryOp::Divide: {
         double divisor = require_number(right, "/");
         if (divisor == 0.0) {
             runtime_error("division by zero");
         }
         return Value(require_number(left, "/") / divisor);
     }
-    if (op == "%") {
+    case BinaryOp::Modulo: {
         double lhs = require_number(left, "%");
         double rhs = require_number(right, "%");
         if (rhs == 0.0) {
@@ -268,105 +299,99 @@ Value Interpreter::eval_binary(const BinaryExpr& binary) {
         }
         return Value(std::fmod(lhs, rhs));
     }
-    if (op == "..") {
+    case BinaryOp::Concat: {
         std::string lhs = stringify_for_concat(left);
         std::string rhs = stringify_for_concat(right);
         return Value(lhs + rhs);
     }
-    if (op == "==") {
+    case BinaryOp::Equal:
         try { return Value(left == right); }
         catch (const EqualityCycleError& error) { runtime_error(error.what()); }
-    }
-    if (op == "!=") {
+    case BinaryOp::NotEqual:
         try { return Value(left != right); }
         catch (const EqualityCycleError& error) { runtime_error(error.what()); }
-    }
-    if (op == "<" || op == "<=" || op == ">" || op == ">=") {
+    case BinaryOp::Less:
+    case BinaryOp::LessEqual:
+    case BinaryOp::Greater:
+    case BinaryOp::GreaterEqual:
         if (std::holds_alternative<double>(left.storage()) && std::holds_alternative<double>(right.storage())) {
             const double lhs = std::get<double>(left.storage()), rhs = std::get<double>(right.storage());
-            if (op == "<") return Value(lhs < rhs);
-            if (op == "<=") return Value(lhs <= rhs);
-            if (op == ">") return Value(lhs > rhs);
+            if (op == BinaryOp::Less) return Value(lhs < rhs);
+            if (op == BinaryOp::LessEqual) return Value(lhs <= rhs);
+            if (op == BinaryOp::Greater) return Value(lhs > rhs);
             return Value(lhs >= rhs);
         }
         if (std::holds_alternative<std::string>(left.storage()) && std::holds_alternative<std::string>(right.storage())) {
             const auto& lhs = std::get<std::string>(left.storage()); const auto& rhs = std::get<std::string>(right.storage());
-            if (op == "<") return Value(lhs < rhs);
-            if (op == "<=") return Value(lhs <= rhs);
-            if (op == ">") return Value(lhs > rhs);
+            if (op == BinaryOp::Less) return Value(lhs < rhs);
+            if (op == BinaryOp::LessEqual) return Value(lhs <= rhs);
+            if (op == BinaryOp::Greater) return Value(lhs > rhs);
             return Value(lhs >= rhs);
         }
         runtime_error("ordered comparison requires two numbers or two strings");
+    case BinaryOp::And:
+    case BinaryOp::Or:
+        break;
     }
 
-    runtime_error("unsupported binary operator: " + op);
+    runtime_error(std::string("unsupported binary operator: ") + operator_symbol(op));
 }
 
 Value Interpreter::eval_assignment(const AssignmentExpr& assignment) {
-    if (std::dynamic_pointer_cast<IndexExpr>(assignment.target())) {
+    if (assignment.target()->kind() == ExprKind::Index) {
         runtime_error("index assignment not supported yet");
     }
-    auto ident = std::dynamic_pointer_cast<IdentifierExpr>(assignment.target());
-    if (!ident) {
+    if (assignment.target()->kind() != ExprKind::Identifier) {
         runtime_error("assignment target must be an identifier");
     }
-    const std::string& name = ident->name();
+    const auto& target = static_cast<const IdentifierExpr&>(*assignment.target());
     Value rhs = eval_expr_internal(assignment.value());
-    const std::string& op = assignment.op();
+    const AssignOp op = assignment.op();
 
-    if (op == "=") {
-        env_->assign(name, rhs);
+    if (op == AssignOp::Assign) {
+        env_->assign(target.slot(), target.name(), rhs);
         return rhs;
     }
 
-    Value current = lookup_identifier(name);
-    if (op == "+=") {
-        double result = require_number(current, "+=") + require_number(rhs, "+=");
-        Value updated(result);
-        env_->assign(name, updated);
-        return updated;
-    }
-    if (op == "-=") {
-        double result = require_number(current, "-=") - require_number(rhs, "-=");
-        Value updated(result);
-        env_->assign(name, updated);
-        return updated;
-    }
-    if (op == "*=") {
-        double result = require_number(current, "*=") * require_number(rhs, "*=");
-        Value updated(result);
-        env_->assign(name, updated);
-        return updated;
-    }
-    if (op == "/=") {
+    Value current = lookup_identifier(target.slot(), target.name());
+    Value updated = apply_compound(op, current, rhs);
+    env_->assign(target.slot(), target.name(), updated);
+    return updated;
+}
+
+Value Interpreter::apply_compound(AssignOp op, const Value& current, const Value& rhs) {
+    switch (op) {
+    case AssignOp::Add:
+        return Value(require_number(current, "+=") + require_number(rhs, "+="));
+    case AssignOp::Subtract:
+        return Value(require_number(current, "-=") - require_number(rhs, "-="));
+    case AssignOp::Multiply:
+        return Value(require_number(current, "*=") * require_number(rhs, "*="));
+    case AssignOp::Divide: {
         double divisor = require_number(rhs, "/=");
         if (divisor == 0.0) {
             runtime_error("division by zero");
         }
-        double result = require_number(current, "/=") / divisor;
-        Value updated(result);
-        env_->assign(name, updated);
-        return updated;
+        return Value(require_number(current, "/=") / divisor);
     }
-    if (op == "%=") {
+    case AssignOp::Modulo: {
         double rhs_number = require_number(rhs, "%=");
         if (rhs_number == 0.0) {
             runtime_error("division by zero");
         }
         double lhs_number = require_number(current, "%=");
-        Value updated(std::fmod(lhs_number, rhs_number));
-        env_->assign(name, updated);
-        return updated;
+        return Value(std::fmod(lhs_number, rhs_number));
     }
-    if (op == "..=") {
+    case AssignOp::Concat: {
         std::string lhs = stringify_for_concat(current);
         std::string rhs_str = stringify_for_concat(rhs);
-        Value updated(lhs + rhs_str);
-        env_->assign(name, updated);
-        return updated;
+        return Value(lhs + rhs_str);
+    }
+    case AssignOp::Assign:
+        return rhs;
     }
 
-    runtime_error("unsupported assignment operator: " + op);
+    runtime_error(std::string("unsupported assignment operator: ") + operator_symbol(op));
 }
 
 Value Interpreter::eval_call(const CallExpr& call) {
@@ -378,107 +403,7 @@ Value Interpreter::eval_call(const CallExpr& call) {
     }
 
     if (std::holds_alternative<BuiltinFunction>(callee.storage())) {
-        const auto& builtin = std::get<BuiltinFunction>(callee.storage());
-        if (!builtin.callback) {
-            runtime_error("attempt to call non-function value");
-        }
-        try {
-            return builtin.callback(*this, args, call.location());
-        } catch (PolonioError& error) {
-            // Storage and SQLite helpers do not know which compatibility name
-            // was invoked. The invocation boundary completes RFC 0005 facts.
-            auto& details = error.mutable_details();
-            details.function_name = builtin.name;
-            details.canonical_function_name = builtin.canonical_name.empty()
-                ? builtin.name : builtin.canonical_name;
-            const std::string& message = error.message();
-            const bool data_builtin = builtin.name.rfind("file_", 0) == 0 ||
-                builtin.name.rfind("dir_", 0) == 0 || builtin.name.rfind("db_", 0) == 0 ||
-                builtin.name == "send_file" || builtin.name == "upload_save" ||
-                builtin.name == "send_mail";
-            if (data_builtin && error.category() == ErrorCategory::Runtime &&
-                details.builtin_reason.has_value() &&
-                *details.builtin_reason == BuiltinFailureReason::Value) {
-                // Explicit path/value diagnostics remain RuntimeError. Other
-                // data-runtime failures are configured resource operations.
-                if (message.find("path traversal") == std::string::npos &&
-                    message.find("absolute path") == std::string::npos &&
-                    message.find("empty path") == std::string::npos &&
-                    message.find("database not connected") == std::string::npos) {
-                    error.set_category(ErrorCategory::Resource);
-                    details.builtin_reason = (message.find("not found") != std::string::npos ||
-                        message.find("temporary file missing") != std::string::npos)
-                        ? BuiltinFailureReason::Resource : BuiltinFailureReason::Operation;
-                }
-            }
-            if (message.find("database not connected") != std::string::npos) {
-                error.set_category(ErrorCategory::Capability);
-                details.builtin_reason = BuiltinFailureReason::Configuration;
-                details.capability = "sqlite";
-                details.configuration_name = "database-connection";
-            }
-            if (!details.builtin_reason.has_value()) {
-                if (error.category() == ErrorCategory::Capability) {
-                    details.builtin_reason = message.find("missing") != std::string::npos
-                        ? BuiltinFailureReason::Configuration : BuiltinFailureReason::Context;
-                } else if (error.category() == ErrorCategory::Resource) {
-                    details.builtin_reason = BuiltinFailureReason::Operation;
-                } else if (message.find("argument") != std::string::npos ||
-                           message.find("expected 0") != std::string::npos ||
-                           message.find("expected 1") != std::string::npos ||
-                           message.find("expected 2") != std::string::npos ||
-                           message.find("expected 3") != std::string::npos) {
-                    details.builtin_reason = BuiltinFailureReason::Arity;
-                } else if (message.find("opts") != std::string::npos ||
-                           message.find("tmp_path") != std::string::npos ||
-                           message.find("file object") != std::string::npos ||
-                           message.find("headers must") != std::string::npos) {
-                    details.builtin_reason = BuiltinFailureReason::Shape;
-                } else if (message.find("unsupported parameter") != std::string::npos ||
-                           message.find("serializable") != std::string::npos) {
-                    details.builtin_reason = BuiltinFailureReason::UnsupportedValue;
-                } else if (message.find("expected") != std::string::npos ||
-                           message.find("must be string") != std::string::npos ||
-                           message.find("must be bool") != std::string::npos) {
-                    details.builtin_reason = BuiltinFailureReason::Type;
-                } else {
-                    details.builtin_reason = BuiltinFailureReason::Value;
-                }
-            }
-            if (*details.builtin_reason == BuiltinFailureReason::Arity) {
-                details.actual_arity = args.size();
-                if (!details.expected_arity_min.has_value()) {
-                    std::vector<std::size_t> numbers;
-                    for (std::size_t i = 0; i < message.size();) {
-                        if (!std::isdigit(static_cast<unsigned char>(message[i]))) { ++i; continue; }
-                        std::size_t value = 0;
-                        while (i < message.size() && std::isdigit(static_cast<unsigned char>(message[i]))) {
-                            value = value * 10 + static_cast<std::size_t>(message[i++] - '0');
-                        }
-                        numbers.push_back(value);
-                    }
-                    if (!numbers.empty()) {
-                        details.expected_arity_min = numbers.front();
-                        if (message.find(" or ") != std::string::npos && numbers.size() > 1) {
-                            details.expected_arity_max = numbers[1];
-                        } else if (message.find("at least") == std::string::npos) {
-                            details.expected_arity_max = numbers.front();
-                        }
-                    }
-                }
-            }
-            if (data_builtin && error.category() == ErrorCategory::Runtime &&
-                (*details.builtin_reason == BuiltinFailureReason::Value) &&
-                message.find("path traversal") == std::string::npos &&
-                message.find("absolute path") == std::string::npos &&
-                message.find("empty path") == std::string::npos) {
-                error.set_category(ErrorCategory::Resource);
-                details.builtin_reason = (message.find("not found") != std::string::npos ||
-                    message.find("temporary file missing") != std::string::npos)
-                    ? BuiltinFailureReason::Resource : BuiltinFailureReason::Operation;
-            }
-            throw;
-        }
+        return call_builtin(std::get<BuiltinFunction>(callee.storage()), args, call.location());
     }
 
     if (!std::holds_alternative<FunctionValue>(callee.storage())) {
@@ -486,25 +411,21 @@ Value Interpreter::eval_call(const CallExpr& call) {
     }
     const auto& function = std::get<FunctionValue>(callee.storage());
 
-    auto closure_env = function.closure ? function.closure : std::make_shared<Env>();
-    auto call_env = std::make_shared<Env>(closure_env);
-    for (std::size_t i = 0; i < function.params.size(); ++i) {
-        Value arg_value = i < args.size() ? args[i] : Value();
-        call_env->set_local(function.params[i], arg_value);
-    }
-    if (!function.name.empty()) {
-        call_env->set_local(function.name, callee);
-    }
+    auto call_env = make_call_env(callee, function, args);
 
     auto previous_env = env_;
     env_ = call_env;
     call_depth_ += 1;
     try {
-        exec_block(function.body);
+        Completion completion = exec_block(function.body);
         env_ = previous_env;
         call_depth_ -= 1;
+        if (completion == Completion::Return) {
+            return std::exchange(return_value_, Value());
+        }
         return Value();
     } catch (const ReturnSignal& signal) {
+        // `return` inside a file included by this function.
         env_ = previous_env;
         call_depth_ -= 1;
         return signal.value();
@@ -515,10 +436,131 @@ Value Interpreter::eval_call(const CallExpr& call) {
     }
 }
 
+Value Interpreter::call_builtin(const BuiltinFunction& builtin, const std::vector<Value>& args,
+                                const Location& location) {
+    if (!builtin.callback) {
+        runtime_error("attempt to call non-function value");
+    }
+    try {
+        return builtin.callback(*this, args, location);
+    } catch (PolonioError& error) {
+        // Storage and SQLite helpers do not know which compatibility name
+        // was invoked. The invocation boundary completes RFC 0005 facts.
+        auto& details = error.mutable_details();
+        details.function_name = builtin.name;
+        details.canonical_function_name = builtin.canonical_name.empty()
+            ? builtin.name : builtin.canonical_name;
+        const std::string& message = error.message();
+        const bool data_builtin = builtin.name.rfind("file_", 0) == 0 ||
+            builtin.name.rfind("dir_", 0) == 0 || builtin.name.rfind("db_", 0) == 0 ||
+            builtin.name == "send_file" || builtin.name == "upload_save" ||
+            builtin.name == "send_mail";
+        if (data_builtin && error.category() == ErrorCategory::Runtime &&
+            details.builtin_reason.has_value() &&
+            *details.builtin_reason == BuiltinFailureReason::Value) {
+            // Explicit path/value diagnostics remain RuntimeError. Other
+            // data-runtime failures are configured resource operations.
+            if (message.find("path traversal") == std::string::npos &&
+                message.find("absolute path") == std::string::npos &&
+                message.find("empty path") == std::string::npos &&
+                message.find("database not connected") == std::string::npos) {
+                error.set_category(ErrorCategory::Resource);
+                details.builtin_reason = (message.find("not found") != std::string::npos ||
+                    message.find("temporary file missing") != std::string::npos)
+                    ? BuiltinFailureReason::Resource : BuiltinFailureReason::Operation;
+            }
+        }
+        if (message.find("database not connected") != std::string::npos) {
+            error.set_category(ErrorCategory::Capability);
+            details.builtin_reason = BuiltinFailureReason::Configuration;
+            details.capability = "sqlite";
+            details.configuration_name = "database-connection";
+        }
+        if (!details.builtin_reason.has_value()) {
+            if (error.category() == ErrorCategory::Capability) {
+                details.builtin_reason = message.find("missing") != std::string::npos
+                    ? BuiltinFailureReason::Configuration : BuiltinFailureReason::Context;
+            } else if (error.category() == ErrorCategory::Resource) {
+                details.builtin_reason = BuiltinFailureReason::Operation;
+            } else if (message.find("argument") != std::string::npos ||
+                       message.find("expected 0") != std::string::npos ||
+                       message.find("expected 1") != std::string::npos ||
+                       message.find("expected 2") != std::string::npos ||
+                       message.find("expected 3") != std::string::npos) {
+                details.builtin_reason = BuiltinFailureReason::Arity;
+            } else if (message.find("opts") != std::string::npos ||
+                       message.find("tmp_path") != std::string::npos ||
+                       message.find("file object") != std::string::npos ||
+                       message.find("headers must") != std::string::npos) {
+                details.builtin_reason = BuiltinFailureReason::Shape;
+            } else if (message.find("unsupported parameter") != std::string::npos ||
+                       message.find("serializable") != std::string::npos) {
+                details.builtin_reason = BuiltinFailureReason::UnsupportedValue;
+            } else if (message.find("expected") != std::string::npos ||
+                       message.find("must be string") != std::string::npos ||
+                       message.find("must be bool") != std::string::npos) {
+                details.builtin_reason = BuiltinFailureReason::Type;
+            } else {
+                details.builtin_reason = BuiltinFailureReason::Value;
+            }
+        }
+        if (*details.builtin_reason == BuiltinFailureReason::Arity) {
+            details.actual_arity = args.size();
+            if (!details.expected_arity_min.has_value()) {
+                std::vector<std::size_t> numbers;
+                for (std::size_t i = 0; i < message.size();) {
+                    if (!std::isdigit(static_cast<unsigned char>(message[i]))) { ++i; continue; }
+                    std::size_t value = 0;
+                    while (i < message.size() && std::isdigit(static_cast<unsigned char>(message[i]))) {
+                        value = value * 10 + static_cast<std::size_t>(message[i++] - '0');
+                    }
+                    numbers.push_back(value);
+                }
+                if (!numbers.empty()) {
+                    details.expected_arity_min = numbers.front();
+                    if (message.find(" or ") != std::string::npos && numbers.size() > 1) {
+                        details.expected_arity_max = numbers[1];
+                    } else if (message.find("at least") == std::string::npos) {
+                        details.expected_arity_max = numbers.front();
+                    }
+                }
+            }
+        }
+        if (data_builtin && error.category() == ErrorCategory::Runtime &&
+            (*details.builtin_reason == BuiltinFailureReason::Value) &&
+            message.find("path traversal") == std::string::npos &&
+            message.find("absolute path") == std::string::npos &&
+            message.find("empty path") == std::string::npos) {
+            error.set_category(ErrorCategory::Resource);
+            details.builtin_reason = (message.find("not found") != std::string::npos ||
+                message.find("temporary file missing") != std::string::npos)
+                ? BuiltinFailureReason::Resource : BuiltinFailureReason::Operation;
+        }
+        throw;
+    }
+}
+
+std::shared_ptr<Env> Interpreter::make_call_env(const Value& callee, const FunctionValue& function,
+                                                const std::vector<Value>& args) {
+    auto closure_env = function.closure ? function.closure : std::make_shared<Env>();
+    auto call_env = std::make_shared<Env>(closure_env, function.scope);
+    for (std::size_t i = 0; i < function.params.size(); ++i) {
+        Value arg_value = i < args.size() ? args[i] : Value();
+        call_env->bind(i, function.params[i], arg_value);
+    }
+    if (!function.name.empty()) {
+        call_env->bind(function.params.size(), function.name, callee);
+    }
+    return call_env;
+}
+
 Value Interpreter::eval_index(const IndexExpr& index) {
     Value collection = eval_expr_internal(index.object());
     Value idx = eval_expr_internal(index.index());
+    return index_value(collection, idx);
+}
 
+Value Interpreter::index_value(const Value& collection, const Value& idx) {
     if (std::holds_alternative<Value::ArrayPtr>(collection.storage())) {
         double numeric = require_number(idx, "array index");
         if (!is_integer(numeric) || numeric < 0) {
@@ -569,8 +611,9 @@ Value Interpreter::eval_array(const ArrayLiteralExpr& array) {
 
 Value Interpreter::eval_object(const ObjectLiteralExpr& object) {
     Value::Object map;
-    for (const auto& field : object.fields()) {
-        map[decode_string(field.first)] = eval_expr_internal(field.second);
+    const auto& keys = object.keys();
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        map[keys[i]] = eval_expr_internal(object.fields()[i].second);
     }
     return Value(std::move(map));
 }
@@ -580,7 +623,7 @@ void Interpreter::exec_var(const VarDeclStmt& stmt) {
     if (stmt.has_initializer()) {
         value = eval_expr_internal(stmt.initializer());
     }
-    env_->set_local(stmt.name(), value);
+    env_->define(stmt.slot(), stmt.name(), value);
 }
 
 void Interpreter::exec_echo(const EchoStmt& stmt) {
@@ -591,15 +634,12 @@ void Interpreter::exec_echo(const EchoStmt& stmt) {
 
 void Interpreter::exec_expr_stmt(const ExprStmt& stmt) { (void)eval_expr_internal(stmt.expr()); }
 
-void Interpreter::exec_return(const ReturnStmt& stmt) {
+Interpreter::Completion Interpreter::exec_return(const ReturnStmt& stmt) {
     if (call_depth_ == 0) {
         runtime_error("return outside of function");
     }
-    Value value;
-    if (stmt.has_value()) {
-        value = eval_expr_internal(stmt.value());
-    }
-    throw ReturnSignal(std::move(value));
+    return_value_ = stmt.has_value() ? eval_expr_internal(stmt.value()) : Value();
+    return Completion::Return;
 }
 
 void Interpreter::exec_function(const FunctionStmt& stmt) {
@@ -608,114 +648,150 @@ void Interpreter::exec_function(const FunctionStmt& stmt) {
     fn_value.params = stmt.params();
     fn_value.body = stmt.body();
     fn_value.closure = env_;
-    env_->set_local(stmt.name(), Value(fn_value));
+    fn_value.scope = stmt.scope();
+    // Lets the VM call this function without compiling its body per call.
+    fn_value.code = engine_ == ExecutionEngine::Vm ? compile_function_bytecode(stmt) : stmt.bytecode();
+    env_->define(stmt.slot(), stmt.name(), Value(fn_value));
 }
 
-void Interpreter::exec_if(const IfStmt& stmt) {
+Interpreter::Completion Interpreter::exec_if(const IfStmt& stmt) {
     for (const auto& branch : stmt.branches()) {
         Value condition = eval_expr_internal(branch.condition);
         if (condition.is_truthy()) {
-            exec_block(branch.body);
-            return;
+            return exec_block(branch.body);
         }
     }
-    if (!stmt.else_body().empty()) {
-        exec_block(stmt.else_body());
-    }
+    return exec_block(stmt.else_body());
 }
 
-void Interpreter::exec_while(const WhileStmt& stmt) {
+Interpreter::Completion Interpreter::exec_while(const WhileStmt& stmt) {
     while (true) {
         Value condition = eval_expr_internal(stmt.condition());
         if (!condition.is_truthy()) {
-            break;
+            return Completion::Normal;
+        }
+        if (exec_block(stmt.body()) == Completion::Return) {
+            return Completion::Return;
         }
-        exec_block(stmt.body());
     }
 }
 
-void Interpreter::exec_for(const ForStmt& stmt) {
+Interpreter::Completion Interpreter::exec_for(const ForStmt& stmt) {
     Value iterable = eval_expr_internal(stmt.iterable());
+    // Iterations share one scope until the body lets it escape; a closure
+    // declared in the loop keeps that iteration's bindings, so the next
+    // iteration gets a fresh scope.
+    std::shared_ptr<Env> loop_env;
     auto run_iteration = [&](std::optional<Value> index_value, Value value) {
-        auto loop_env = std::make_shared<Env>(env_);
+        if (loop_env && loop_env.use_count() == 1) {
+            loop_env->clear();
+        } else {
+            loop_env = std::make_shared<Env>(env_, stmt.scope());
+        }
+        std::size_t binding = 0;
         if (stmt.index_name()) {
-            if (index_value.has_value()) {
-                loop_env->set_local(*stmt.index_name(), *index_value);
-            } else {
-                loop_env->set_local(*stmt.index_name(), Value());
-            }
+            loop_env->bind(binding++, *stmt.index_name(), index_value.value_or(Value()));
         }
-        loop_env->set_local(stmt.value_name(), value);
+        loop_env->bind(binding, stmt.value_name(), std::move(value));
         auto previous_env = env_;
         env_ = loop_env;
+        Completion completion;
         try {
-            exec_block(stmt.body());
+            completion = exec_block(stmt.body());
         } catch (...) {
             env_ = previous_env;
             throw;
         }
         env_ = previous_env;
+        return completion;
     };
 
     if (std::holds_alternative<Value::ArrayPtr>(iterable.storage())) {
         const auto& array = std::get<Value::ArrayPtr>(iterable.storage());
         if (!array) {
-            return;
+            return Completion::Normal;
         }
         for (std::size_t i = 0; i < array->size(); ++i) {
             std::optional<Value> index_value;
             if (stmt.index_name()) {
                 index_value = Value(static_cast<double>(i));
             }
-            run_iteration(index_value, (*array)[i]);
+            if (run_iteration(index_value, (*array)[i]) == Completion::Return) {
+                return Completion::Return;
+            }
         }
-        return;
+        return Completion::Normal;
     }
 
     if (std::holds_alternative<Value::ObjectPtr>(iterable.storage())) {
         const auto& object = std::get<Value::ObjectPtr>(iterable.storage());
         if (!object) {
-            return;
+            return Completion::Normal;
         }
+        // The keys present at loop start, already in order; keys the body
+        // adds are not visited and keys it erases are skipped.
         std::vector<std::string> keys;
         keys.reserve(object->size());
         for (const auto& entry : *object) {
             keys.push_back(entry.first);
         }
-        std::sort(keys.begin(), keys.end());
         for (const auto& key : keys) {
+            auto it = object->find(key);
+            if (it == object->end()) {
+                continue;
+            }
             std::optional<Value> index_value;
             if (stmt.index_name()) {
                 index_value = Value(key);
             }
-            auto it = object->find(key);
-            if (it != object->end()) {
-                run_iteration(index_value, it->second);
+            if (run_iteration(index_value, it->second) == Completion::Return) {
+                return Completion::Return;
             }
         }
-        return;
+        return Completion::Normal;
     }
 
-    runtime_error("for loop expects array or object");
+    if (std::holds_alternative<Value::IteratorPtr>(iterable.storage())) {
+        const auto& iterator = std::get<Value::IteratorPtr>(iterable.storage());
+        Value index;
+        Value element;
+        while (iterator && iterator->next(index, element)) {
+            std::optional<Value> index_value;
+            if (stmt.index_name()) {
+                index_value = std::move(index);
+            }
+            if (run_iteration(index_value, std::move(element)) == Completion::Return) {
+                return Completion::Return;
+            }
+        }
+        return Completion::Normal;
+    }
+
+    runtime_error("for loop expects array, object, or cursor");
 }
 
-void Interpreter::exec_block(const std::vector<StmtPtr>& statements) {
+Interpreter::Completion Interpreter::exec_block(const std::vector<StmtPtr>& statements) {
     for (const auto& stmt : statements) {
-        exec_stmt(stmt);
+        if (exec_stmt_internal(stmt) == Completion::Return) {
+            return Completion::Return;
+        }
     }
+    return Completion::Normal;
 }
 
-void Interpreter::exec_attempt(const AttemptStmt& stmt) {
+Interpreter::Completion Interpreter::exec_attempt(const AttemptStmt& stmt) {
     try {
-        exec_block(stmt.attempt_body());
+        return exec_block(stmt.attempt_body());
     } catch (const PolonioError& error) {
         if (error.recoverability() != Recoverability::Operational || response_finalized_) throw;
-        auto recover_env = std::make_shared<Env>(env_);
-        if (stmt.recover_binding()) recover_env->set_local(*stmt.recover_binding(), error_value(error));
+        auto recover_env = std::make_shared<Env>(env_, stmt.recover_scope());
+        if (stmt.recover_binding()) recover_env->bind(0, *stmt.recover_binding(), error_value(error));
         auto previous_env = env_;
         env_ = recover_env;
-        try { exec_block(stmt.recover_body()); } catch (...) { env_ = previous_env; throw; }
+        Completion completion;
+        try { completion = exec_block(stmt.recover_body()); } catch (...) { env_ = previous_env; throw; }
         env_ = previous_env;
+        return completion;
     }
 }
 
@@ -745,8 +821,8 @@ Value Interpreter::error_value(const PolonioError& error) const {
     throw PolonioError(ErrorCategory::Runtime, message, path_);
 }
 
-Value Interpreter::lookup_identifier(const std::string& name) {
-    if (auto* value = env_->find(name)) {
+Value Interpreter::lookup_identifier(const SlotRef& slot, const std::string& name) {
+    if (auto* value = env_->find(slot, name)) {
         return *value;
     }
     runtime_error("undefined variable: " + name);
@@ -768,49 +844,29 @@ void Interpreter::finalize_response(const std::string& body) {
     output_.clear();
 }
 
-void Interpreter::ensure_response_writable() {
-    if (response_finalized_) {
-        runtime_error("response already finalized");
+bool Interpreter::flush_response() {
+    ensure_response_writable();
+    if (!response_stream_ || !response_context_) {
+        return false;
+    }
+    if (!response_context_->headers_sent) {
+        response_context_->ensure_default_headers();
+        response_stream_->commit(*response_context_);
+        response_context_->headers_sent = true;
+        if (!output_.str().empty()) {
+            response_stream_->write(output_.str());
+        }
+        output_.clear();
+        output_.set_sink(response_stream_->write, false);
     }
+    response_stream_->flush();
+    return true;
 }
 
-std::string Interpreter::decode_string(const std::string& literal) {
-    if (literal.size() < 2) {
-        return {};
-    }
-    std::string result;
-    for (std::size_t i = 1; i + 1 < literal.size(); ++i) {
-        char c = literal[i];
-        if (c == '\\' && i + 1 < literal.size()) {
-            char next = literal[++i];
-            switch (next) {
-            case 'n':
-                result.push_back('\n');
-                break;
-            case 't':
-                result.push_back('\t');
-                break;
-            case '\\':
-                result.push_back('\\');
-                break;
-            case '"':
-                result.push_back('"');
-                break;
-            case '\'':
-                result.push_back('\'');
-                break;
-            case 'r':
-                result.push_back('\r');
-                break;
-            default:
-                result.push_back(next);
-                break;
-            }
-        } else {
-            result.push_back(c);
-        }
+void Interpreter::ensure_response_writable() {
+    if (response_finalized_) {
+        runtime_error("response already finalized");
     }
-    return result;
 }
 
 std::string Interpreter::stringify_for_concat(const Value& value) const {
@@ -4,6 +4,7 @@
 #include <functional>
 #include <iosfwd>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -18,7 +19,19 @@ namespace polonio {
 
 struct CGIContext;
 struct SessionContext;
+class Vm;
 
+// `ast` walks the parsed tree directly; `vm` compiles programs and function
+// bodies to bytecode first. Both engines share values, environments, builtins,
+// and error reporting, so templates behave identically under either.
+enum class ExecutionEngine { Ast, Vm };
+
+std::optional<ExecutionEngine> parse_execution_engine(const std::string& name);
+// POLONIO_ENGINE when it names a known engine, otherwise the AST walker.
+ExecutionEngine default_execution_engine();
+
+// Carries `return` out of a file included inside a function call, across the
+// include callback, to that call. Returns within one program do not throw.
 class ReturnSignal : public std::exception {
 public:
     explicit ReturnSignal(Value value) : value_(std::move(value)) {}
@@ -41,9 +54,25 @@ struct ResponseContext {
     void emit(std::ostream& os);
 };
 
+// Lets a response go out while the script is still rendering. The adapter
+// installs one per request; the first flush() sends the status and headers
+// through `commit`, after which output goes straight to `write` and each
+// flush() calls `flush`.
+struct ResponseStream {
+    std::function<void(ResponseContext&)> commit;
+    OutputBuffer::Sink write;
+    std::function<void()> flush;
+};
+
 class Interpreter {
 public:
-    explicit Interpreter(std::shared_ptr<Env> env = std::make_shared<Env>(), std::string path = {});
+    // Builtins are read from the shared frozen scope, linked beneath the
+    // outermost scope of `env`. Pass `link_builtins` false when that chain
+    // already provides them, or to run without any.
+    explicit Interpreter(std::shared_ptr<Env> env = std::make_shared<Env>(),
+                         std::string path = {},
+                         bool link_builtins = true);
+    ~Interpreter();
 
     Value eval_expr(const ExprPtr& expr);
     void exec_stmt(const StmtPtr& stmt);
@@ -54,6 +83,7 @@ public:
     bool response_finalized() const { return response_finalized_; }
     std::shared_ptr<Env> env() const { return env_; }
     const std::string& path() const { return path_; }
+    void set_path(std::string path) { path_ = std::move(path); }
     void write_text(const std::string& text);
     void set_output_sink(OutputBuffer::Sink sink, bool capture_output = false) {
         output_.set_sink(std::move(sink), capture_output);
@@ -70,8 +100,24 @@ public:
     DatabaseConnection* db_connection() { return db_connection_.get(); }
     const DatabaseConnection* db_connection() const { return db_connection_.get(); }
     void finalize_response(const std::string& body);
+    void set_response_stream(ResponseStream* stream) { response_stream_ = stream; }
+    // Commits the headers on first use and sends the output so far through
+    // the response stream. Returns false when the adapter cannot stream.
+    bool flush_response();
+    // Storage root used when POLONIO_STORAGE_PATH is unset; the dev server
+    // points it at the served directory.
+    void set_storage_root(std::string root) { storage_root_ = std::move(root); }
+    const std::string& storage_root() const { return storage_root_; }
+    void set_engine(ExecutionEngine engine) { engine_ = engine; }
+    // Drops all per-request state (globals, output, contexts, storage root,
+    // database connection) so the interpreter can serve another script. The engine
+    // setting is kept.
+    void reset(std::string path = {});
+    ExecutionEngine engine() const { return engine_; }
 
 private:
+    friend class Vm;
+
     Value eval_expr_internal(const ExprPtr& expr);
     Value eval_literal(const LiteralExpr& literal);
     Value eval_identifier(const IdentifierExpr& ident);
@@ -83,37 +129,54 @@ private:
     Value eval_array(const ArrayLiteralExpr& array);
     Value eval_object(const ObjectLiteralExpr& object);
 
+    // How a statement finished. `return` unwinds to its call through ordinary
+    // returns, with the value parked in return_value_ on the way.
+    enum class Completion { Normal, Return };
+
+    Completion exec_stmt_internal(const StmtPtr& stmt);
     void exec_var(const VarDeclStmt& stmt);
     void exec_echo(const EchoStmt& stmt);
     void exec_expr_stmt(const ExprStmt& stmt);
-    void exec_return(const ReturnStmt& stmt);
+    Completion exec_return(const ReturnStmt& stmt);
     void exec_function(const FunctionStmt& stmt);
-    void exec_if(const IfStmt& stmt);
-    void exec_while(const WhileStmt& stmt);
-    void exec_for(const ForStmt& stmt);
-    void exec_attempt(const AttemptStmt& stmt);
-    void exec_block(const std::vector<StmtPtr>& statements);
+    Completion exec_if(const IfStmt& stmt);
+    Completion exec_while(const WhileStmt& stmt);
+    Completion exec_for(const ForStmt& stmt);
+    Completion exec_attempt(const AttemptStmt& stmt);
+    Completion exec_block(const std::vector<StmtPtr>& statements);
     Value error_value(const PolonioError& error) const;
 
+    Value apply_unary(UnaryOp op, const Value& right);
+    Value apply_binary(BinaryOp op, const Value& left, const Value& right);
+    Value apply_compound(AssignOp op, const Value& current, const Value& rhs);
+    Value index_value(const Value& collection, const Value& idx);
+    Value call_builtin(const BuiltinFunction& builtin, const std::vector<Value>& args, const Location& location);
+    std::shared_ptr<Env> make_call_env(const Value& callee, const FunctionValue& function,
+                                       const std::vector<Value>& args);
+
     [[noreturn]] void runtime_error(const std::string& message);
-    Value lookup_identifier(const std::string& name);
+    Value lookup_identifier(const SlotRef& slot, const std::string& name);
     double require_number(const Value& value, const std::string& context);
     void ensure_response_writable();
 
-    static std::string decode_string(const std::string& literal);
     std::string stringify_for_concat(const Value& value) const;
 
     std::shared_ptr<Env> env_;
     OutputBuffer output_;
     std::string path_;
     int call_depth_ = 0;
+    Value return_value_;
     IncludeCallback include_callback_;
     ResponseContext* response_context_ = nullptr;
     CGIContext* cgi_context_ = nullptr;
     SessionContext* session_context_ = nullptr;
+    ResponseStream* response_stream_ = nullptr;
     std::unique_ptr<DatabaseConnection> db_connection_;
+    std::string storage_root_;
     bool response_finalized_ = false;
     std::string finalized_body_;
+    ExecutionEngine engine_;
+    std::unique_ptr<Vm> vm_;
 };
 
 } // namespace polonio
@@ -0,0 +1,46 @@
+#include "polonio/runtime/interpreter_pool.h"
+
+#include <utility>
+
+namespace polonio {
+
+InterpreterPool::Lease::~Lease() {
+    if (interpreter_) {
+        pool_->release(std::move(interpreter_));
+    }
+}
+
+InterpreterPool::Lease InterpreterPool::acquire(const std::string& path) {
+    std::unique_ptr<Interpreter> interpreter;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!idle_.empty()) {
+            interpreter = std::move(idle_.back());
+            idle_.pop_back();
+        }
+    }
+    if (interpreter) {
+        // Already reset when it was returned.
+        interpreter->set_path(path);
+    } else {
+        interpreter = std::make_unique<Interpreter>(nullptr, path);
+    }
+    return Lease(*this, std::move(interpreter));
+}
+
+std::size_t InterpreterPool::idle() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idle_.size();
+}
+
+void InterpreterPool::release(std::unique_ptr<Interpreter> interpreter) {
+    // Reset before parking so an idle interpreter holds no request data or
+    // database handle.
+    interpreter->reset();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_.size() < max_idle_) {
+        idle_.push_back(std::move(interpreter));
+    }
+}
+
+} // namespace polonio
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "polonio/runtime/interpreter.h"
+
+namespace polonio {
+
+// Keeps finished interpreters for reuse across requests. A lease resets its
+// interpreter when returned, so nothing from one request (globals, contexts,
+// an open database) reaches the next. Safe to share between threads.
+class InterpreterPool {
+public:
+    class Lease {
+    public:
+        Lease(InterpreterPool& pool, std::unique_ptr<Interpreter> interpreter)
+            : pool_(&pool), interpreter_(std::move(interpreter)) {}
+        Lease(Lease&& other) noexcept = default;
+        Lease& operator=(Lease&&) = delete;
+        ~Lease();
+
+        Interpreter& operator*() const { return *interpreter_; }
+        Interpreter* operator->() const { return interpreter_.get(); }
+
+    private:
+        InterpreterPool* pool_;
+        std::unique_ptr<Interpreter> interpreter_;
+    };
+
+    explicit InterpreterPool(std::size_t max_idle = 8) : max_idle_(max_idle) {}
+
+    Lease acquire(const std::string& path);
+    std::size_t idle() const;
+
+private:
+    void release(std::unique_ptr<Interpreter> interpreter);
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Interpreter>> idle_;
+    std::size_t max_idle_;
+};
+
+} // namespace polonio
@@ -1,6 +1,5 @@
 #include "polonio/runtime/json_utils.h"
 
-#include <algorithm>
 #include <cctype>
 #include <cstring>
 #include <iomanip>
@@ -138,11 +137,11 @@ private:
         if (advance() != '{') {
             error("expected object");
         }
-        Value::Object result;
+        std::vector<Value::Object::value_type> entries;
         skip_ws();
         if (peek() == '}') {
             advance();
-            return result;
+            return Value::Object();
         }
         while (true) {
             skip_ws();
@@ -156,7 +155,7 @@ private:
             }
             skip_ws();
             Value value = parse_value();
-            result[key] = value;
+            entries.emplace_back(std::move(key), std::move(value));
             skip_ws();
             char ch = advance();
             if (ch == '}') {
@@ -167,7 +166,7 @@ private:
             }
             skip_ws();
         }
-        return result;
+        return Value::Object(std::move(entries));
     }
 
     Value::Array parse_array() {
@@ -286,21 +285,14 @@ void serialize_array(const Value::ArrayPtr& arr, std::string& out, const JsonErr
 
 void serialize_object(const Value::ObjectPtr& obj, std::string& out, const JsonErrorFn& on_error) {
     out.push_back('{');
-    if (obj && !obj->empty()) {
-        std::vector<std::string> keys;
-        keys.reserve(obj->size());
-        for (const auto& entry : *obj) {
-            keys.push_back(entry.first);
-        }
-        std::sort(keys.begin(), keys.end());
+    if (obj) {
         bool first = true;
-        for (const auto& key : keys) {
+        for (const auto& entry : *obj) {
             if (!first) out.push_back(',');
             first = false;
-            append_string(key, out);
+            append_string(entry.first, out);
             out.push_back(':');
-            auto it = obj->find(key);
-            serialize_impl(it->second, out, on_error);
+            serialize_impl(entry.second, out, on_error);
         }
     }
     out.push_back('}');
@@ -0,0 +1,178 @@
+#include "polonio/runtime/multipart.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include "polonio/runtime/http_request_utils.h"
+
+namespace polonio::http {
+namespace {
+
+[[noreturn]] void invalid_body() { throw std::runtime_error("invalid multipart body"); }
+
+} // namespace
+
+MultipartParser::MultipartParser(const std::string& boundary, Handler handler)
+    : handler_(std::move(handler)), delimiter_("\r\n--" + boundary) {
+    // Boyer-Moore-Horspool shift table: how far the window may move when its
+    // last byte is a given value.
+    const std::size_t length = delimiter_.size();
+    skip_.fill(length);
+    for (std::size_t i = 0; i + 1 < length; ++i) {
+        skip_[static_cast<unsigned char>(delimiter_[i])] = length - 1 - i;
+    }
+}
+
+void MultipartParser::feed(const char* data, std::size_t size) {
+    buffer_.append(data, size);
+    std::size_t pos = 0;
+    while (step(pos)) {
+    }
+    buffer_.erase(0, pos);
+}
+
+void MultipartParser::finish() {
+    // A closing boundary with nothing after it also ends the body.
+    if (state_ == State::AfterDelimiter && in_part_ && buffer_.empty()) {
+        in_part_ = false;
+        handler_.end_part();
+        state_ = State::Done;
+    }
+    if (state_ != State::Done) {
+        invalid_body();
+    }
+}
+
+// Consumes what it can at `pos`; returns false when more input is needed.
+bool MultipartParser::step(std::size_t& pos) {
+    const std::size_t available = buffer_.size() - pos;
+    switch (state_) {
+    case State::Start: {
+        const std::size_t marker = delimiter_.size() - 2;
+        const std::size_t seen = std::min(available, marker);
+        if (buffer_.compare(pos, seen, delimiter_, 2, seen) != 0) {
+            invalid_body();
+        }
+        if (seen < marker) return false;
+        pos += marker;
+        state_ = State::AfterDelimiter;
+        return true;
+    }
+    case State::AfterDelimiter: {
+        if (available < 2) return false;
+        const bool last = buffer_.compare(pos, 2, "--") == 0;
+        if (!last && buffer_.compare(pos, 2, "\r\n") != 0) {
+            invalid_body();
+        }
+        pos += 2;
+        if (in_part_) {
+            in_part_ = false;
+            handler_.end_part();
+        }
+        state_ = last ? State::Done : State::Headers;
+        return true;
+    }
+    case State::Headers: {
+        const std::size_t end = buffer_.find("\r\n\r\n", pos);
+        if (end == std::string::npos) {
+            if (available > kMaxPartHeaderBytes) invalid_body();
+            return false;
+        }
+        if (end - pos > kMaxPartHeaderBytes) invalid_body();
+        PartHeaders headers = parse_part_headers(buffer_.substr(pos, end - pos));
+        pos = end + 4;
+        in_part_ = true;
+        handler_.begin_part(headers);
+        state_ = State::Data;
+        return true;
+    }
+    case State::Data: {
+        const std::size_t found = find_delimiter(pos);
+        if (found != std::string::npos) {
+            if (found > pos) handler_.part_data(buffer_.data() + pos, found - pos);
+            pos = found + delimiter_.size();
+            state_ = State::AfterDelimiter;
+            return true;
+        }
+        // Hold back a tail that could be the start of a delimiter split
+        // across pieces.
+        const std::size_t keep = delimiter_.size() - 1;
+        if (available > keep) {
+            handler_.part_data(buffer_.data() + pos, available - keep);
+            pos += available - keep;
+        }
+        return false;
+    }
+    case State::Done:
+        // The epilogue is ignored.
+        pos = buffer_.size();
+        return false;
+    }
+    return false;
+}
+
+std::size_t MultipartParser::find_delimiter(std::size_t from) const {
+    const std::size_t length = delimiter_.size();
+    const char* haystack = buffer_.data();
+    for (std::size_t i = from; i + length <= buffer_.size();
+         i += skip_[static_cast<unsigned char>(haystack[i + length - 1])]) {
+        if (std::memcmp(haystack + i, delimiter_.data(), length) == 0) {
+            return i;
+        }
+    }
+    return std::string::npos;
+}
+
+MultipartParser::PartHeaders MultipartParser::parse_part_headers(const std::string& block) const {
+    PartHeaders headers;
+    std::size_t line_start = 0;
+    while (line_start < block.size()) {
+        std::size_t line_end = block.find("\r\n", line_start);
+        std::string line =
+            block.substr(line_start, (line_end == std::string::npos ? block.size() : line_end) - line_start);
+        line_start = line_end == std::string::npos ? block.size() : line_end + 2;
+        if (line.empty()) continue;
+        auto colon = line.find(':');
+        if (colon == std::string::npos) {
+            invalid_body();
+        }
+        std::string key = to_lower_copy(trim_whitespace(line.substr(0, colon)));
+        std::string value = trim_whitespace(line.substr(colon + 1));
+        if (key == "content-disposition") {
+            std::stringstream ss(value);
+            std::string token;
+            bool first_token = true;
+            while (std::getline(ss, token, ';')) {
+                token = trim_whitespace(token);
+                if (token.empty()) continue;
+                if (first_token) {
+                    first_token = false;
+                    continue;
+                }
+                auto eq = token.find('=');
+                if (eq == std::string::npos) continue;
+                std::string param_key = to_lower_copy(trim_whitespace(token.substr(0, eq)));
+                std::string param_value = trim_whitespace(token.substr(eq + 1));
+                if (!param_value.empty() && param_value.front() == '"' && param_value.back() == '"') {
+                    param_value = param_value.substr(1, param_value.size() - 2);
+                }
+                if (param_key == "name") {
+                    headers.name = param_value;
+                } else if (param_key == "filename") {
+                    headers.filename = param_value;
+                }
+            }
+        } else if (key == "content-type") {
+            headers.content_type = value;
+        }
+    }
+    if (headers.name.empty()) {
+        invalid_body();
+    }
+    return headers;
+}
+
+} // namespace polonio::http
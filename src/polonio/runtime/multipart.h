@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+namespace polonio::http {
+
+// Incremental multipart/form-data parser. Bytes are pushed in pieces of any
+// size, and part contents reach the handler as soon as they are known not to
+// hold the next boundary, so memory stays bounded by the boundary length and
+// the largest part header block rather than by the body.
+class MultipartParser {
+public:
+    struct PartHeaders {
+        std::string name;
+        std::string filename;
+        std::string content_type;
+    };
+
+    struct Handler {
+        std::function<void(const PartHeaders&)> begin_part;
+        std::function<void(const char* data, std::size_t size)> part_data;
+        std::function<void()> end_part;
+    };
+
+    // Header blocks longer than this are rejected.
+    static constexpr std::size_t kMaxPartHeaderBytes = 16 * 1024;
+
+    MultipartParser(const std::string& boundary, Handler handler);
+
+    // Both throw std::runtime_error("invalid multipart body") on malformed
+    // input; call finish() once every byte has been fed.
+    void feed(const char* data, std::size_t size);
+    void finish();
+
+private:
+    enum class State { Start, AfterDelimiter, Headers, Data, Done };
+
+    bool step(std::size_t& pos);
+    std::size_t find_delimiter(std::size_t from) const;
+    PartHeaders parse_part_headers(const std::string& block) const;
+
+    Handler handler_;
+    // "\r\n--boundary"; the first boundary appears without the leading CRLF.
+    std::string delimiter_;
+    std::array<std::size_t, 256> skip_{};
+    std::string buffer_;
+    State state_ = State::Start;
+    bool in_part_ = false;
+};
+
+} // namespace polonio::http
@@ -49,6 +49,8 @@ std::string OutputBuffer::value_to_string(const Value& value) {
             } else if constexpr (std::is_same_v<T, Value::ObjectPtr> ||
                                  std::is_same_v<T, Value::ReadOnlyObjectPtr>) {
                 return "[object]";
+            } else if constexpr (std::is_same_v<T, Value::IteratorPtr>) {
+                return alt ? std::string("[") + alt->type_name() + "]" : std::string();
             } else {
                 return "[function]";
             }
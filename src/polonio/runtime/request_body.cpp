@@ -0,0 +1,155 @@
+#include "polonio/runtime/request_body.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+namespace polonio {
+
+struct RequestBody::Storage {
+    std::string memory;
+    int fd = -1;
+    std::uint64_t size = 0;
+    void* map = nullptr;
+    std::size_t map_size = 0;
+
+    Storage() = default;
+    Storage(const Storage&) = delete;
+    Storage& operator=(const Storage&) = delete;
+
+    ~Storage() {
+        unmap();
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    void unmap() {
+        if (map) {
+            ::munmap(map, map_size);
+            map = nullptr;
+            map_size = 0;
+        }
+    }
+};
+
+namespace {
+
+[[noreturn]] void throw_body_error(const char* operation) {
+    throw std::runtime_error(std::string("request body: ") + operation + ": " + std::strerror(errno));
+}
+
+// A temporary file that is already unlinked, so it disappears with its
+// descriptor however the request ends.
+int open_spool_file() {
+    std::string pattern = (std::filesystem::temp_directory_path() / "polonio-body-XXXXXX").string();
+    std::vector<char> path(pattern.begin(), pattern.end());
+    path.push_back('\0');
+    int fd = ::mkstemp(path.data());
+    if (fd < 0) {
+        throw_body_error("mkstemp");
+    }
+    ::unlink(path.data());
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+void write_all(int fd, const char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw_body_error("write");
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+}
+
+} // namespace
+
+RequestBody::RequestBody(std::string bytes) {
+    if (!bytes.empty()) {
+        storage().memory = std::move(bytes);
+        storage_->size = storage_->memory.size();
+    }
+}
+
+RequestBody::Storage& RequestBody::storage() {
+    if (!storage_) {
+        storage_ = std::make_shared<Storage>();
+    }
+    return *storage_;
+}
+
+void RequestBody::append(const char* data, std::size_t size) {
+    if (size == 0) {
+        return;
+    }
+    Storage& body = storage();
+    body.unmap();
+    if (body.fd < 0 && body.memory.size() + size > kDefaultMemoryLimit) {
+        body.fd = open_spool_file();
+        write_all(body.fd, body.memory.data(), body.memory.size());
+        std::string().swap(body.memory);
+    }
+    if (body.fd >= 0) {
+        write_all(body.fd, data, size);
+    } else {
+        body.memory.append(data, size);
+    }
+    body.size += size;
+}
+
+std::uint64_t RequestBody::size() const { return storage_ ? storage_->size : 0; }
+
+bool RequestBody::spooled() const { return storage_ && storage_->fd >= 0; }
+
+std::string_view RequestBody::view() const {
+    if (!storage_) {
+        return std::string_view();
+    }
+    Storage& body = *storage_;
+    if (body.fd < 0) {
+        return body.memory;
+    }
+    if (!body.map) {
+        void* mapped = ::mmap(nullptr, static_cast<std::size_t>(body.size), PROT_READ, MAP_PRIVATE, body.fd, 0);
+        if (mapped == MAP_FAILED) {
+            throw_body_error("mmap");
+        }
+        body.map = mapped;
+        body.map_size = static_cast<std::size_t>(body.size);
+    }
+    return std::string_view(static_cast<const char*>(body.map), body.map_size);
+}
+
+std::size_t RequestBody::read(std::uint64_t offset, char* out, std::size_t size) const {
+    if (!storage_ || offset >= storage_->size) {
+        return 0;
+    }
+    const Storage& body = *storage_;
+    size = static_cast<std::size_t>(std::min<std::uint64_t>(size, body.size - offset));
+    if (body.fd < 0) {
+        std::memcpy(out, body.memory.data() + offset, size);
+        return size;
+    }
+    std::size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::pread(body.fd, out + done, size - done, static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) throw_body_error("read");
+        if (n == 0) break;
+        done += static_cast<std::size_t>(n);
+    }
+    return done;
+}
+
+} // namespace polonio
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace polonio {
+
+// A request body that stays in memory while small and moves to an unlinked
+// temporary file once it grows past a threshold, so a large upload costs disk
+// rather than memory. Written by one reader, then only read; copies share the
+// same bytes.
+class RequestBody {
+public:
+    static constexpr std::size_t kDefaultMemoryLimit = 64 * 1024;
+    // Largest body that may be copied onto the heap whole, as request_body(),
+    // request_json() and urlencoded forms do. Only multipart uploads, which
+    // stream into storage, may be larger.
+    static constexpr std::uint64_t kMaxBufferedBytes = 8 * 1024 * 1024;
+
+    RequestBody() = default;
+    explicit RequestBody(std::string bytes);
+
+    // Throws std::runtime_error when the temporary file cannot be written.
+    void append(const char* data, std::size_t size);
+    std::uint64_t size() const;
+    bool empty() const { return size() == 0; }
+    bool spooled() const;
+    // The whole body. A spooled body is mapped read-only instead of read, so
+    // viewing it costs address space rather than heap.
+    std::string_view view() const;
+    std::string str() const { return std::string(view()); }
+    // Copies up to `size` bytes starting at `offset` into `out` and returns
+    // how many were copied, for readers that walk the body in pieces.
+    std::size_t read(std::uint64_t offset, char* out, std::size_t size) const;
+
+private:
+    struct Storage;
+
+    Storage& storage();
+
+    std::shared_ptr<Storage> storage_;
+};
+
+} // namespace polonio
@@ -13,10 +13,10 @@ namespace polonio {
 
 namespace {
 
-std::string get_storage_root_internal() {
+std::string get_storage_root_internal(const Interpreter& interp) {
     const char* root = std::getenv("POLONIO_STORAGE_PATH");
     if (!root || std::string(root).empty()) {
-        return std::string();
+        return interp.storage_root();
     }
     return root;
 }
@@ -26,7 +26,7 @@ std::string get_storage_root_internal() {
 std::string storage_root(Interpreter& interp,
                          const std::string& builtin_name,
                          const Location& loc) {
-    std::string root = get_storage_root_internal();
+    std::string root = get_storage_root_internal(interp);
     if (root.empty()) {
         ErrorDetails details;
         details.capability = "storage";
@@ -16,7 +16,7 @@ namespace polonio {
 namespace {
 
 std::string make_temp_path(const std::filesystem::path& dir) {
-    static std::mt19937_64 rng{std::random_device{}()};
+    thread_local std::mt19937_64 rng{std::random_device{}()};
     std::uniform_int_distribution<uint64_t> dist;
     for (int i = 0; i < 16; ++i) {
         auto candidate = dir / (".tmp." + std::to_string(dist(rng)));
@@ -41,12 +41,10 @@ void ensure_parent_exists(const std::filesystem::path& path,
                        loc);
 }
 
-} // namespace
-
-std::string storage_file_read(const std::string& relative,
-                              Interpreter& interp,
-                              const std::string& builtin_name,
-                              const Location& loc) {
+std::ifstream open_storage_file(const std::string& relative,
+                                Interpreter& interp,
+                                const std::string& builtin_name,
+                                const Location& loc) {
     auto resolved = resolve_storage_path(relative, interp, builtin_name, loc);
     std::filesystem::path path(resolved);
     if (!std::filesystem::exists(path)) {
@@ -68,10 +66,37 @@ std::string storage_file_read(const std::string& relative,
                            interp.path(),
                            loc);
     }
+    return file;
+}
+
+} // namespace
+
+std::string storage_file_read(const std::string& relative,
+                              Interpreter& interp,
+                              const std::string& builtin_name,
+                              const Location& loc) {
+    std::ifstream file = open_storage_file(relative, interp, builtin_name, loc);
     std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
     return content;
 }
 
+std::string storage_file_read_range(const std::string& relative,
+                                    std::uint64_t offset,
+                                    std::uint64_t length,
+                                    Interpreter& interp,
+                                    const std::string& builtin_name,
+                                    const Location& loc) {
+    std::ifstream file = open_storage_file(relative, interp, builtin_name, loc);
+    std::string content;
+    if (!file.seekg(static_cast<std::streamoff>(offset))) {
+        return content;
+    }
+    content.resize(static_cast<std::size_t>(length));
+    file.read(&content[0], static_cast<std::streamsize>(length));
+    content.resize(static_cast<std::size_t>(file.gcount()));
+    return content;
+}
+
 void storage_file_write(const std::string& relative,
                         const std::string& content,
                         Interpreter& interp,
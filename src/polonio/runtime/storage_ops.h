@@ -13,6 +13,14 @@ std::string storage_file_read(const std::string& relative,
                               Interpreter& interp,
                               const std::string& builtin_name,
                               const Location& loc);
+// Reads at most `length` bytes starting at `offset`; the rest of the file is
+// never loaded.
+std::string storage_file_read_range(const std::string& relative,
+                                    std::uint64_t offset,
+                                    std::uint64_t length,
+                                    Interpreter& interp,
+                                    const std::string& builtin_name,
+                                    const Location& loc);
 void storage_file_write(const std::string& relative,
                         const std::string& content,
                         Interpreter& interp,
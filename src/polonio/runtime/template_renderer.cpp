@@ -1,7 +1,12 @@
 #include "polonio/runtime/template_renderer.h"
 
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -50,6 +55,78 @@ std::filesystem::path canonicalize(const std::filesystem::path& path) {
     }
 }
 
+struct FileStamp {
+    std::filesystem::file_time_type mtime;
+    std::uintmax_t size = 0;
+
+    bool operator==(const FileStamp& other) const { return mtime == other.mtime && size == other.size; }
+};
+
+std::optional<FileStamp> stat_file(const std::filesystem::path& path) {
+    std::error_code ec;
+    FileStamp stamp;
+    stamp.size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        return std::nullopt;
+    }
+    stamp.mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return std::nullopt;
+    }
+    return stamp;
+}
+
+// Parsed programs are immutable once built, so one compiled copy per
+// canonical path is shared by every render in the process. Each include is
+// its own entry and is revalidated when its include statement executes, so
+// editing a partial invalidates only that partial.
+class TemplateCache {
+public:
+    std::shared_ptr<const Program> find(const std::string& key, const FileStamp& stamp) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end() || !(it->second.stamp == stamp)) {
+            stats_.misses += 1;
+            return nullptr;
+        }
+        stats_.hits += 1;
+        return it->second.program;
+    }
+
+    void store(const std::string& key, const FileStamp& stamp, std::shared_ptr<const Program> program) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_[key] = Entry{stamp, std::move(program)};
+    }
+
+    TemplateCacheStats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        TemplateCacheStats result = stats_;
+        result.entries = entries_.size();
+        return result;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+        stats_ = TemplateCacheStats{};
+    }
+
+private:
+    struct Entry {
+        FileStamp stamp;
+        std::shared_ptr<const Program> program;
+    };
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    TemplateCacheStats stats_;
+};
+
+TemplateCache& template_cache() {
+    static TemplateCache cache;
+    return cache;
+}
+
 } // namespace
 
 std::string escape_string_literal(const std::string& text) {
@@ -152,13 +229,13 @@ bool is_inline_echo(const Program& program, EchoStmt** echo_out) {
     if (statements.size() != 1) {
         return false;
     }
-    if (auto echo_stmt = std::dynamic_pointer_cast<EchoStmt>(statements[0])) {
-        if (echo_out) {
-            *echo_out = echo_stmt.get();
-        }
-        return true;
+    if (statements[0]->kind() != StmtKind::Echo) {
+        return false;
+    }
+    if (echo_out) {
+        *echo_out = static_cast<EchoStmt*>(statements[0].get());
     }
-    return false;
+    return true;
 }
 
 std::string compile_template(const Source& source) {
@@ -175,20 +252,43 @@ std::string compile_template(const Source& source) {
     return code;
 }
 
-void render_source(RenderState& state, const Source& source, const std::filesystem::path& canonical_path) {
-    PathGuard guard(state.path_stack, canonical_path);
+std::shared_ptr<const Program> compile_program(const Source& source) {
     auto compiled = compile_template(source);
     Lexer lexer(compiled, source.path());
     auto tokens = lexer.scan_all();
     Parser parser(tokens, source.path());
-    auto program = parser.parse_program();
+    return std::make_shared<const Program>(parser.parse_program());
+}
+
+// The file is stamped before it is read, so a write racing with the read
+// leaves an older stamp behind and the next lookup recompiles.
+std::shared_ptr<const Program> load_program(const std::filesystem::path& canonical_path,
+                                            const std::function<Source()>& read_source) {
+    const std::string key = canonical_path.string();
+    auto stamp = stat_file(canonical_path);
+    if (stamp) {
+        if (auto cached = template_cache().find(key, *stamp)) {
+            return cached;
+        }
+    }
+    Source source = read_source();
+    auto program = compile_program(source);
+    if (stamp && stamp->size == source.size()) {
+        template_cache().store(key, *stamp, program);
+    }
+    return program;
+}
+
+void render_program(RenderState& state, const Program& program, const std::filesystem::path& canonical_path) {
+    PathGuard guard(state.path_stack, canonical_path);
     state.interpreter.exec_program(program);
 }
 
-std::string render_template_with_interpreter(const Source& source, Interpreter& interpreter) {
+std::string render_root(Interpreter& interpreter,
+                        const std::filesystem::path& root_path,
+                        const std::function<std::shared_ptr<const Program>()>& load_root) {
     interpreter.clear_output();
     RenderState state{interpreter, {}};
-    auto root_path = canonicalize(source.path());
     interpreter.set_include_callback([&state](const std::string& include_path, const Location& loc) {
         if (state.path_stack.empty()) {
             throw PolonioError(ErrorKind::Runtime, "include not allowed", "", loc);
@@ -204,23 +304,42 @@ std::string render_template_with_interpreter(const Source& source, Interpreter&
                 throw PolonioError(ErrorKind::Runtime, "include cycle detected", state.path_stack.back().string(), loc);
             }
         }
-        auto child_source = Source::from_file(candidate.string());
-        Source normalized(canonical_child.string(), child_source.content());
+        auto program = load_program(canonical_child, [&]() {
+            auto child_source = Source::from_file(candidate.string());
+            return Source(canonical_child.string(), child_source.content());
+        });
         try {
-            render_source(state, normalized, canonical_child);
+            render_program(state, *program, canonical_child);
         } catch (PolonioError& error) {
             error.add_include_frame(state.path_stack.back().string() + ":" +
                                     std::to_string(loc.line) + ":" + std::to_string(loc.column));
             throw;
         }
     });
-    render_source(state, source, root_path);
+    auto program = load_root();
+    render_program(state, *program, root_path);
     if (interpreter.response_finalized()) {
         return interpreter.finalized_body();
     }
     return interpreter.output();
 }
 
+std::string render_template_with_interpreter(const Source& source, Interpreter& interpreter) {
+    auto root_path = canonicalize(source.path());
+    return render_root(interpreter, root_path, [&source]() { return compile_program(source); });
+}
+
+std::string render_template_file(const std::string& path, Interpreter& interpreter) {
+    auto root_path = canonicalize(path);
+    return render_root(interpreter, root_path, [&]() {
+        return load_program(root_path, [&path]() { return Source::from_file(path); });
+    });
+}
+
+TemplateCacheStats template_cache_stats() { return template_cache().stats(); }
+
+void clear_template_cache() { template_cache().clear(); }
+
 std::string render_template(const Source& source) {
     Interpreter interpreter(std::make_shared<Env>(), source.path());
     return render_template_with_interpreter(source, interpreter);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 namespace polonio {
@@ -8,7 +9,21 @@ class Source;
 
 class Interpreter;
 
+struct TemplateCacheStats {
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t entries = 0;
+};
+
 std::string render_template(const Source& source);
 std::string render_template_with_interpreter(const Source& source, Interpreter& interpreter);
+// Like render_template_with_interpreter, but reads the file itself so a
+// cached parse (keyed by canonical path, modification time, and size) can
+// skip both the read and the lex/parse front end. Includes are cached the
+// same way whichever entry point rendered the page.
+std::string render_template_file(const std::string& path, Interpreter& interpreter);
+
+TemplateCacheStats template_cache_stats();
+void clear_template_cache();
 
 } // namespace polonio
@@ -1,19 +1,15 @@
 #include "polonio/runtime/value.h"
 
+#include <algorithm>
+#include <iterator>
 #include <type_traits>
 #include <unordered_set>
 #include <utility>
 
 namespace polonio {
 
-Value::Value() : storage_(std::monostate{}) {}
-
 Value::Value(std::nullptr_t) : storage_(std::monostate{}) {}
 
-Value::Value(bool b) : storage_(b) {}
-
-Value::Value(double d) : storage_(d) {}
-
 Value::Value(int i) : storage_(static_cast<double>(i)) {}
 
 Value::Value(const std::string& s) : storage_(s) {}
@@ -42,6 +38,8 @@ Value::Value(BuiltinFunction fn) {
     storage_ = std::move(fn);
 }
 
+Value::Value(IteratorPtr iterator) : storage_(std::move(iterator)) {}
+
 std::string Value::type_name() const {
     return std::visit(
         [](const auto& alt) -> std::string {
@@ -62,6 +60,8 @@ std::string Value::type_name() const {
                 return "object";
             } else if constexpr (std::is_same_v<T, BuiltinFunction>) {
                 return "function";
+            } else if constexpr (std::is_same_v<T, IteratorPtr>) {
+                return alt ? alt->type_name() : "null";
             } else {
                 return "function";
             }
@@ -86,8 +86,9 @@ bool Value::is_truthy() const {
             } else if constexpr (std::is_same_v<T, ObjectPtr>) {
                 return alt && !alt->empty();
             } else {
-                // ReadOnlyObjectPtr is the immutable Error view. Functions and
-                // Error views are present values and therefore always true.
+                // ReadOnlyObjectPtr is the immutable Error view. Functions,
+                // Error views, and iterators are present values and therefore
+                // always true.
                 return true;
             }
         },
@@ -143,9 +144,9 @@ bool values_equal(const Value& left, const Value& right,
                 if (lhs->size() != rhs->size()) {
                     return false;
                 }
-                for (const auto& kv : *lhs) {
-                    auto it = rhs->find(kv.first);
-                    if (it == rhs->end() || !values_equal(kv.second, it->second, active)) {
+                // Both sides are in key order, so equal objects line up entry by entry.
+                for (auto l = lhs->begin(), r = rhs->begin(); l != lhs->end(); ++l, ++r) {
+                    if (l->first != r->first || !values_equal(l->second, r->second, active)) {
                         return false;
                     }
                 }
@@ -172,9 +173,143 @@ bool Value::operator==(const Value& other) const {
 
 bool Value::operator!=(const Value& other) const { return !(*this == other); }
 
-const Value::Storage& Value::storage() const { return storage_; }
+namespace {
+
+bool key_less(const ObjectMap::value_type& lhs, const ObjectMap::value_type& rhs) { return lhs.first < rhs.first; }
+
+std::size_t key_hash(std::string_view key) { return std::hash<std::string_view>()(key); }
+
+} // namespace
+
+ObjectMap::ObjectMap(std::vector<value_type> entries) : entries_(std::move(entries)) {
+    std::stable_sort(entries_.begin(), entries_.end(), key_less);
+    // Keep the last of each run of equal keys.
+    auto out = entries_.begin();
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        auto next = std::next(it);
+        if (next != entries_.end() && next->first == it->first) {
+            continue;
+        }
+        if (out != it) {
+            *out = std::move(*it);
+        }
+        ++out;
+    }
+    entries_.erase(out, entries_.end());
+    sorted_ = entries_.size();
+}
+
+ObjectMap ObjectMap::from_sorted(std::vector<value_type> entries) {
+    ObjectMap object;
+    object.entries_ = std::move(entries);
+    object.sorted_ = object.entries_.size();
+    return object;
+}
+
+std::size_t ObjectMap::index_of(std::string_view key) const {
+    auto sorted_end = entries_.begin() + static_cast<std::ptrdiff_t>(sorted_);
+    auto it = std::lower_bound(entries_.begin(), sorted_end, key,
+                               [](const value_type& entry, std::string_view rhs) { return entry.first < rhs; });
+    if (it != sorted_end && it->first == key) {
+        return static_cast<std::size_t>(it - entries_.begin());
+    }
+    if (!unsorted_.empty()) {
+        auto range = unsorted_.equal_range(key_hash(key));
+        for (auto candidate = range.first; candidate != range.second; ++candidate) {
+            if (entries_[candidate->second].first == key) {
+                return candidate->second;
+            }
+        }
+    }
+    return entries_.size();
+}
 
-Value::Storage& Value::storage() { return storage_; }
+void ObjectMap::settle() const {
+    if (unsorted_.empty()) {
+        return;
+    }
+    auto middle = entries_.begin() + static_cast<std::ptrdiff_t>(sorted_);
+    std::sort(middle, entries_.end(), key_less);
+    std::inplace_merge(entries_.begin(), middle, entries_.end(), key_less);
+    sorted_ = entries_.size();
+    unsorted_.clear();
+}
+
+Value& ObjectMap::at(std::string_view key) {
+    auto it = find(key);
+    if (it == entries_.end()) {
+        throw std::out_of_range("object has no key: " + std::string(key));
+    }
+    return it->second;
+}
+
+const Value& ObjectMap::at(std::string_view key) const {
+    auto it = find(key);
+    if (it == entries_.end()) {
+        throw std::out_of_range("object has no key: " + std::string(key));
+    }
+    return it->second;
+}
+
+std::pair<ObjectMap::iterator, bool> ObjectMap::emplace(std::string key, Value value) {
+    std::size_t index = index_of(key);
+    if (index != entries_.size()) {
+        return {entries_.begin() + static_cast<std::ptrdiff_t>(index), false};
+    }
+    // Keys arriving in order, and any key while the object is small, go
+    // straight into place; the rest wait unsorted for the next walk.
+    if (unsorted_.empty() && (entries_.size() < kFlatInsertLimit || entries_.back().first < key)) {
+        auto it = std::lower_bound(entries_.begin(), entries_.end(), key,
+                                   [](const value_type& entry, const std::string& rhs) { return entry.first < rhs; });
+        it = entries_.emplace(it, std::move(key), std::move(value));
+        ++sorted_;
+        return {it, true};
+    }
+    unsorted_.emplace(key_hash(key), entries_.size());
+    entries_.emplace_back(std::move(key), std::move(value));
+    return {std::prev(entries_.end()), true};
+}
+
+ObjectMap::iterator ObjectMap::erase(const_iterator position) {
+    std::size_t index = static_cast<std::size_t>(position - entries_.cbegin());
+    if (index < sorted_) {
+        entries_.erase(position);
+        --sorted_;
+        // Every unsorted entry moved down one place.
+        for (auto& entry : unsorted_) {
+            --entry.second;
+        }
+        return entries_.begin() + static_cast<std::ptrdiff_t>(index);
+    }
+    // The unsorted tail has no order to keep: fill the hole with the last entry.
+    auto forget = [this](std::size_t at) {
+        auto range = unsorted_.equal_range(key_hash(entries_[at].first));
+        for (auto candidate = range.first; candidate != range.second; ++candidate) {
+            if (candidate->second == at) {
+                unsorted_.erase(candidate);
+                return;
+            }
+        }
+    };
+    forget(index);
+    std::size_t last = entries_.size() - 1;
+    if (index != last) {
+        forget(last);
+        entries_[index] = std::move(entries_[last]);
+        unsorted_.emplace(key_hash(entries_[index].first), index);
+    }
+    entries_.pop_back();
+    return entries_.begin() + static_cast<std::ptrdiff_t>(index);
+}
+
+std::size_t ObjectMap::erase(std::string_view key) {
+    std::size_t index = index_of(key);
+    if (index == entries_.size()) {
+        return 0;
+    }
+    erase(entries_.cbegin() + static_cast<std::ptrdiff_t>(index));
+    return 1;
+}
 
 std::string safe_value_summary(const Value& value) {
     return std::visit([](const auto& alt) -> std::string {
@@ -191,6 +326,8 @@ std::string safe_value_summary(const Value& value) {
             return "object(count=" + std::to_string(alt ? alt->size() : 0) + ")";
         } else if constexpr (std::is_same_v<T, Value::ReadOnlyObjectPtr>) {
             return "object(count=" + std::to_string(alt ? alt->size() : 0) + ")";
+        } else if constexpr (std::is_same_v<T, Value::IteratorPtr>) {
+            return alt ? alt->type_name() : "null";
         } else return "function";
     }, value.storage());
 }
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
-#include <memory>
+#include <initializer_list>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <stdexcept>
 #include <unordered_map>
 #include <variant>
@@ -16,8 +18,12 @@ class Env;
 class Stmt;
 class Interpreter;
 struct Location;
+struct Chunk;
+struct ScopeLayout;
 
 class Value;
+class ObjectMap;
+class ValueIterator;
 
 using BuiltinCallback = Value (*)(Interpreter&, const std::vector<Value>&, const Location&);
 
@@ -27,6 +33,10 @@ struct FunctionValue {
     std::vector<std::shared_ptr<Stmt>> body;
     std::shared_ptr<Env> closure;
     std::shared_ptr<void> identity;
+    // Bytecode for `body` when the function was declared under the VM engine.
+    std::shared_ptr<const Chunk> code;
+    // Call scope layout from the resolver; null for unresolved bodies.
+    std::shared_ptr<const ScopeLayout> scope;
 
     bool operator==(const FunctionValue& other) const {
         return name == other.name && params == other.params && body == other.body && closure == other.closure;
@@ -59,16 +69,17 @@ public:
 class Value {
 public:
     using Array = std::vector<Value>;
-    using Object = std::unordered_map<std::string, Value>;
+    using Object = ObjectMap;
     using ArrayPtr = std::shared_ptr<Array>;
     using ObjectPtr = std::shared_ptr<Object>;
     using ReadOnlyObjectPtr = std::shared_ptr<const Object>;
-    using Storage = std::variant<std::monostate, bool, double, std::string, ArrayPtr, ObjectPtr, ReadOnlyObjectPtr, FunctionValue, BuiltinFunction>;
+    using IteratorPtr = std::shared_ptr<ValueIterator>;
+    using Storage = std::variant<std::monostate, bool, double, std::string, ArrayPtr, ObjectPtr, ReadOnlyObjectPtr, FunctionValue, BuiltinFunction, IteratorPtr>;
 
-    Value();
+    Value() = default;
     Value(std::nullptr_t);
-    explicit Value(bool b);
-    explicit Value(double d);
+    explicit Value(bool b) : storage_(b) {}
+    explicit Value(double d) : storage_(d) {}
     explicit Value(int i);
     Value(const std::string& s);
     Value(std::string&& s);
@@ -80,6 +91,7 @@ public:
     explicit Value(ReadOnlyObjectPtr object);
     explicit Value(FunctionValue fn);
     explicit Value(BuiltinFunction fn);
+    explicit Value(IteratorPtr iterator);
 
     std::string type_name() const;
     bool is_truthy() const;
@@ -87,13 +99,95 @@ public:
     bool operator==(const Value& other) const;
     bool operator!=(const Value& other) const;
 
-    const Storage& storage() const;
-    Storage& storage();
+    const Storage& storage() const { return storage_; }
+    Storage& storage() { return storage_; }
 
 private:
     Storage storage_;
 };
 
+// A sequence produced on demand, such as a database cursor. `for` walks it
+// once, pulling one element per iteration; scripts can otherwise only pass it
+// around and compare it by identity.
+class ValueIterator {
+public:
+    virtual ~ValueIterator() = default;
+    // What type() reports for it.
+    virtual const char* type_name() const = 0;
+    // Stores the next element and its loop index; false once exhausted.
+    virtual bool next(Value& index, Value& element) = 0;
+};
+
+// Object storage: one contiguous vector of entries kept sorted by key. Objects
+// iterate in byte-wise key order, so walking one needs no per-call sort, and a
+// small object is a single allocation. The interface follows std::map.
+//
+// Inserting into the middle of a large vector is linear, so past
+// kFlatInsertLimit entries new keys are appended unsorted and found through a
+// hash index instead; begin() merges them into place before any ordered walk.
+// That makes begin() a write even on a const object, so like any Value an
+// object must not be walked from two threads at once.
+class ObjectMap {
+public:
+    using value_type = std::pair<std::string, Value>;
+    using iterator = std::vector<value_type>::iterator;
+    using const_iterator = std::vector<value_type>::const_iterator;
+
+    static constexpr std::size_t kFlatInsertLimit = 64;
+
+    ObjectMap() = default;
+    ObjectMap(std::initializer_list<value_type> entries) : ObjectMap(std::vector<value_type>(entries)) {}
+    // Entries in any order; for a repeated key the last one wins.
+    explicit ObjectMap(std::vector<value_type> entries);
+    // Entries already in key order with no repeated key, as from a caller
+    // that sorted one layout for many objects.
+    static ObjectMap from_sorted(std::vector<value_type> entries);
+
+    iterator begin() {
+        settle();
+        return entries_.begin();
+    }
+    // end() never reorders, so an iterator from find() stays comparable to it.
+    iterator end() { return entries_.end(); }
+    const_iterator begin() const {
+        settle();
+        return entries_.begin();
+    }
+    const_iterator end() const { return entries_.end(); }
+    std::size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    void reserve(std::size_t count) { entries_.reserve(count); }
+    void clear() {
+        entries_.clear();
+        sorted_ = 0;
+        unsorted_.clear();
+    }
+
+    iterator find(std::string_view key) { return entries_.begin() + index_of(key); }
+    const_iterator find(std::string_view key) const { return entries_.cbegin() + index_of(key); }
+    std::size_t count(std::string_view key) const { return index_of(key) != entries_.size() ? 1 : 0; }
+
+    Value& at(std::string_view key);
+    const Value& at(std::string_view key) const;
+    Value& operator[](std::string_view key) { return emplace(std::string(key), Value()).first->second; }
+    std::pair<iterator, bool> emplace(std::string key, Value value);
+    std::pair<iterator, bool> insert(value_type entry) { return emplace(std::move(entry.first), std::move(entry.second)); }
+    iterator erase(const_iterator position);
+    std::size_t erase(std::string_view key);
+
+private:
+    // Position of `key` in entries_, or entries_.size() when absent.
+    std::size_t index_of(std::string_view key) const;
+    // Sorts the appended entries and merges them into the sorted prefix.
+    void settle() const;
+
+    mutable std::vector<value_type> entries_;
+    // entries_[0, sorted_) is in key order; the rest were appended unsorted.
+    mutable std::size_t sorted_ = 0;
+    // Key hash to position for the unsorted entries.
+    mutable std::unordered_multimap<std::size_t, std::size_t> unsorted_;
+};
+
 // Bounded, non-recursive display suitable for non-sensitive diagnostics. Call
 // sites handling credentials, bodies, cookies, tokens, or SQL parameters must
 // deliberately leave the summary empty instead.
@@ -0,0 +1,584 @@
+#include "polonio/runtime/vm.h"
+
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "polonio/common/error.h"
+#include "polonio/runtime/env.h"
+#include "polonio/runtime/interpreter.h"
+
+namespace polonio {
+
+namespace {
+
+struct RecoverHandler {
+    std::uint32_t recover_pc;
+    std::uint32_t recover;
+    std::shared_ptr<Env> env;
+    std::size_t stack_size;
+    std::size_t loop_depth;
+};
+
+// Arrays are walked live by position, objects over the keys they had at loop
+// start, and iterators by pulling their next element. `scope` is reused by the
+// next iteration unless a closure kept it.
+struct LoopState {
+    Value iterable;
+    std::size_t position = 0;
+    std::vector<std::string> keys;
+    std::shared_ptr<Env> scope;
+};
+
+bool both_numbers(const Value& left, const Value& right) {
+    return std::holds_alternative<double>(left.storage()) && std::holds_alternative<double>(right.storage());
+}
+
+bool is_comparison(OpCode op) {
+    return op == OpCode::Equal || op == OpCode::NotEqual || op == OpCode::Less || op == OpCode::LessEqual ||
+           op == OpCode::Greater || op == OpCode::GreaterEqual;
+}
+
+bool compare_numbers(OpCode op, double lhs, double rhs) {
+    switch (op) {
+    case OpCode::Equal: return lhs == rhs;
+    case OpCode::NotEqual: return lhs != rhs;
+    case OpCode::Less: return lhs < rhs;
+    case OpCode::LessEqual: return lhs <= rhs;
+    case OpCode::Greater: return lhs > rhs;
+    default: return lhs >= rhs;
+    }
+}
+
+// Stores `lhs <op> rhs` in `out`; false when the interpreter has to decide,
+// as for division by zero or concatenation.
+bool arithmetic(OpCode op, double lhs, double rhs, double& out) {
+    switch (op) {
+    case OpCode::Add: out = lhs + rhs; return true;
+    case OpCode::Subtract: out = lhs - rhs; return true;
+    case OpCode::Multiply: out = lhs * rhs; return true;
+    case OpCode::Divide:
+        if (rhs == 0.0) return false;
+        out = lhs / rhs;
+        return true;
+    case OpCode::Modulo:
+        if (rhs == 0.0) return false;
+        out = std::fmod(lhs, rhs);
+        return true;
+    default: return false;
+    }
+}
+
+bool compound_arithmetic(AssignOp op, double lhs, double rhs, double& out) {
+    switch (op) {
+    case AssignOp::Add: return arithmetic(OpCode::Add, lhs, rhs, out);
+    case AssignOp::Subtract: return arithmetic(OpCode::Subtract, lhs, rhs, out);
+    case AssignOp::Multiply: return arithmetic(OpCode::Multiply, lhs, rhs, out);
+    case AssignOp::Divide: return arithmetic(OpCode::Divide, lhs, rhs, out);
+    case AssignOp::Modulo: return arithmetic(OpCode::Modulo, lhs, rhs, out);
+    default: return false;
+    }
+}
+
+bool truthy(const Value& value) {
+    if (const bool* flag = std::get_if<bool>(&value.storage())) {
+        return *flag;
+    }
+    return value.is_truthy();
+}
+
+} // namespace
+
+void Vm::run_program(const Program& program) {
+    auto chunk = compile_bytecode(program);
+    run(*chunk);
+}
+
+Value Vm::pop() {
+    Value value = std::move(stack_.back());
+    stack_.pop_back();
+    return value;
+}
+
+Value Vm::run(const Chunk& chunk) {
+    // However the frame exits, the caller gets back its operand stack and scope.
+    struct FrameGuard {
+        Vm& vm;
+        std::size_t base;
+        std::size_t names_base;
+        std::shared_ptr<Env> env;
+        ~FrameGuard() {
+            vm.stack_.resize(base);
+            vm.names_.resize(names_base);
+            vm.interpreter_.env_ = std::move(env);
+        }
+    } guard{*this, stack_.size(), names_.size(), interpreter_.env_};
+    const std::size_t names_base = names_.size();
+    names_.resize(names_base + chunk.variables.size());
+
+    Interpreter& in = interpreter_;
+    const auto& code = chunk.code;
+    std::vector<RecoverHandler> handlers;
+    std::vector<LoopState> loops;
+    std::uint32_t pc = 0;
+
+    for (;;) {
+        try {
+            for (;;) {
+                const Instruction& ins = code[pc++];
+                switch (ins.op) {
+                case OpCode::Constant:
+                    stack_.push_back(chunk.constants[ins.a]);
+                    break;
+                case OpCode::Null:
+                    stack_.emplace_back();
+                    break;
+                case OpCode::True:
+                    stack_.emplace_back(true);
+                    break;
+                case OpCode::False:
+                    stack_.emplace_back(false);
+                    break;
+                case OpCode::Pop:
+                    stack_.pop_back();
+                    break;
+                case OpCode::LoadName: {
+                    const Variable& variable = chunk.variables[ins.a];
+                    if (Value* value = variable_value(names_base, ins.a, variable, false)) {
+                        stack_.push_back(*value);
+                    } else {
+                        stack_.push_back(in.lookup_identifier(variable.slot, variable.name));
+                    }
+                    break;
+                }
+                case OpCode::DefineName: {
+                    const Variable& variable = chunk.variables[ins.a];
+                    // A top-level `var` rebinds the name in the current scope;
+                    // when the cache already points there, that is a store.
+                    if (variable.slot.depth == 0 && variable.slot.index == SlotRef::kOutside) {
+                        if (Value* value = variable_value(names_base, ins.a, variable, true)) {
+                            *value = pop();
+                            break;
+                        }
+                    }
+                    in.env_->define(variable.slot, variable.name, pop());
+                    break;
+                }
+                case OpCode::StoreName: {
+                    const Variable& variable = chunk.variables[ins.a];
+                    if (Value* value = variable_value(names_base, ins.a, variable, true)) {
+                        // An assignment statement drops its value right away.
+                        if (code[pc].op == OpCode::Pop) {
+                            *value = pop();
+                            ++pc;
+                        } else {
+                            *value = stack_.back();
+                        }
+                    } else {
+                        in.env_->assign(variable.slot, variable.name, stack_.back());
+                    }
+                    break;
+                }
+                case OpCode::CompoundStore: {
+                    const Variable& variable = chunk.variables[ins.a];
+                    const auto op = static_cast<AssignOp>(ins.b);
+                    if (Value* value = variable_value(names_base, ins.a, variable, true)) {
+                        double* current = std::get_if<double>(&value->storage());
+                        const double* rhs = std::get_if<double>(&stack_.back().storage());
+                        double result;
+                        if (current && rhs && compound_arithmetic(op, *current, *rhs, result)) {
+                            *current = result;
+                            stack_.pop_back();
+                        } else {
+                            Value operand = pop();
+                            *value = compound(op, *value, operand);
+                        }
+                        if (code[pc].op == OpCode::Pop) {
+                            ++pc;
+                        } else {
+                            stack_.push_back(*value);
+                        }
+                        break;
+                    }
+                    Value rhs = pop();
+                    Value current = in.lookup_identifier(variable.slot, variable.name);
+                    Value updated = compound(op, current, rhs);
+                    in.env_->assign(variable.slot, variable.name, updated);
+                    stack_.push_back(std::move(updated));
+                    break;
+                }
+                case OpCode::Negate: {
+                    Value& top = stack_.back();
+                    if (std::holds_alternative<double>(top.storage())) {
+                        top = Value(-std::get<double>(top.storage()));
+                    } else {
+                        top = in.apply_unary(UnaryOp::Negate, top);
+                    }
+                    break;
+                }
+                case OpCode::Not:
+                case OpCode::ToBool: {
+                    Value& top = stack_.back();
+                    bool truthy = top.is_truthy();
+                    top = Value(ins.op == OpCode::Not ? !truthy : truthy);
+                    break;
+                }
+                case OpCode::Add:
+                case OpCode::Subtract:
+                case OpCode::Multiply:
+                case OpCode::Divide:
+                case OpCode::Modulo:
+                case OpCode::Concat:
+                case OpCode::Equal:
+                case OpCode::NotEqual:
+                case OpCode::Less:
+                case OpCode::LessEqual:
+                case OpCode::Greater:
+                case OpCode::GreaterEqual: {
+                    Value& left = stack_[stack_.size() - 2];
+                    double* lhs = std::get_if<double>(&left.storage());
+                    const double* rhs = std::get_if<double>(&stack_.back().storage());
+                    if (lhs && rhs) {
+                        if (is_comparison(ins.op)) {
+                            bool result = compare_numbers(ins.op, *lhs, *rhs);
+                            stack_.pop_back();
+                            // A comparison feeding a branch jumps without
+                            // pushing its result.
+                            const Instruction& next = code[pc];
+                            if (next.op == OpCode::JumpIfFalse || next.op == OpCode::JumpIfTrue) {
+                                stack_.pop_back();
+                                pc = result == (next.op == OpCode::JumpIfTrue) ? next.a : pc + 1;
+                            } else {
+                                stack_.back() = Value(result);
+                            }
+                            break;
+                        }
+                        double result;
+                        if (arithmetic(ins.op, *lhs, *rhs, result)) {
+                            *lhs = result;
+                            stack_.pop_back();
+                            break;
+                        }
+                    }
+                    Value right = pop();
+                    stack_.back() = in.apply_binary(static_cast<BinaryOp>(ins.a), stack_.back(), right);
+                    break;
+                }
+                case OpCode::Jump:
+                    pc = ins.a;
+                    break;
+                case OpCode::JumpIfFalse: {
+                    bool condition = truthy(stack_.back());
+                    stack_.pop_back();
+                    if (!condition) {
+                        pc = ins.a;
+                    }
+                    break;
+                }
+                case OpCode::JumpIfTrue: {
+                    bool condition = truthy(stack_.back());
+                    stack_.pop_back();
+                    if (condition) {
+                        pc = ins.a;
+                    }
+                    break;
+                }
+                case OpCode::Index: {
+                    Value idx = pop();
+                    Value& collection = stack_.back();
+                    collection = in.index_value(collection, idx);
+                    break;
+                }
+                case OpCode::MakeArray: {
+                    auto first = stack_.end() - static_cast<std::ptrdiff_t>(ins.a);
+                    Value::Array values(std::make_move_iterator(first), std::make_move_iterator(stack_.end()));
+                    stack_.erase(first, stack_.end());
+                    stack_.emplace_back(std::move(values));
+                    break;
+                }
+                case OpCode::MakeObject: {
+                    const auto& keys = chunk.object_keys[ins.a];
+                    std::size_t first = stack_.size() - keys.size();
+                    Value::Object map;
+                    for (std::size_t i = 0; i < keys.size(); ++i) {
+                        map[keys[i]] = std::move(stack_[first + i]);
+                    }
+                    stack_.resize(first);
+                    stack_.emplace_back(std::move(map));
+                    break;
+                }
+                case OpCode::Call: {
+                    Value result = call(stack_.size() - ins.a, chunk.locations[ins.b]);
+                    stack_.push_back(std::move(result));
+                    break;
+                }
+                case OpCode::Echo: {
+                    Value value = pop();
+                    in.ensure_response_writable();
+                    in.output_.write(value);
+                    break;
+                }
+                case OpCode::Function: {
+                    const FunctionProto& proto = chunk.functions[ins.a];
+                    FunctionValue fn_value;
+                    fn_value.name = proto.name;
+                    fn_value.params = proto.params;
+                    fn_value.body = proto.body;
+                    fn_value.closure = in.env_;
+                    fn_value.code = proto.code;
+                    fn_value.scope = proto.scope;
+                    in.env_->define(proto.slot, proto.name, Value(std::move(fn_value)));
+                    break;
+                }
+                case OpCode::Include:
+                    if (!in.include_callback_) {
+                        in.runtime_error("include not supported here");
+                    }
+                    in.include_callback_(chunk.names[ins.a], chunk.locations[ins.b]);
+                    break;
+                case OpCode::CheckReturn:
+                    if (in.call_depth_ == 0) {
+                        in.runtime_error("return outside of function");
+                    }
+                    break;
+                case OpCode::Return: {
+                    Value value = pop();
+                    if (!chunk.function_body) {
+                        throw ReturnSignal(std::move(value));
+                    }
+                    return value;
+                }
+                case OpCode::ForPrepare: {
+                    Value iterable = pop();
+                    if (std::holds_alternative<Value::ArrayPtr>(iterable.storage())) {
+                        if (!std::get<Value::ArrayPtr>(iterable.storage())) {
+                            pc = ins.a;
+                            break;
+                        }
+                        loops.push_back(LoopState{std::move(iterable), 0, {}, nullptr});
+                        break;
+                    }
+                    if (std::holds_alternative<Value::ObjectPtr>(iterable.storage())) {
+                        const auto& object = std::get<Value::ObjectPtr>(iterable.storage());
+                        if (!object) {
+                            pc = ins.a;
+                            break;
+                        }
+                        std::vector<std::string> keys;
+                        keys.reserve(object->size());
+                        for (const auto& entry : *object) {
+                            keys.push_back(entry.first);
+                        }
+                        loops.push_back(LoopState{std::move(iterable), 0, std::move(keys), nullptr});
+                        break;
+                    }
+                    if (std::holds_alternative<Value::IteratorPtr>(iterable.storage())) {
+                        if (!std::get<Value::IteratorPtr>(iterable.storage())) {
+                            pc = ins.a;
+                            break;
+                        }
+                        loops.push_back(LoopState{std::move(iterable), 0, {}, nullptr});
+                        break;
+                    }
+                    in.runtime_error("for loop expects array, object, or cursor");
+                }
+                case OpCode::ForNext: {
+                    LoopState& loop = loops.back();
+                    const ForLoopInfo& info = chunk.loops[ins.b];
+                    Value index;
+                    Value element;
+                    bool found = false;
+                    if (std::holds_alternative<Value::ArrayPtr>(loop.iterable.storage())) {
+                        const auto& array = std::get<Value::ArrayPtr>(loop.iterable.storage());
+                        if (loop.position < array->size()) {
+                            index = Value(static_cast<double>(loop.position));
+                            element = (*array)[loop.position++];
+                            found = true;
+                        }
+                    } else if (std::holds_alternative<Value::IteratorPtr>(loop.iterable.storage())) {
+                        found = std::get<Value::IteratorPtr>(loop.iterable.storage())->next(index, element);
+                    } else {
+                        const auto& object = std::get<Value::ObjectPtr>(loop.iterable.storage());
+                        // Keys the body erased are skipped.
+                        while (!found && loop.position < loop.keys.size()) {
+                            const std::string& key = loop.keys[loop.position++];
+                            auto it = object->find(key);
+                            if (it != object->end()) {
+                                index = Value(key);
+                                element = it->second;
+                                found = true;
+                            }
+                        }
+                    }
+                    if (!found) {
+                        pc = ins.a;
+                        break;
+                    }
+                    if (loop.scope && loop.scope.use_count() == 1) {
+                        loop.scope->clear();
+                    } else {
+                        loop.scope = std::make_shared<Env>(in.env_, info.scope);
+                    }
+                    std::size_t binding = 0;
+                    if (info.index_name) {
+                        loop.scope->bind(binding++, *info.index_name, std::move(index));
+                    }
+                    loop.scope->bind(binding, info.value_name, std::move(element));
+                    in.env_ = loop.scope;
+                    break;
+                }
+                case OpCode::ForExit:
+                    loops.pop_back();
+                    break;
+                case OpCode::PopScope:
+                    in.env_ = in.env_->parent();
+                    break;
+                case OpCode::TryBegin:
+                    handlers.push_back(RecoverHandler{ins.a, ins.b, in.env_, stack_.size(), loops.size()});
+                    break;
+                case OpCode::TryEnd:
+                    handlers.pop_back();
+                    break;
+                case OpCode::Fail:
+                    in.runtime_error(chunk.names[ins.a]);
+                case OpCode::Halt:
+                    return Value();
+                }
+            }
+        } catch (const PolonioError& error) {
+            if (handlers.empty() || error.recoverability() != Recoverability::Operational ||
+                in.response_finalized_) {
+                throw;
+            }
+            RecoverHandler handler = std::move(handlers.back());
+            handlers.pop_back();
+            stack_.resize(handler.stack_size);
+            loops.resize(handler.loop_depth);
+            const RecoverInfo& info = chunk.recovers[handler.recover];
+            auto recover_env = std::make_shared<Env>(handler.env, info.scope);
+            if (info.binding) {
+                recover_env->bind(0, *info.binding, in.error_value(error));
+            }
+            in.env_ = std::move(recover_env);
+            pc = handler.recover_pc;
+        }
+    }
+}
+
+Value Vm::call(std::size_t first, const Location& location) {
+    Interpreter& in = interpreter_;
+    Value callee = std::move(stack_[first - 1]);
+    if (std::holds_alternative<BuiltinFunction>(callee.storage())) {
+        std::vector<Value> args;
+        if (!spare_args_.empty()) {
+            args = std::move(spare_args_.back());
+            spare_args_.pop_back();
+        }
+        args.assign(std::make_move_iterator(stack_.begin() + static_cast<std::ptrdiff_t>(first)),
+                    std::make_move_iterator(stack_.end()));
+        stack_.resize(first - 1);
+        Value result = in.call_builtin(std::get<BuiltinFunction>(callee.storage()), args, location);
+        args.clear();
+        spare_args_.push_back(std::move(args));
+        return result;
+    }
+    if (!std::holds_alternative<FunctionValue>(callee.storage())) {
+        in.runtime_error("attempt to call non-function value");
+    }
+    const auto& function = std::get<FunctionValue>(callee.storage());
+    // Functions declared by the AST walker carry bytecode only when their
+    // declaration was already compiled.
+    std::shared_ptr<const Chunk> compiled;
+    const Chunk* code = function.code.get();
+    if (!code) {
+        compiled = compile_function_bytecode(function.body);
+        code = compiled.get();
+    }
+
+    // The arguments move from the operand stack straight into their slots,
+    // as make_call_env would bind them: missing ones are null, extras dropped.
+    auto closure_env = function.closure ? function.closure : std::make_shared<Env>();
+    std::shared_ptr<Env> call_env;
+    if (spare_envs_.empty()) {
+        call_env = std::make_shared<Env>(std::move(closure_env), function.scope);
+    } else {
+        call_env = std::move(spare_envs_.back());
+        spare_envs_.pop_back();
+        call_env->reset(std::move(closure_env), function.scope);
+    }
+    const std::size_t count = stack_.size() - first;
+    const std::size_t params = function.params.size();
+    for (std::size_t i = 0; i < params; ++i) {
+        call_env->bind(i, function.params[i], i < count ? std::move(stack_[first + i]) : Value());
+    }
+    stack_.resize(first - 1);
+    if (!function.name.empty()) {
+        std::string name = function.name;
+        call_env->bind(params, name, std::move(callee));
+    }
+
+    // A call scope that no closure kept is emptied and reused by a later call.
+    struct CallGuard {
+        Vm& vm;
+        std::shared_ptr<Env> env;
+        ~CallGuard() {
+            Interpreter& in = vm.interpreter_;
+            std::shared_ptr<Env> call_env = std::exchange(in.env_, std::move(env));
+            in.call_depth_ -= 1;
+            if (call_env.use_count() == 1 && vm.spare_envs_.size() < kSpareEnvs) {
+                call_env->reset(nullptr, nullptr);
+                vm.spare_envs_.push_back(std::move(call_env));
+            }
+        }
+    } guard{*this, std::exchange(in.env_, std::move(call_env))};
+    in.call_depth_ += 1;
+    try {
+        return run(*code);
+    } catch (const ReturnSignal& signal) {
+        // `return` inside a file included by this function.
+        return signal.value();
+    }
+}
+
+Value* Vm::variable_value(std::size_t cache_base, std::uint32_t index, const Variable& variable, bool for_store) {
+    Env* env = interpreter_.env_.get();
+    if (variable.slot.index != SlotRef::kOutside) {
+        return env->resolved_slot(variable.slot);
+    }
+    // Past the resolved scopes, unless an include bound names on the way.
+    for (std::uint32_t hop = 0; hop < variable.slot.depth; ++hop) {
+        if (env->has_names() || !env->parent_scope()) {
+            return nullptr;
+        }
+        env = env->parent_scope();
+    }
+    NameCache& cache = names_[cache_base + index];
+    if (cache.scope != env || cache.version != env->names_version() || !cache.value) {
+        // Only the scope itself and a frozen parent are cached: nothing else
+        // can come to shadow them without bumping the scope's version.
+        cache = NameCache{env, env->names_version(), env->find_local_value(variable.name), true};
+        if (!cache.value) {
+            Env* parent = env->parent_scope();
+            if (!parent || !parent->frozen()) {
+                return nullptr;
+            }
+            cache.value = parent->find_local_value(variable.name);
+            cache.writable = false;
+        }
+    }
+    return for_store && !cache.writable ? nullptr : cache.value;
+}
+
+Value Vm::compound(AssignOp op, const Value& current, const Value& rhs) {
+    double result;
+    if (both_numbers(current, rhs) &&
+        compound_arithmetic(op, std::get<double>(current.storage()), std::get<double>(rhs.storage()), result)) {
+        return Value(result);
+    }
+    return interpreter_.apply_compound(op, current, rhs);
+}
+
+} // namespace polonio
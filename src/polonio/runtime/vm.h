@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "polonio/common/location.h"
+#include "polonio/parser/ast.h"
+#include "polonio/runtime/bytecode.h"
+#include "polonio/runtime/value.h"
+
+namespace polonio {
+
+class Interpreter;
+
+// Executes bytecode against the owning Interpreter's scope, output, and
+// response state. Runtime semantics that are not on a fast path defer to the
+// Interpreter so both engines report identical results and errors.
+class Vm {
+public:
+    explicit Vm(Interpreter& interpreter) : interpreter_(interpreter) {}
+
+    void run_program(const Program& program);
+
+private:
+    // Where a name outside every resolved scope was last found, valid while
+    // `scope` keeps `version`. `writable` is false for a frozen builtin, which
+    // an assignment shadows instead of overwriting.
+    struct NameCache {
+        Env* scope = nullptr;
+        std::uint32_t version = 0;
+        Value* value = nullptr;
+        bool writable = false;
+    };
+
+    Value run(const Chunk& chunk);
+    // Calls the callee at stack_[first - 1] with the arguments above it, and
+    // leaves the stack at first - 1.
+    Value call(std::size_t first, const Location& location);
+    Value* variable_value(std::size_t cache_base, std::uint32_t index, const Variable& variable, bool for_store);
+    Value compound(AssignOp op, const Value& current, const Value& rhs);
+    Value pop();
+
+    Interpreter& interpreter_;
+    std::vector<Value> stack_;
+    // One NameCache per chunk variable for every active frame, innermost last.
+    std::vector<NameCache> names_;
+    // Argument vectors for builtins, kept to avoid an allocation per call.
+    std::vector<std::vector<Value>> spare_args_;
+    // Call scopes no closure kept, at most kSpareEnvs of them.
+    static constexpr std::size_t kSpareEnvs = 64;
+    std::vector<std::shared_ptr<Env>> spare_envs_;
+};
+
+} // namespace polonio
@@ -0,0 +1,158 @@
+#include "polonio/server/compression.h"
+
+#include <zlib.h>
+
+#include <cstdlib>
+#include <stdexcept>
+
+#include "polonio/runtime/http_request_utils.h"
+
+namespace polonio {
+namespace {
+
+// The q-value of one Accept-Encoding element; a missing or unparsable
+// weight counts as 1.
+double element_quality(const std::string& parameters) {
+    std::size_t pos = 0;
+    while (pos < parameters.size()) {
+        std::size_t semicolon = parameters.find(';', pos);
+        std::string parameter = http::trim_whitespace(
+            parameters.substr(pos, semicolon == std::string::npos ? std::string::npos : semicolon - pos));
+        if (parameter.size() > 2 && (parameter[0] == 'q' || parameter[0] == 'Q') && parameter[1] == '=') {
+            char* end = nullptr;
+            double quality = std::strtod(parameter.c_str() + 2, &end);
+            return end == parameter.c_str() + 2 ? 1.0 : quality;
+        }
+        if (semicolon == std::string::npos) {
+            break;
+        }
+        pos = semicolon + 1;
+    }
+    return 1.0;
+}
+
+} // namespace
+
+ContentCoding negotiate_content_coding(const std::string& accept_encoding) {
+    double gzip = -1.0;
+    double deflate = -1.0;
+    double any = -1.0;
+    std::size_t pos = 0;
+    while (pos < accept_encoding.size()) {
+        std::size_t comma = accept_encoding.find(',', pos);
+        std::string element =
+            accept_encoding.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        std::size_t semicolon = element.find(';');
+        std::string coding = http::to_lower_copy(http::trim_whitespace(element.substr(0, semicolon)));
+        double quality = semicolon == std::string::npos ? 1.0 : element_quality(element.substr(semicolon + 1));
+        if (coding == "gzip" || coding == "x-gzip") {
+            gzip = quality;
+        } else if (coding == "deflate") {
+            deflate = quality;
+        } else if (coding == "*") {
+            any = quality;
+        }
+        if (comma == std::string::npos) {
+            break;
+        }
+        pos = comma + 1;
+    }
+    if (gzip < 0) gzip = any;
+    if (deflate < 0) deflate = any;
+    if (gzip > 0 && gzip >= deflate) return ContentCoding::Gzip;
+    if (deflate > 0) return ContentCoding::Deflate;
+    return ContentCoding::Identity;
+}
+
+const char* content_coding_name(ContentCoding coding) {
+    switch (coding) {
+    case ContentCoding::Gzip: return "gzip";
+    case ContentCoding::Deflate: return "deflate";
+    case ContentCoding::Identity: break;
+    }
+    return "";
+}
+
+bool is_compressible_type(const std::string& content_type) {
+    std::string type = http::to_lower_copy(http::trim_whitespace(content_type.substr(0, content_type.find(';'))));
+    if (type.compare(0, 5, "text/") == 0) {
+        return true;
+    }
+    return type == "application/javascript" || type == "application/json" || type == "application/xml" ||
+           type == "image/svg+xml" || (type.size() > 5 && type.compare(type.size() - 5, 5, "+json") == 0) ||
+           (type.size() > 4 && type.compare(type.size() - 4, 4, "+xml") == 0);
+}
+
+std::string compress_body(const char* data, std::size_t size, ContentCoding coding) {
+    if (coding == ContentCoding::Identity) {
+        return std::string(data, size);
+    }
+    z_stream stream{};
+    // 16 added to the window bits selects the gzip wrapper.
+    const int window_bits = coding == ContentCoding::Gzip ? 15 + 16 : 15;
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("compression failed");
+    }
+    std::string output;
+    output.resize(deflateBound(&stream, static_cast<uLong>(size)));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    stream.avail_out = static_cast<uInt>(output.size());
+    int status = deflate(&stream, Z_FINISH);
+    std::size_t produced = stream.total_out;
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        throw std::runtime_error("compression failed");
+    }
+    output.resize(produced);
+    return output;
+}
+
+std::shared_ptr<const std::string> CompressedCache::get(const std::string& path,
+                                                        const OpenFile& file,
+                                                        ContentCoding coding) {
+    const std::string key = std::string(content_coding_name(coding)) + ':' + path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            if (it->second->etag == file.etag()) {
+                entries_.splice(entries_.begin(), entries_, it->second);
+                return it->second->bytes;
+            }
+            total_bytes_ -= it->second->bytes->size();
+            entries_.erase(it->second);
+            index_.erase(it);
+        }
+    }
+
+    // Compress outside the lock; two workers racing on the same file both do
+    // the work and the later one replaces the earlier entry. The bytes come
+    // through pread, so a file truncated meanwhile reads short instead of
+    // faulting; that partial copy is served once but not cached.
+    std::string contents = file.read(0, file.size());
+    auto bytes = std::make_shared<const std::string>(compress_body(contents.data(), contents.size(), coding));
+    if (bytes->size() > budget_bytes_ || contents.size() != file.size()) {
+        return bytes;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        total_bytes_ -= it->second->bytes->size();
+        entries_.erase(it->second);
+        index_.erase(it);
+    }
+    entries_.push_front(Entry{key, file.etag(), bytes});
+    index_[key] = entries_.begin();
+    total_bytes_ += bytes->size();
+    while (total_bytes_ > budget_bytes_ && !entries_.empty()) {
+        total_bytes_ -= entries_.back().bytes->size();
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+    }
+    return bytes;
+}
+
+} // namespace polonio
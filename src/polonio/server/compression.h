@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "polonio/server/file_cache.h"
+
+namespace polonio {
+
+enum class ContentCoding { Identity, Gzip, Deflate };
+
+// Bodies smaller than this gain too little from compression to be worth it.
+constexpr std::size_t kMinCompressBytes = 1024;
+
+// The coding to apply given a request's Accept-Encoding: gzip when acceptable,
+// then deflate, otherwise identity. Codings listed with q=0 are refused.
+ContentCoding negotiate_content_coding(const std::string& accept_encoding);
+// The Content-Encoding token for `coding`; empty for identity.
+const char* content_coding_name(ContentCoding coding);
+// Text-like media types (HTML, CSS, JavaScript, JSON, XML, SVG).
+bool is_compressible_type(const std::string& content_type);
+// Compresses with zlib at its default level. Deflate output keeps the zlib
+// wrapper, as the HTTP `deflate` coding requires.
+std::string compress_body(const char* data, std::size_t size, ContentCoding coding);
+
+// Compressed copies of static files, so a file is compressed once per
+// version rather than once per request. Entries are keyed by path and coding,
+// dropped when the file's ETag changes, and evicted least recently used once
+// their total size exceeds the budget. Safe to share between threads.
+class CompressedCache {
+public:
+    explicit CompressedCache(std::size_t budget_bytes = 32 * 1024 * 1024) : budget_bytes_(budget_bytes) {}
+
+    std::shared_ptr<const std::string> get(const std::string& path, const OpenFile& file, ContentCoding coding);
+
+private:
+    struct Entry {
+        std::string key;
+        std::string etag;
+        std::shared_ptr<const std::string> bytes;
+    };
+
+    std::mutex mutex_;
+    // Most recently used first.
+    std::list<Entry> entries_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    std::size_t budget_bytes_;
+    std::size_t total_bytes_ = 0;
+};
+
+} // namespace polonio
@@ -0,0 +1,160 @@
+#include "polonio/server/file_cache.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#elif defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/uio.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <utility>
+
+namespace polonio {
+namespace {
+
+std::int64_t modified_ns(const struct stat& info) {
+#if defined(__APPLE__)
+    const timespec& stamp = info.st_mtimespec;
+#else
+    const timespec& stamp = info.st_mtim;
+#endif
+    return static_cast<std::int64_t>(stamp.tv_sec) * 1000000000 + stamp.tv_nsec;
+}
+
+std::string make_etag(const struct stat& info) {
+    char buffer[80];
+    std::snprintf(buffer, sizeof(buffer), "\"%llx-%llx-%llx\"", static_cast<unsigned long long>(info.st_ino),
+                  static_cast<unsigned long long>(info.st_size),
+                  static_cast<unsigned long long>(modified_ns(info)));
+    return buffer;
+}
+
+} // namespace
+
+OpenFile::~OpenFile() {
+    ::close(fd_);
+}
+
+std::string OpenFile::read(std::uint64_t offset, std::uint64_t length) const {
+    std::string contents;
+    if (offset >= size_) {
+        return contents;
+    }
+    length = std::min(length, size_ - offset);
+    contents.resize(static_cast<std::size_t>(length));
+    std::size_t done = 0;
+    while (done < contents.size()) {
+        ssize_t n = ::pread(fd_, &contents[done], contents.size() - done, static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += static_cast<std::size_t>(n);
+    }
+    contents.resize(done);
+    return contents;
+}
+
+ssize_t send_file_range(int socket_fd, const OpenFile& file, std::uint64_t offset, std::size_t count) {
+#if defined(__linux__)
+    off_t position = static_cast<off_t>(offset);
+    ssize_t sent = ::sendfile(socket_fd, file.fd(), &position, count);
+    if (sent >= 0 || (errno != EINVAL && errno != ENOSYS)) {
+        return sent;
+    }
+    // Some filesystems cannot feed sendfile; copy through a buffer instead.
+#elif defined(__APPLE__)
+    off_t length = static_cast<off_t>(count);
+    int result = ::sendfile(file.fd(), socket_fd, static_cast<off_t>(offset), &length, nullptr, 0);
+    // A partial send reports -1 with EAGAIN or EINTR but still sets `length`.
+    if (result == 0 || length > 0) {
+        return static_cast<ssize_t>(length);
+    }
+    if (errno != ENOTSUP && errno != EOPNOTSUPP && errno != ENOTSOCK) {
+        return -1;
+    }
+#endif
+    // Never the mapping: a file truncated while it is served reads short
+    // through pread, where touching the mapping past the new end would raise
+    // SIGBUS. Zero bytes read means the file shrank.
+    char buffer[64 * 1024];
+    std::size_t wanted = std::min(count, sizeof(buffer));
+    ssize_t n;
+    do {
+        n = ::pread(file.fd(), buffer, wanted, static_cast<off_t>(offset));
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return -1;
+    }
+    return n == 0 ? 0 : ::send(socket_fd, buffer, static_cast<std::size_t>(n), 0);
+}
+
+std::shared_ptr<const OpenFile> FileCache::open(const std::filesystem::path& path) {
+    const std::string key = path.string();
+    const auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end() && now - it->second.checked < revalidate_after_) {
+            it->second.used = now;
+            return it->second.file;
+        }
+    }
+
+    struct stat info {};
+    if (::stat(key.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.erase(key);
+        return nullptr;
+    }
+    Identity identity{info.st_dev, info.st_ino, static_cast<std::uint64_t>(info.st_size), modified_ns(info)};
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end() && it->second.identity == identity) {
+            it->second.checked = now;
+            it->second.used = now;
+            return it->second.file;
+        }
+    }
+
+    int fd = ::open(key.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    // Describe what was actually opened, in case the path changed since stat.
+    if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        ::close(fd);
+        return nullptr;
+    }
+    identity = Identity{info.st_dev, info.st_ino, static_cast<std::uint64_t>(info.st_size), modified_ns(info)};
+    auto file = std::make_shared<const OpenFile>(fd, identity.size, identity.modified_ns, make_etag(info));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end() && entries_.size() >= capacity_) {
+        evict_least_recently_used();
+    }
+    entries_[key] = Entry{file, identity, now, now};
+    return file;
+}
+
+void FileCache::evict_least_recently_used() {
+    auto oldest = entries_.begin();
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->second.used < oldest->second.used) {
+            oldest = it;
+        }
+    }
+    if (oldest != entries_.end()) {
+        entries_.erase(oldest);
+    }
+}
+
+} // namespace polonio
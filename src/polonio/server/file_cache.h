@@ -0,0 +1,94 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace polonio {
+
+// An open, read-only file shared by every response that serves it. The
+// descriptor closes when the last response and the cache let go.
+class OpenFile {
+public:
+    OpenFile(int fd, std::uint64_t size, std::int64_t modified_ns, std::string etag)
+        : fd_(fd), size_(size), modified_ns_(modified_ns), etag_(std::move(etag)) {}
+    ~OpenFile();
+    OpenFile(const OpenFile&) = delete;
+    OpenFile& operator=(const OpenFile&) = delete;
+
+    int fd() const { return fd_; }
+    std::uint64_t size() const { return size_; }
+    // Modification time in whole seconds since the epoch, for Last-Modified.
+    std::int64_t modified() const {
+        std::int64_t seconds = modified_ns_ / 1000000000;
+        return modified_ns_ % 1000000000 < 0 ? seconds - 1 : seconds;
+    }
+    // Modification time in nanoseconds, for ordering files against each other.
+    std::int64_t modified_ns() const { return modified_ns_; }
+    // Strong validator derived from inode, size, and modification time.
+    const std::string& etag() const { return etag_; }
+    // Reads through pread; returns fewer bytes if the file has shrunk.
+    std::string read(std::uint64_t offset, std::uint64_t length) const;
+
+private:
+    int fd_;
+    std::uint64_t size_;
+    std::int64_t modified_ns_;
+    std::string etag_;
+};
+
+// Copies up to `count` bytes of `file` starting at `offset` to a socket
+// without staging them in a user-space buffer where the platform has
+// sendfile(2), and through a pread buffer otherwise. Returns what send(2)
+// would; 0 when the file has shrunk below `offset`.
+ssize_t send_file_range(int socket_fd, const OpenFile& file, std::uint64_t offset, std::size_t count);
+
+// Open descriptors for recently served files, keyed by path. A cached entry
+// is trusted for a short interval, then checked with stat(2) and reopened if
+// the file was replaced or modified. Safe to share between threads.
+class FileCache {
+public:
+    explicit FileCache(std::size_t capacity = 128,
+                       std::chrono::milliseconds revalidate_after = std::chrono::milliseconds(250))
+        : capacity_(capacity), revalidate_after_(revalidate_after) {}
+
+    // Returns nullptr when the path cannot be opened as a regular file.
+    std::shared_ptr<const OpenFile> open(const std::filesystem::path& path);
+
+private:
+    struct Identity {
+        dev_t device = 0;
+        ino_t inode = 0;
+        std::uint64_t size = 0;
+        std::int64_t modified_ns = 0;
+
+        bool operator==(const Identity& other) const {
+            return device == other.device && inode == other.inode && size == other.size &&
+                   modified_ns == other.modified_ns;
+        }
+    };
+
+    struct Entry {
+        std::shared_ptr<const OpenFile> file;
+        Identity identity;
+        std::chrono::steady_clock::time_point checked;
+        std::chrono::steady_clock::time_point used;
+    };
+
+    void evict_least_recently_used();
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    std::size_t capacity_;
+    std::chrono::milliseconds revalidate_after_;
+};
+
+} // namespace polonio
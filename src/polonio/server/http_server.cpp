@@ -1,23 +1,32 @@
 #include "polonio/server/http_server.h"
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 #include <algorithm>
 #include <cctype>
 #include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <filesystem>
-#include <fstream>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -27,14 +36,38 @@
 #include "polonio/runtime/env.h"
 #include "polonio/runtime/http_request_utils.h"
 #include "polonio/runtime/interpreter.h"
+#include "polonio/runtime/interpreter_pool.h"
+#include "polonio/runtime/request_body.h"
 #include "polonio/runtime/session.h"
 #include "polonio/runtime/template_renderer.h"
+#include "polonio/server/compression.h"
+#include "polonio/server/file_cache.h"
+#include "polonio/server/poller.h"
 
 namespace polonio {
 namespace {
 
 constexpr std::size_t kMaxHeaderBytes = 64 * 1024;
-constexpr std::size_t kMaxBodyBytes = 8 * 1024 * 1024;
+// Multipart bodies spool to disk and stream into storage, so this bounds disk
+// use rather than memory. Other bodies are read whole by their consumers and
+// stop at RequestBody::kMaxBufferedBytes.
+constexpr std::uint64_t kMaxUploadBodyBytes = 256ull * 1024 * 1024;
+// Longest chunk-size line, extensions included, in a chunked request body.
+constexpr std::size_t kMaxChunkLineBytes = 1024;
+// A connection that makes no progress reading its request or taking its
+// response for this long is closed.
+constexpr int kClientTimeoutSeconds = 30;
+// Persistent connections close after this long without a new request, or
+// after serving this many requests.
+constexpr int kKeepAliveIdleSeconds = 5;
+constexpr int kMaxRequestsPerConnection = 100;
+// Largest file range handed to one send_file_range call.
+constexpr std::size_t kFileChunkBytes = 1024 * 1024;
+// A streamed response sends a chunk once this much output is waiting, or
+// whenever the script calls http_flush().
+constexpr std::size_t kStreamChunkBytes = 16 * 1024;
+// Larger static files are sent uncompressed rather than compressed in memory.
+constexpr std::uint64_t kMaxCompressFileBytes = 8 * 1024 * 1024;
 
 [[noreturn]] void throw_system_error(const char* operation) {
     throw std::runtime_error(std::string(operation) + ": " + std::strerror(errno));
@@ -65,7 +98,7 @@ struct HttpRequest {
     std::string version;
     std::vector<std::pair<std::string, std::string>> headers;
     std::unordered_map<std::string, std::string> header_lookup;
-    std::string body;
+    RequestBody body;
 
     std::string header(const std::string& name) const {
         auto it = header_lookup.find(to_lower_ascii(name));
@@ -86,28 +119,20 @@ struct ResolvedResource {
     enum class Kind { Template, Static };
     Kind kind = Kind::Static;
     std::filesystem::path path;
+    // The request path under the root that led to `path`.
+    std::filesystem::path relative;
 };
 
 struct ServerState {
     std::filesystem::path root;
     std::string root_string;
     int port = 0;
+    std::shared_ptr<InterpreterPool> interpreters = std::make_shared<InterpreterPool>();
+    std::shared_ptr<FileCache> files = std::make_shared<FileCache>();
+    bool compress = true;
+    std::shared_ptr<CompressedCache> compressed = std::make_shared<CompressedCache>();
 };
 
-bool send_all(int fd, const std::string& data) {
-    std::size_t offset = 0;
-    while (offset < data.size()) {
-        ssize_t sent = ::send(fd, data.data() + offset, data.size() - offset, 0);
-        if (sent < 0) {
-            if (errno == EINTR) continue;
-            return false;
-        }
-        if (sent == 0) break;
-        offset += static_cast<std::size_t>(sent);
-    }
-    return offset == data.size();
-}
-
 HttpRequest parse_http_request_string(const std::string& raw) {
     HttpRequest request;
     auto header_end = raw.find("\r\n\r\n");
@@ -148,123 +173,385 @@ HttpRequest parse_http_request_string(const std::string& raw) {
         if (line_end == std::string::npos) break;
         pos = line_end + 2;
     }
-    request.body = raw.substr(header_end + 4);
+    request.body = RequestBody(raw.substr(header_end + 4));
     return request;
 }
 
-bool read_http_request(int client_fd, HttpRequest& request) {
-    std::string buffer;
-    buffer.reserve(4096);
-    char chunk[4096];
-    std::size_t header_end = std::string::npos;
-    while (true) {
-        ssize_t n = ::recv(client_fd, chunk, sizeof(chunk), 0);
-        if (n < 0) {
-            if (errno == EINTR) continue;
-            throw_system_error("recv");
+// Reads requests off a connection's input as it arrives. Body bytes move out
+// of the input buffer into the request's RequestBody as soon as they are
+// framed, so a large or chunked upload never sits in the buffer whole.
+class RequestReader {
+public:
+    // Consumes what it can of `input`. Returns true once `request` holds a
+    // complete request, leaving any bytes after it in `input`; returns false
+    // while more input is needed. Throws for requests the server will not
+    // accept.
+    bool advance(std::string& input, HttpRequest& request) {
+        while (true) {
+            switch (state_) {
+            case State::Head:
+                if (!read_head(input)) return false;
+                break;
+            case State::Body: {
+                std::size_t take = static_cast<std::size_t>(std::min<std::uint64_t>(remaining_, input.size()));
+                take_body(input, take);
+                remaining_ -= take;
+                if (remaining_ > 0) return false;
+                return finish(request);
+            }
+            case State::ChunkSize: {
+                std::string line;
+                if (!take_line(input, line)) return false;
+                remaining_ = parse_chunk_size(line);
+                if (remaining_ == 0) {
+                    state_ = State::Trailers;
+                } else {
+                    if (remaining_ > body_limit_ - request_.body.size()) {
+                        throw std::runtime_error("request body too large");
+                    }
+                    state_ = State::ChunkData;
+                }
+                break;
+            }
+            case State::ChunkData: {
+                std::size_t take = static_cast<std::size_t>(std::min<std::uint64_t>(remaining_, input.size()));
+                take_body(input, take);
+                remaining_ -= take;
+                if (remaining_ > 0) return false;
+                state_ = State::ChunkDataEnd;
+                break;
+            }
+            case State::ChunkDataEnd:
+                if (input.size() < 2) return false;
+                if (input.compare(0, 2, "\r\n") != 0) {
+                    throw std::runtime_error("malformed chunked body");
+                }
+                input.erase(0, 2);
+                state_ = State::ChunkSize;
+                break;
+            case State::Trailers: {
+                // Trailer fields are read and discarded; the blank line ends
+                // the body.
+                std::string line;
+                if (!take_line(input, line)) return false;
+                if (line.empty()) return finish(request);
+                trailer_bytes_ += line.size() + 2;
+                if (trailer_bytes_ > kMaxHeaderBytes) {
+                    throw std::runtime_error("request trailers too large");
+                }
+                break;
+            }
+            }
         }
-        if (n == 0) {
-            if (buffer.empty()) {
-                return false;
+    }
+
+private:
+    enum class State { Head, Body, ChunkSize, ChunkData, ChunkDataEnd, Trailers };
+
+    bool read_head(std::string& input) {
+        std::size_t header_end = input.find("\r\n\r\n");
+        if (header_end == std::string::npos) {
+            if (input.size() > kMaxHeaderBytes) {
+                throw std::runtime_error("request headers too large");
             }
-            throw std::runtime_error("unexpected EOF");
+            return false;
         }
-        buffer.append(chunk, static_cast<std::size_t>(n));
-        if (buffer.size() > kMaxHeaderBytes) {
+        if (header_end + 4 > kMaxHeaderBytes) {
             throw std::runtime_error("request headers too large");
         }
-        header_end = buffer.find("\r\n\r\n");
-        if (header_end != std::string::npos) {
-            break;
-        }
-    }
+        request_ = parse_http_request_string(input.substr(0, header_end + 4));
+        input.erase(0, header_end + 4);
+        trailer_bytes_ = 0;
+        body_limit_ = to_lower_ascii(request_.header("content-type")).rfind("multipart/form-data", 0) == 0
+                          ? kMaxUploadBodyBytes
+                          : RequestBody::kMaxBufferedBytes;
 
-    auto length_header_pos = buffer.find("Content-Length:");
-    std::size_t content_length = 0;
-    std::string content_length_value;
-    if (length_header_pos != std::string::npos) {
-        auto line_end = buffer.find("\r\n", length_header_pos);
-        content_length_value =
-            buffer.substr(length_header_pos + std::strlen("Content-Length:"), line_end - (length_header_pos + std::strlen("Content-Length:")));
-        content_length_value = http::trim_whitespace(content_length_value);
-    }
-    if (!content_length_value.empty()) {
-        try {
-            long long parsed = std::stoll(content_length_value);
-            if (parsed < 0) throw std::runtime_error("negative content length");
-            content_length = static_cast<std::size_t>(parsed);
-        } catch (const std::exception&) {
-            throw std::runtime_error("invalid content-length");
+        std::string content_length_value = request_.header("content-length");
+        if (request_.header_lookup.count("transfer-encoding") != 0) {
+            // Only a lone chunked coding is understood, and it may not be
+            // combined with a length (RFC 9112 section 6.3).
+            if (!iequals(request_.header("transfer-encoding"), "chunked") || !content_length_value.empty()) {
+                throw std::runtime_error("transfer-encoding not supported");
+            }
+            state_ = State::ChunkSize;
+            return true;
         }
-        if (content_length > kMaxBodyBytes) {
-            throw std::runtime_error("request body too large");
+        remaining_ = 0;
+        if (!content_length_value.empty()) {
+            try {
+                long long parsed = std::stoll(content_length_value);
+                if (parsed < 0) throw std::runtime_error("negative content length");
+                remaining_ = static_cast<std::uint64_t>(parsed);
+            } catch (const std::exception&) {
+                throw std::runtime_error("invalid content-length");
+            }
+            if (remaining_ > body_limit_) {
+                throw std::runtime_error("request body too large");
+            }
         }
+        state_ = State::Body;
+        return true;
     }
 
-    auto transfer_encoding = buffer.find("Transfer-Encoding:");
-    if (transfer_encoding != std::string::npos) {
-        throw std::runtime_error("transfer-encoding not supported");
+    void take_body(std::string& input, std::size_t count) {
+        request_.body.append(input.data(), count);
+        input.erase(0, count);
     }
 
-    std::size_t total_needed = header_end + 4 + content_length;
-    while (buffer.size() < total_needed) {
-        ssize_t n = ::recv(client_fd, chunk, sizeof(chunk), 0);
-        if (n < 0) {
-            if (errno == EINTR) continue;
-            throw_system_error("recv");
+    static bool take_line(std::string& input, std::string& line) {
+        std::size_t end = input.find("\r\n");
+        if (end == std::string::npos) {
+            if (input.size() > kMaxChunkLineBytes) {
+                throw std::runtime_error("malformed chunked body");
+            }
+            return false;
         }
-        if (n == 0) {
-            throw std::runtime_error("unexpected EOF");
+        if (end > kMaxChunkLineBytes) {
+            throw std::runtime_error("malformed chunked body");
         }
-        buffer.append(chunk, static_cast<std::size_t>(n));
-        if (buffer.size() - header_end - 4 > kMaxBodyBytes) {
-            throw std::runtime_error("request body too large");
+        line = input.substr(0, end);
+        input.erase(0, end + 2);
+        return true;
+    }
+
+    // The size in a chunk-size line, ignoring any chunk extensions.
+    static std::uint64_t parse_chunk_size(const std::string& line) {
+        std::size_t digits = 0;
+        std::uint64_t size = 0;
+        while (digits < line.size() && std::isxdigit(static_cast<unsigned char>(line[digits]))) {
+            if (digits == 16) {
+                throw std::runtime_error("malformed chunked body");
+            }
+            char ch = line[digits];
+            unsigned value = std::isdigit(static_cast<unsigned char>(ch))
+                                 ? static_cast<unsigned>(ch - '0')
+                                 : static_cast<unsigned>(std::tolower(static_cast<unsigned char>(ch)) - 'a' + 10);
+            size = size * 16 + value;
+            ++digits;
         }
+        std::size_t rest = digits;
+        while (rest < line.size() && (line[rest] == ' ' || line[rest] == '\t')) ++rest;
+        if (digits == 0 || (rest < line.size() && line[rest] != ';')) {
+            throw std::runtime_error("malformed chunked body");
+        }
+        return size;
     }
-    std::string complete = buffer.substr(0, header_end + 4 + content_length);
-    request = parse_http_request_string(complete);
-    return true;
-}
+
+    bool finish(HttpRequest& request) {
+        request = std::move(request_);
+        request_ = HttpRequest();
+        state_ = State::Head;
+        return true;
+    }
+
+    State state_ = State::Head;
+    HttpRequest request_;
+    std::uint64_t remaining_ = 0;
+    // Largest body the current request may carry.
+    std::uint64_t body_limit_ = RequestBody::kMaxBufferedBytes;
+    std::size_t trailer_bytes_ = 0;
+};
 
 std::string reason_phrase(int status) {
     switch (status) {
     case 200: return "OK";
+    case 206: return "Partial Content";
     case 302: return "Found";
+    case 304: return "Not Modified";
     case 400: return "Bad Request";
     case 401: return "Unauthorized";
     case 403: return "Forbidden";
     case 404: return "Not Found";
     case 405: return "Method Not Allowed";
+    case 416: return "Range Not Satisfiable";
     case 500: return "Internal Server Error";
     default: return "OK";
     }
 }
 
-std::string build_http_response(int status,
-                                const std::vector<std::pair<std::string, std::string>>& headers,
-                                const std::string& body) {
-    bool has_connection = false;
-    std::ostringstream stream;
-    stream << "HTTP/1.1 " << status << ' ' << reason_phrase(status) << "\r\n";
+// A response before it is put on the wire; the connection layer picks the
+// Connection header when it serializes. A response with a `file` sends that
+// range of the file as its body instead of `body`.
+struct HttpResponse {
+    int status = 200;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    std::shared_ptr<const OpenFile> file;
+    std::uint64_t file_offset = 0;
+    std::uint64_t file_length = 0;
+};
+
+// Serialized bytes, followed on the wire by the file range when there is one.
+struct WireResponse {
+    std::string bytes;
+    std::shared_ptr<const OpenFile> file;
+    std::uint64_t file_offset = 0;
+    std::uint64_t file_length = 0;
+
+    std::uint64_t size() const { return bytes.size() + file_length; }
+};
+
+HttpResponse build_http_response(int status,
+                                 const std::vector<std::pair<std::string, std::string>>& headers,
+                                 std::string body) {
+    HttpResponse response;
+    response.status = status;
+    response.body = std::move(body);
+    response.headers.reserve(headers.size());
     for (const auto& header : headers) {
-        if (iequals(header.first, "Connection")) {
-            has_connection = true;
-        }
         if (iequals(header.first, "Content-Length")) {
             continue;
         }
+        response.headers.push_back(header);
+    }
+    return response;
+}
+
+// False when the script asked for `Connection: close`.
+bool response_allows_keep_alive(const HttpResponse& response) {
+    for (const auto& header : response.headers) {
+        if (iequals(header.first, "Connection") && to_lower_ascii(header.second).find("close") != std::string::npos) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The status line and headers, without the blank line that ends them.
+void write_http_head(std::ostringstream& stream, const HttpResponse& response, bool keep_alive) {
+    bool has_connection = false;
+    stream << "HTTP/1.1 " << response.status << ' ' << reason_phrase(response.status) << "\r\n";
+    for (const auto& header : response.headers) {
+        if (iequals(header.first, "Connection")) {
+            has_connection = true;
+        }
         stream << header.first << ": " << header.second << "\r\n";
     }
     if (!has_connection) {
-        stream << "Connection: close\r\n";
+        stream << (keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+    }
+    if (keep_alive) {
+        stream << "Keep-Alive: timeout=" << kKeepAliveIdleSeconds << "\r\n";
+    }
+}
+
+WireResponse serialize_http_response(const HttpResponse& response, bool keep_alive) {
+    std::ostringstream stream;
+    write_http_head(stream, response, keep_alive);
+    // A 304 has no body; whatever the script rendered is dropped.
+    const bool bodyless = response.status == 304;
+    if (!bodyless) {
+        stream << "Content-Length: " << (response.file ? response.file_length : response.body.size()) << "\r\n";
     }
-    stream << "Content-Length: " << body.size() << "\r\n";
     stream << "\r\n";
-    stream << body;
-    return stream.str();
+    WireResponse wire;
+    if (bodyless) {
+        wire.bytes = stream.str();
+    } else if (response.file) {
+        wire.bytes = stream.str();
+        wire.file = response.file;
+        wire.file_offset = response.file_offset;
+        wire.file_length = response.file_length;
+    } else {
+        stream << response.body;
+        wire.bytes = stream.str();
+    }
+    return wire;
 }
 
-std::string plain_response(int status, const std::string& message) {
+// The dev server's side of a template that calls http_flush(). The headers
+// go out with Transfer-Encoding: chunked when the script commits them, and
+// output is framed into chunks as it accumulates. finish() hands back the last
+// chunk and the terminator, which the connection sends like any response.
+class ChunkedStream {
+public:
+    // Delivers bytes to the client; false once it is gone.
+    using Send = std::function<bool(const std::string&)>;
+
+    ChunkedStream(Send send, bool keep_alive)
+        : send_(std::move(send)),
+          keep_alive_(keep_alive),
+          stream_{[this](ResponseContext& ctx) { commit(ctx); },
+                  [this](const std::string& text) { write(text); },
+                  [this] { send_pending(); }} {}
+    ChunkedStream(const ChunkedStream&) = delete;
+    ChunkedStream& operator=(const ChunkedStream&) = delete;
+
+    ResponseStream* response_stream() { return &stream_; }
+    bool committed() const { return committed_; }
+    bool keep_alive() const { return keep_alive_ && !failed_; }
+
+    // Ends a stream whose script failed after committing: the error text
+    // follows the partial page and the connection closes without the
+    // terminating chunk, so the client sees the body as incomplete.
+    void abort(const std::string& message) {
+        write(message);
+        send_pending();
+        failed_ = true;
+    }
+
+    std::string finish() {
+        if (failed_) {
+            return std::string();
+        }
+        std::string tail = frame(pending_);
+        pending_.clear();
+        return tail + "0\r\n\r\n";
+    }
+
+private:
+    void commit(ResponseContext& ctx) {
+        HttpResponse head = build_http_response(ctx.status_code, ctx.headers, std::string());
+        keep_alive_ = keep_alive_ && response_allows_keep_alive(head);
+        std::ostringstream stream;
+        write_http_head(stream, head, keep_alive_);
+        stream << "Transfer-Encoding: chunked\r\n\r\n";
+        committed_ = true;
+        deliver(stream.str());
+    }
+
+    void write(const std::string& text) {
+        pending_ += text;
+        if (pending_.size() >= kStreamChunkBytes) {
+            send_pending();
+        }
+    }
+
+    void send_pending() {
+        if (pending_.empty()) {
+            return;
+        }
+        std::string chunk = frame(pending_);
+        pending_.clear();
+        deliver(chunk);
+    }
+
+    void deliver(const std::string& bytes) {
+        // Once the client is gone the script still runs to completion; its
+        // output is dropped.
+        if (!failed_ && !send_(bytes)) {
+            failed_ = true;
+        }
+    }
+
+    static std::string frame(const std::string& data) {
+        if (data.empty()) {
+            return std::string();
+        }
+        char size[32];
+        std::snprintf(size, sizeof(size), "%zx\r\n", data.size());
+        return size + data + "\r\n";
+    }
+
+    Send send_;
+    bool keep_alive_;
+    bool committed_ = false;
+    bool failed_ = false;
+    std::string pending_;
+    ResponseStream stream_;
+};
+
+HttpResponse plain_response(int status, const std::string& message) {
     std::vector<std::pair<std::string, std::string>> headers = {
         {"Content-Type", "text/plain; charset=utf-8"},
     };
@@ -369,6 +656,7 @@ std::optional<ResolvedResource> resolve_resource(const ServerState& state, const
         if (!canonical) return std::nullopt;
         ResolvedResource resource;
         resource.path = *canonical;
+        resource.relative = candidate;
         auto ext = resource.path.extension().string();
         std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
         if (ext == ".pol") {
@@ -421,16 +709,6 @@ std::string infer_static_mime_type(const std::filesystem::path& path) {
     return "application/octet-stream";
 }
 
-std::string read_file_contents(const std::filesystem::path& path) {
-    std::ifstream stream(path, std::ios::binary);
-    if (!stream) {
-        throw std::runtime_error("unable to open file: " + path.string());
-    }
-    std::ostringstream buffer;
-    buffer << stream.rdbuf();
-    return buffer.str();
-}
-
 ServerState build_server_state(const ServerConfig& config) {
     ServerState state;
     std::error_code ec;
@@ -446,6 +724,7 @@ ServerState build_server_state(const ServerConfig& config) {
         state.root_string = "/";
     }
     state.port = config.port;
+    state.compress = config.compress;
     return state;
 }
 
@@ -489,40 +768,98 @@ void populate_header_object(CGIContext& ctx, const HttpRequest& request) {
     ctx.headers = std::move(headers);
 }
 
-std::string response_from_context(ResponseContext& ctx, const std::string& body) {
+HttpResponse response_from_context(ResponseContext& ctx, std::string body) {
     if (!ctx.has_content_type()) {
         ctx.add_header("Content-Type", "text/html; charset=utf-8");
     }
-    std::vector<std::pair<std::string, std::string>> headers;
-    headers.reserve(ctx.headers.size());
-    for (const auto& header : ctx.headers) {
-        if (iequals(header.first, "Content-Length")) {
-            continue;
+    return build_http_response(ctx.status_code, ctx.headers, std::move(body));
+}
+
+// True when a Range request may be honoured: there is no If-Range, or it
+// names the current representation by strong ETag or exact Last-Modified.
+bool if_range_allows(const HttpRequest& request, const std::string& etag, std::int64_t modified) {
+    std::string if_range = http::trim_whitespace(request.header("if-range"));
+    if (if_range.empty()) {
+        return true;
+    }
+    if (if_range.front() == '"' || if_range.compare(0, 2, "W/") == 0) {
+        return if_range == etag && etag.compare(0, 2, "W/") != 0;
+    }
+    auto date = http::parse_http_date(if_range);
+    return date && *date == modified;
+}
+
+// Entity tags of compressed variants are weakened, as a compressed body is
+// not byte-for-byte the tagged representation.
+std::string weaken_etag(const std::string& etag) {
+    if (etag.compare(0, 2, "W/") == 0) {
+        return etag;
+    }
+    return "W/" + etag;
+}
+
+// Compresses rendered output in place when the client accepts it and the
+// body is text worth compressing. A script that set Content-Encoding itself
+// is left alone.
+void compress_template_response(const HttpRequest& request, HttpResponse& response, const ServerState& state) {
+    if (!state.compress || response.status == 304 || response.status == 204 || response.status == 206 ||
+        response.status == 416 || response.body.size() < kMinCompressBytes) {
+        return;
+    }
+    std::string content_type;
+    for (const auto& header : response.headers) {
+        if (iequals(header.first, "Content-Encoding")) {
+            return;
+        }
+        if (iequals(header.first, "Content-Type")) {
+            content_type = header.second;
+        }
+    }
+    if (!is_compressible_type(content_type)) {
+        return;
+    }
+    response.headers.emplace_back("Vary", "Accept-Encoding");
+    ContentCoding coding = negotiate_content_coding(request.header("accept-encoding"));
+    if (coding == ContentCoding::Identity) {
+        return;
+    }
+    response.body = compress_body(response.body.data(), response.body.size(), coding);
+    response.headers.emplace_back("Content-Encoding", content_coding_name(coding));
+    for (auto& header : response.headers) {
+        if (iequals(header.first, "ETag")) {
+            header.second = weaken_etag(header.second);
         }
-        headers.push_back(header);
     }
-    return build_http_response(ctx.status_code, headers, body);
 }
 
-std::string template_response(const HttpRequest& request,
-                              const RequestInfo& info,
-                              const ResolvedResource& resource,
-                              const sockaddr_in& client,
-                              const ServerState& state,
-                              std::optional<int> forced_status = std::nullopt) {
+HttpResponse template_response(const HttpRequest& request,
+                               const RequestInfo& info,
+                               const ResolvedResource& resource,
+                               const sockaddr_in& client,
+                               const ServerState& state,
+                               ChunkedStream* stream,
+                               std::optional<int> forced_status = std::nullopt) {
     try {
-        Source source = Source::from_file(resource.path.string());
-        Interpreter interpreter(std::make_shared<Env>(), resource.path.string());
+        auto lease = state.interpreters->acquire(resource.path.string());
+        Interpreter& interpreter = *lease;
         ResponseContext response;
         if (forced_status) {
             response.set_status(*forced_status);
         }
         interpreter.set_response_context(&response);
+        if (stream) {
+            interpreter.set_response_stream(stream->response_stream());
+        }
         CGIContext ctx;
         ctx.script_filename = resource.path.string();
         ctx.request_method = request.method;
         ctx.content_type = request.header("content-type");
         ctx.content_length = request.header("content-length");
+        if (ctx.content_length.empty() && !request.header("transfer-encoding").empty()) {
+            // Scripts see a decoded chunked body as if it had been sent with
+            // its length.
+            ctx.content_length = std::to_string(request.body.size());
+        }
         ctx.body = request.body;
         ctx.get = http::parse_query_string(info.query);
         ctx.post = Value::Object();
@@ -550,6 +887,7 @@ std::string template_response(const HttpRequest& request,
             }
         }
         interpreter.set_session_context(&session);
+        interpreter.set_storage_root(state.root.generic_string());
         process_request_body(ctx, interpreter);
         auto env = interpreter.env();
         env->set_local("_GET", Value(ctx.get));
@@ -557,7 +895,11 @@ std::string template_response(const HttpRequest& request,
         env->set_local("_FILES", Value(ctx.files));
         env->set_local("_COOKIE", Value(ctx.cookie));
         env->set_local("_SERVER", Value(ctx.server));
-        std::string rendered = render_template_with_interpreter(source, interpreter);
+        std::string rendered = render_template_file(resource.path.string(), interpreter);
+        if (stream && stream->committed()) {
+            // Already on its way; the caller sends the final chunk.
+            return HttpResponse();
+        }
         if (session.is_cgi && session.dirty && !session.secret_missing) {
             try {
                 std::string cookie_value =
@@ -570,59 +912,150 @@ std::string template_response(const HttpRequest& request,
             response.set_status(*forced_status);
         }
         std::string body = interpreter.response_finalized() ? interpreter.finalized_body() : rendered;
-        return response_from_context(response, body);
+        HttpResponse result = response_from_context(response, std::move(body));
+        compress_template_response(request, result, state);
+        return result;
     } catch (const PolonioError& err) {
+        if (stream && stream->committed()) {
+            stream->abort(err.format());
+            return HttpResponse();
+        }
         return plain_response(500, err.format());
     } catch (const std::exception&) {
+        if (stream && stream->committed()) {
+            stream->abort("InternalError: request failed");
+            return HttpResponse();
+        }
         return plain_response(500, "InternalError: request failed");
     }
 }
 
-std::string static_response(const ResolvedResource& resource) {
-    try {
-        std::string body = read_file_contents(resource.path);
-        std::vector<std::pair<std::string, std::string>> headers = {
-            {"Content-Type", infer_static_mime_type(resource.path)},
-        };
-        return build_http_response(200, headers, body);
-    } catch (const std::exception&) {
+// True when a GET's validators show the client already holds the
+// representation tagged `etag`, last modified at `modified`. If-None-Match
+// takes precedence over If-Modified-Since (RFC 9110 13.2.2).
+bool client_has_current_copy(const HttpRequest& request, const std::string& etag, std::int64_t modified) {
+    if (!iequals(request.method, "GET")) {
+        return false;
+    }
+    std::string if_none_match = request.header("if-none-match");
+    if (!if_none_match.empty()) {
+        return http::if_none_match_matches(if_none_match, etag);
+    }
+    std::string if_modified_since = request.header("if-modified-since");
+    if (if_modified_since.empty()) {
+        return false;
+    }
+    auto since = http::parse_http_date(http::trim_whitespace(if_modified_since));
+    return since && modified <= *since;
+}
+
+HttpResponse static_response(const HttpRequest& request, const ResolvedResource& resource, const ServerState& state) {
+    auto file = state.files->open(resource.path);
+    if (!file) {
         return plain_response(500, "InternalError: resource failed");
     }
+    const std::string content_type = infer_static_mime_type(resource.path);
+    ContentCoding coding =
+        state.compress ? negotiate_content_coding(request.header("accept-encoding")) : ContentCoding::Identity;
+
+    // A prebuilt `name.gz` beside the file is sent as is unless the file was
+    // edited after it was built; otherwise text is compressed here and kept
+    // in the compressed cache. The sibling is resolved like any requested
+    // file, so a link pointing out of the root is never followed.
+    std::shared_ptr<const OpenFile> body_file = file;
+    std::shared_ptr<const std::string> body_bytes;
+    std::string etag = file->etag();
+    const char* encoding = "";
+    if (coding == ContentCoding::Gzip) {
+        std::shared_ptr<const OpenFile> sibling;
+        if (auto sibling_path = find_regular_file(state, resource.relative.string() + ".gz")) {
+            sibling = state.files->open(*sibling_path);
+        }
+        if (sibling && sibling->modified_ns() >= file->modified_ns()) {
+            body_file = std::move(sibling);
+            etag = body_file->etag();
+            encoding = "gzip";
+        }
+    }
+    if (!*encoding && coding != ContentCoding::Identity && is_compressible_type(content_type) &&
+        file->size() >= kMinCompressBytes && file->size() <= kMaxCompressFileBytes) {
+        body_bytes = state.compressed->get(resource.path.string(), *file, coding);
+        body_file.reset();
+        etag = weaken_etag(file->etag());
+        encoding = content_coding_name(coding);
+    }
+
+    // Files change under the dev server constantly, so clients may keep a
+    // copy but must revalidate it; the validators make that a cheap 304.
+    std::vector<std::pair<std::string, std::string>> headers = {
+        {"Content-Type", content_type},
+        {"ETag", etag},
+        {"Last-Modified", http::format_http_date(file->modified())},
+        {"Cache-Control", "no-cache"},
+    };
+    if (state.compress) {
+        headers.emplace_back("Vary", "Accept-Encoding");
+    }
+    if (*encoding) {
+        headers.emplace_back("Content-Encoding", encoding);
+    }
+    headers.emplace_back("Accept-Ranges", "bytes");
+    if (client_has_current_copy(request, etag, file->modified())) {
+        return build_http_response(304, headers, std::string());
+    }
+
+    // Ranges address the bytes actually sent, compressed or not.
+    const std::uint64_t size = body_bytes ? body_bytes->size() : body_file->size();
+    http::ByteRange range;
+    std::string range_header = request.header("range");
+    if (!range_header.empty() && iequals(request.method, "GET") && if_range_allows(request, etag, file->modified())) {
+        range = http::resolve_byte_range(range_header, size);
+    }
+    if (range.kind == http::ByteRange::Kind::Unsatisfiable) {
+        headers.emplace_back("Content-Range", http::content_range_value(range, size));
+        return build_http_response(416, headers, std::string());
+    }
+    int status = 200;
+    std::uint64_t offset = 0;
+    std::uint64_t length = size;
+    if (range.kind == http::ByteRange::Kind::Partial) {
+        status = 206;
+        offset = range.offset;
+        length = range.length;
+        headers.emplace_back("Content-Range", http::content_range_value(range, size));
+    }
+    if (body_bytes) {
+        return build_http_response(status, headers,
+                                   body_bytes->substr(static_cast<std::size_t>(offset), static_cast<std::size_t>(length)));
+    }
+    HttpResponse response = build_http_response(status, headers, std::string());
+    response.file_offset = offset;
+    response.file_length = length;
+    response.file = std::move(body_file);
+    return response;
 }
 
-std::string not_found_response(const HttpRequest& request,
-                               const RequestInfo& info,
-                               const sockaddr_in& client,
-                               const ServerState& state) {
+HttpResponse not_found_response(const HttpRequest& request,
+                                const RequestInfo& info,
+                                const sockaddr_in& client,
+                                const ServerState& state,
+                                ChunkedStream* stream) {
     auto custom = find_regular_file(state, "404.pol");
     if (custom) {
         ResolvedResource resource;
         resource.kind = ResolvedResource::Kind::Template;
         resource.path = *custom;
-        return template_response(request, info, resource, client, state, 404);
+        return template_response(request, info, resource, client, state, stream, 404);
     }
     return plain_response(404, "Not Found");
 }
 
-std::string dispatch_request(const ServerState& state, const HttpRequest& request, const sockaddr_in& client) {
-    struct ScopedStorageRoot {
-        bool applied = false;
-        explicit ScopedStorageRoot(const std::filesystem::path& root) {
-            const char* existing = std::getenv("POLONIO_STORAGE_PATH");
-            if (existing && existing[0] != '\0') {
-                return;
-            }
-            std::string value = root.generic_string();
-            ::setenv("POLONIO_STORAGE_PATH", value.c_str(), 1);
-            applied = true;
-        }
-        ~ScopedStorageRoot() {
-            if (applied) {
-                ::unsetenv("POLONIO_STORAGE_PATH");
-            }
-        }
-    } storage_guard(state.root);
-
+// `stream`, when given, lets templates flush their output early; see
+// ChunkedStream.
+HttpResponse dispatch_request(const ServerState& state,
+                              const HttpRequest& request,
+                              const sockaddr_in& client,
+                              ChunkedStream* stream) {
     if (request.version != "HTTP/1.1") {
         return plain_response(400, "Bad Request");
     }
@@ -640,33 +1073,429 @@ std::string dispatch_request(const ServerState& state, const HttpRequest& reques
     }
     auto resource = resolve_resource(state, info.path);
     if (!resource) {
-        return not_found_response(request, info, client, state);
+        return not_found_response(request, info, client, state, stream);
     }
     if (resource->kind == ResolvedResource::Kind::Template) {
-        return template_response(request, info, *resource, client, state);
+        return template_response(request, info, *resource, client, state, stream);
     }
-    return static_response(*resource);
+    return static_response(request, *resource, state);
 }
 
-void handle_client(int client_fd, const sockaddr_in& client, const ServerState& state) {
-    try {
-        HttpRequest request;
-        if (!read_http_request(client_fd, request)) {
-            return;
+void set_nonblocking(int fd) {
+    int flags = ::fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        throw_system_error("fcntl");
+    }
+}
+
+// A parsed request on its way to a worker thread. A negative fd tells the
+// worker that pops it to exit.
+struct PendingRequest {
+    int fd = -1;
+    sockaddr_in client{};
+    HttpRequest request;
+    bool keep_alive = false;
+};
+
+struct FinishedResponse {
+    int fd;
+    WireResponse response;
+    bool keep_alive;
+};
+
+bool request_allows_keep_alive(const HttpRequest& request) {
+    return to_lower_ascii(request.header("connection")).find("close") == std::string::npos;
+}
+
+// Writes a streamed chunk from a worker thread. The event loop leaves a
+// connection alone while its request runs, so the worker may use the socket
+// directly, waiting out a full send buffer up to the client timeout.
+bool send_while_running(int fd, const std::string& bytes) {
+    std::size_t sent = 0;
+    while (sent < bytes.size()) {
+        ssize_t n = ::send(fd, bytes.data() + sent, bytes.size() - sent, 0);
+        if (n > 0) {
+            sent += static_cast<std::size_t>(n);
+            continue;
         }
-        std::string response = dispatch_request(state, request, client);
-        send_all(client_fd, response);
-    } catch (const std::exception&) {
-        std::string response = plain_response(500, "InternalError: request failed");
-        send_all(client_fd, response);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pollfd writable{fd, POLLOUT, 0};
+            if (::poll(&writable, 1, kClientTimeoutSeconds * 1000) > 0) {
+                continue;
+            }
+        }
+        return false;
     }
+    return true;
 }
 
+class RequestQueue {
+public:
+    void push(PendingRequest request) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        requests_.push_back(std::move(request));
+        ready_.notify_one();
+    }
+
+    PendingRequest pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return !requests_.empty(); });
+        PendingRequest request = std::move(requests_.front());
+        requests_.pop_front();
+        return request;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<PendingRequest> requests_;
+};
+
+// Owns every client socket. The event loop thread reads requests and writes
+// responses without blocking, so idle and slow clients cost a buffer rather
+// than a thread. Complete requests run on the worker threads, which hand the
+// response back through `finished_` and a byte on the wake pipe.
+class Reactor {
+public:
+    Reactor(int server_fd, const ServerState& state, std::size_t worker_count)
+        : server_fd_(server_fd), state_(state) {
+        if (::pipe(wake_fds_) < 0) {
+            throw_system_error("pipe");
+        }
+        set_nonblocking(wake_fds_[0]);
+        set_nonblocking(wake_fds_[1]);
+        set_nonblocking(server_fd_);
+        poller_.add(server_fd_, Poller::Read);
+        poller_.add(wake_fds_[0], Poller::Read);
+        workers_.reserve(worker_count);
+        for (std::size_t i = 0; i < worker_count; ++i) {
+            workers_.emplace_back([this] { work(); });
+        }
+    }
+
+    ~Reactor() {
+        for (std::size_t i = 0; i < workers_.size(); ++i) {
+            requests_.push(PendingRequest{});
+        }
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+        for (const auto& entry : connections_) {
+            ::close(entry.first);
+        }
+        ::close(wake_fds_[0]);
+        ::close(wake_fds_[1]);
+    }
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    [[noreturn]] void run() {
+        auto last_sweep = std::chrono::steady_clock::now();
+        while (true) {
+            for (const auto& event : poller_.wait(1000)) {
+                if (event.fd == server_fd_) {
+                    accept_connections();
+                } else if (event.fd == wake_fds_[0]) {
+                    collect_finished();
+                } else {
+                    on_ready(event);
+                }
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_sweep >= std::chrono::seconds(1)) {
+                expire_idle(now);
+                // Descriptors held elsewhere, such as cached files, may
+                // have been released too.
+                resume_accepting();
+                last_sweep = now;
+            }
+        }
+    }
+
+private:
+    enum class Phase { Reading, Running, Writing };
+
+    struct Connection {
+        sockaddr_in client{};
+        Phase phase = Phase::Reading;
+        // Bytes received but not yet parsed, including pipelined requests.
+        std::string input;
+        RequestReader reader;
+        WireResponse output;
+        std::uint64_t output_offset = 0;
+        bool keep_alive = false;
+        int requests_started = 0;
+        bool watched = false;
+        std::chrono::steady_clock::time_point last_activity;
+    };
+
+    void accept_connections() {
+        while (true) {
+            sockaddr_in client{};
+            socklen_t client_len = sizeof(client);
+            int fd = ::accept(server_fd_, reinterpret_cast<sockaddr*>(&client), &client_len);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+                // Out of descriptors: leave the rest in the backlog, and stop
+                // watching it so the level-triggered poller does not report
+                // it again on every wait, until a descriptor is freed.
+                if (errno == EMFILE || errno == ENFILE) {
+                    poller_.remove(server_fd_);
+                    accepting_ = false;
+                    return;
+                }
+                throw_system_error("accept");
+            }
+            set_nonblocking(fd);
+            Connection& connection = connections_[fd];
+            connection.client = client;
+            connection.last_activity = std::chrono::steady_clock::now();
+            watch(fd, connection, Poller::Read);
+        }
+    }
+
+    void resume_accepting() {
+        if (!accepting_) {
+            poller_.add(server_fd_, Poller::Read);
+            accepting_ = true;
+        }
+    }
+
+    void on_ready(const Poller::Event& event) {
+        auto it = connections_.find(event.fd);
+        if (it == connections_.end()) {
+            return;
+        }
+        Connection& connection = it->second;
+        if (connection.phase == Phase::Reading && (event.readable || event.failed)) {
+            read_request(event.fd, connection);
+        } else if (connection.phase == Phase::Writing && (event.writable || event.failed)) {
+            write_response(event.fd, connection);
+        }
+    }
+
+    void read_request(int fd, Connection& connection) {
+        char chunk[16384];
+        while (true) {
+            ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+                close_connection(fd);
+                return;
+            }
+            if (n == 0) {
+                // The client hung up, between requests or in the middle of one.
+                close_connection(fd);
+                return;
+            }
+            connection.input.append(chunk, static_cast<std::size_t>(n));
+            connection.last_activity = std::chrono::steady_clock::now();
+            if (start_next_request(fd, connection)) {
+                return;
+            }
+        }
+    }
+
+    // Hands the next request buffered on the connection to a worker. Returns
+    // false when more input is needed first.
+    bool start_next_request(int fd, Connection& connection) {
+        PendingRequest pending;
+        try {
+            if (!connection.reader.advance(connection.input, pending.request)) {
+                return false;
+            }
+        } catch (const std::exception&) {
+            unwatch(fd, connection);
+            respond(fd, connection, serialize_http_response(plain_response(500, "InternalError: request failed"), false),
+                    false);
+            return true;
+        }
+        // Nothing is read while the request runs, so pipelined requests wait
+        // in the buffer and responses go out in order.
+        unwatch(fd, connection);
+        connection.phase = Phase::Running;
+        connection.requests_started += 1;
+        pending.fd = fd;
+        pending.client = connection.client;
+        pending.keep_alive =
+            request_allows_keep_alive(pending.request) && connection.requests_started < kMaxRequestsPerConnection;
+        requests_.push(std::move(pending));
+        return true;
+    }
+
+    void work() {
+        while (true) {
+            PendingRequest pending = requests_.pop();
+            if (pending.fd < 0) {
+                return;
+            }
+            const int fd = pending.fd;
+            ChunkedStream stream([fd](const std::string& bytes) { return send_while_running(fd, bytes); },
+                                 pending.keep_alive);
+            HttpResponse response;
+            try {
+                response = dispatch_request(state_, pending.request, pending.client, &stream);
+            } catch (const std::exception&) {
+                response = plain_response(500, "InternalError: request failed");
+            }
+            bool keep_alive;
+            WireResponse serialized;
+            if (stream.committed()) {
+                serialized.bytes = stream.finish();
+                keep_alive = stream.keep_alive();
+            } else {
+                keep_alive = pending.keep_alive && response_allows_keep_alive(response);
+                serialized = serialize_http_response(response, keep_alive);
+            }
+            {
+                std::lock_guard<std::mutex> lock(finished_mutex_);
+                finished_.push_back(FinishedResponse{pending.fd, std::move(serialized), keep_alive});
+            }
+            char byte = 0;
+            // A full pipe already guarantees a wakeup.
+            (void)::write(wake_fds_[1], &byte, 1);
+        }
+    }
+
+    void collect_finished() {
+        char drain[256];
+        while (::read(wake_fds_[0], drain, sizeof(drain)) > 0) {
+        }
+        std::vector<FinishedResponse> finished;
+        {
+            std::lock_guard<std::mutex> lock(finished_mutex_);
+            finished.swap(finished_);
+        }
+        for (auto& done : finished) {
+            auto it = connections_.find(done.fd);
+            if (it != connections_.end()) {
+                respond(done.fd, it->second, std::move(done.response), done.keep_alive);
+            }
+        }
+    }
+
+    void respond(int fd, Connection& connection, WireResponse response, bool keep_alive) {
+        connection.phase = Phase::Writing;
+        connection.output = std::move(response);
+        connection.output_offset = 0;
+        connection.keep_alive = keep_alive;
+        connection.last_activity = std::chrono::steady_clock::now();
+        write_response(fd, connection);
+    }
+
+    // Sends as much of the response as the socket takes, then either waits
+    // for the socket to drain, moves on to the next request, or closes.
+    void write_response(int fd, Connection& connection) {
+        const WireResponse& output = connection.output;
+        while (connection.output_offset < output.size()) {
+            ssize_t sent;
+            if (connection.output_offset < output.bytes.size()) {
+                std::size_t offset = static_cast<std::size_t>(connection.output_offset);
+                sent = ::send(fd, output.bytes.data() + offset, output.bytes.size() - offset, 0);
+            } else {
+                std::uint64_t into_file = connection.output_offset - output.bytes.size();
+                std::size_t count =
+                    static_cast<std::size_t>(std::min<std::uint64_t>(output.file_length - into_file, kFileChunkBytes));
+                sent = send_file_range(fd, *output.file, output.file_offset + into_file, count);
+                if (sent == 0) {
+                    // The file shrank after its length went out in the headers.
+                    close_connection(fd);
+                    return;
+                }
+            }
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    watch(fd, connection, Poller::Write);
+                    return;
+                }
+                close_connection(fd);
+                return;
+            }
+            connection.output_offset += static_cast<std::size_t>(sent);
+            connection.last_activity = std::chrono::steady_clock::now();
+        }
+        if (!connection.keep_alive) {
+            close_connection(fd);
+            return;
+        }
+        connection.phase = Phase::Reading;
+        connection.output = WireResponse();
+        connection.output_offset = 0;
+        if (!start_next_request(fd, connection)) {
+            watch(fd, connection, Poller::Read);
+        }
+    }
+
+    void watch(int fd, Connection& connection, unsigned interest) {
+        if (connection.watched) {
+            poller_.modify(fd, interest);
+        } else {
+            poller_.add(fd, interest);
+            connection.watched = true;
+        }
+    }
+
+    void unwatch(int fd, Connection& connection) {
+        if (connection.watched) {
+            poller_.remove(fd);
+            connection.watched = false;
+        }
+    }
+
+    void expire_idle(std::chrono::steady_clock::time_point now) {
+        std::vector<int> expired;
+        for (const auto& entry : connections_) {
+            const Connection& connection = entry.second;
+            if (connection.phase == Phase::Running) {
+                continue;
+            }
+            bool between_requests = connection.phase == Phase::Reading && connection.input.empty() &&
+                                    connection.requests_started > 0;
+            auto limit = std::chrono::seconds(between_requests ? kKeepAliveIdleSeconds : kClientTimeoutSeconds);
+            if (now - connection.last_activity >= limit) {
+                expired.push_back(entry.first);
+            }
+        }
+        for (int fd : expired) {
+            close_connection(fd);
+        }
+    }
+
+    void close_connection(int fd) {
+        poller_.remove(fd);
+        connections_.erase(fd);
+        ::close(fd);
+        resume_accepting();
+    }
+
+    int server_fd_;
+    // False while the listen socket is unwatched for lack of descriptors.
+    bool accepting_ = true;
+    const ServerState& state_;
+    Poller poller_;
+    std::unordered_map<int, Connection> connections_;
+    RequestQueue requests_;
+    std::vector<std::thread> workers_;
+    std::mutex finished_mutex_;
+    std::vector<FinishedResponse> finished_;
+    int wake_fds_[2] = {-1, -1};
+};
+
 } // namespace
 
 void run_http_server(const ServerConfig& config) {
     ServerState state = build_server_state(config);
     std::cout << "Serving " << state.root_string << " at http://127.0.0.1:" << state.port << std::endl;
+    // Writes to a client that went away must fail with EPIPE, not end the
+    // server.
+    std::signal(SIGPIPE, SIG_IGN);
 
     int server_fd = ::socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0) {
@@ -687,28 +1516,19 @@ void run_http_server(const ServerConfig& config) {
         throw_system_error("bind");
     }
 
-    if (::listen(server_fd, 16) < 0) {
+    if (::listen(server_fd, SOMAXCONN) < 0) {
         int err = errno;
         ::close(server_fd);
         errno = err;
         throw_system_error("listen");
     }
 
-    while (true) {
-        sockaddr_in client{};
-        socklen_t client_len = sizeof(client);
-        int client_fd = ::accept(server_fd, reinterpret_cast<sockaddr*>(&client), &client_len);
-        if (client_fd < 0) {
-            if (errno == EINTR) {
-                continue;
-            }
-            int err = errno;
-            ::close(server_fd);
-            errno = err;
-            throw_system_error("accept");
-        }
-        handle_client(client_fd, client, state);
-        ::close(client_fd);
+    try {
+        Reactor reactor(server_fd, state, static_cast<std::size_t>(std::max(1, config.workers)));
+        reactor.run();
+    } catch (...) {
+        ::close(server_fd);
+        throw;
     }
 }
 
@@ -716,14 +1536,33 @@ std::string simulate_http_request(const ServerConfig& config,
                                   const std::string& raw_request,
                                   const std::string& client_address) {
     ServerState state = build_server_state(config);
-    HttpRequest request = parse_http_request_string(raw_request);
+    std::string input = raw_request;
+    HttpRequest request;
+    if (!RequestReader().advance(input, request)) {
+        throw std::runtime_error("incomplete HTTP request");
+    }
     sockaddr_in client{};
     client.sin_family = AF_INET;
     if (::inet_pton(AF_INET, client_address.c_str(), &client.sin_addr) != 1) {
         client.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
     }
     client.sin_port = 0;
-    return dispatch_request(state, request, client);
+    std::string streamed;
+    ChunkedStream stream(
+        [&streamed](const std::string& bytes) {
+            streamed += bytes;
+            return true;
+        },
+        false);
+    HttpResponse response = dispatch_request(state, request, client, &stream);
+    if (stream.committed()) {
+        return streamed + stream.finish();
+    }
+    WireResponse wire = serialize_http_response(response, false);
+    if (wire.file) {
+        wire.bytes += wire.file->read(wire.file_offset, wire.file_length);
+    }
+    return wire.bytes;
 }
 
 } // namespace polonio
@@ -8,6 +8,12 @@ namespace polonio {
 struct ServerConfig {
     std::filesystem::path root;
     int port = 8080;
+    // Threads handling connections in parallel; each request gets its own
+    // interpreter.
+    int workers = 4;
+    // gzip/deflate for clients that accept it: prebuilt `.gz` siblings of
+    // static files, and text bodies of at least 1 KiB compressed on the fly.
+    bool compress = true;
 };
 
 void run_http_server(const ServerConfig& config);
@@ -0,0 +1,144 @@
+#include "polonio/server/poller.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
+namespace polonio {
+namespace {
+
+[[noreturn]] void throw_poll_error(const char* operation) {
+    throw std::runtime_error(std::string(operation) + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+#if defined(__linux__)
+
+namespace {
+
+constexpr int kMaxEventsPerWait = 256;
+
+std::uint32_t epoll_events(unsigned interest) {
+    std::uint32_t events = 0;
+    if (interest & Poller::Read) events |= EPOLLIN;
+    if (interest & Poller::Write) events |= EPOLLOUT;
+    return events;
+}
+
+} // namespace
+
+Poller::Poller() : epoll_fd_(::epoll_create1(EPOLL_CLOEXEC)) {
+    if (epoll_fd_ < 0) {
+        throw_poll_error("epoll_create1");
+    }
+}
+
+Poller::~Poller() { ::close(epoll_fd_); }
+
+void Poller::add(int fd, unsigned interest) {
+    epoll_event event{};
+    event.events = epoll_events(interest);
+    event.data.fd = fd;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+        throw_poll_error("epoll_ctl");
+    }
+}
+
+void Poller::modify(int fd, unsigned interest) {
+    epoll_event event{};
+    event.events = epoll_events(interest);
+    event.data.fd = fd;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) < 0) {
+        throw_poll_error("epoll_ctl");
+    }
+}
+
+void Poller::remove(int fd) { ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr); }
+
+const std::vector<Poller::Event>& Poller::wait(int timeout_ms) {
+    epoll_event events[kMaxEventsPerWait];
+    ready_.clear();
+    int count = ::epoll_wait(epoll_fd_, events, kMaxEventsPerWait, timeout_ms);
+    if (count < 0) {
+        if (errno == EINTR) return ready_;
+        throw_poll_error("epoll_wait");
+    }
+    for (int i = 0; i < count; ++i) {
+        const std::uint32_t flags = events[i].events;
+        ready_.push_back(Event{events[i].data.fd, (flags & EPOLLIN) != 0, (flags & EPOLLOUT) != 0,
+                               (flags & (EPOLLERR | EPOLLHUP)) != 0});
+    }
+    return ready_;
+}
+
+#else
+
+namespace {
+
+short poll_events(unsigned interest) {
+    short events = 0;
+    if (interest & Poller::Read) events |= POLLIN;
+    if (interest & Poller::Write) events |= POLLOUT;
+    return events;
+}
+
+} // namespace
+
+Poller::Poller() = default;
+Poller::~Poller() = default;
+
+void Poller::add(int fd, unsigned interest) {
+    index_[fd] = fds_.size();
+    fds_.push_back(pollfd{fd, poll_events(interest), 0});
+}
+
+void Poller::modify(int fd, unsigned interest) {
+    auto it = index_.find(fd);
+    if (it != index_.end()) {
+        fds_[it->second].events = poll_events(interest);
+    }
+}
+
+void Poller::remove(int fd) {
+    auto it = index_.find(fd);
+    if (it == index_.end()) {
+        return;
+    }
+    // Swap with the last entry so removal stays O(1).
+    std::size_t slot = it->second;
+    index_.erase(it);
+    if (slot != fds_.size() - 1) {
+        fds_[slot] = fds_.back();
+        index_[fds_[slot].fd] = slot;
+    }
+    fds_.pop_back();
+}
+
+const std::vector<Poller::Event>& Poller::wait(int timeout_ms) {
+    ready_.clear();
+    int count = ::poll(fds_.data(), static_cast<nfds_t>(fds_.size()), timeout_ms);
+    if (count < 0) {
+        if (errno == EINTR) return ready_;
+        throw_poll_error("poll");
+    }
+    for (const auto& entry : fds_) {
+        if (entry.revents == 0) continue;
+        ready_.push_back(Event{entry.fd, (entry.revents & POLLIN) != 0, (entry.revents & POLLOUT) != 0,
+                               (entry.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0});
+        if (ready_.size() == static_cast<std::size_t>(count)) break;
+    }
+    return ready_;
+}
+
+#endif
+
+} // namespace polonio
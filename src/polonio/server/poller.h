@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#if !defined(__linux__)
+#include <poll.h>
+#endif
+
+namespace polonio {
+
+// Level-triggered readiness notification for a set of descriptors: epoll on
+// Linux, poll(2) elsewhere.
+class Poller {
+public:
+    enum Interest : unsigned { Read = 1u << 0, Write = 1u << 1 };
+
+    struct Event {
+        int fd;
+        bool readable;
+        bool writable;
+        // Hangup or socket error; the next read or write reports details.
+        bool failed;
+    };
+
+    Poller();
+    ~Poller();
+    Poller(const Poller&) = delete;
+    Poller& operator=(const Poller&) = delete;
+
+    void add(int fd, unsigned interest);
+    void modify(int fd, unsigned interest);
+    void remove(int fd);
+
+    // Blocks up to `timeout_ms` (-1 waits indefinitely) and returns the ready
+    // descriptors. An interrupted wait returns no events.
+    const std::vector<Event>& wait(int timeout_ms);
+
+private:
+    std::vector<Event> ready_;
+#if defined(__linux__)
+    int epoll_fd_ = -1;
+#else
+    std::vector<pollfd> fds_;
+    std::unordered_map<int, std::size_t> index_;
+#endif
+};
+
+} // namespace polonio
@@ -8,11 +8,20 @@
 #include "polonio/common/error.h"
 #include "polonio/lexer/lexer.h"
 #include "polonio/parser/parser.h"
+#include "polonio/runtime/builtins.h"
+#include "polonio/runtime/db.h"
+#include "polonio/runtime/http_request_utils.h"
 #include "polonio/runtime/value.h"
 #include "polonio/runtime/env.h"
 #include "polonio/runtime/interpreter.h"
+#include "polonio/runtime/interpreter_pool.h"
+#include "polonio/runtime/json_utils.h"
+#include "polonio/runtime/multipart.h"
+#include "polonio/runtime/request_body.h"
 #include "polonio/runtime/template_scanner.h"
 #include "polonio/runtime/template_renderer.h"
+#include "polonio/server/compression.h"
+#include "polonio/server/file_cache.h"
 #include "polonio/server/http_server.h"
 
 #include <arpa/inet.h>
@@ -23,6 +32,7 @@
 #include <cstdlib>
 #include <cerrno>
 #include <cstring>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
 #include <memory>
@@ -31,8 +41,11 @@
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <sys/resource.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <sys/wait.h>
+#include <zlib.h>
 #include <thread>
 #include <unistd.h>
 #include <vector>
@@ -256,6 +269,7 @@ std::string build_http_request(const std::string& method,
                                const std::string& body) {
     bool has_host = false;
     bool has_content_length = false;
+    bool chunked = false;
     std::ostringstream request;
     request << method << " " << target << " HTTP/1.1\r\n";
     for (const auto& header : headers) {
@@ -265,12 +279,15 @@ std::string build_http_request(const std::string& method,
         if (iequals(header.first, "Content-Length")) {
             has_content_length = true;
         }
+        if (iequals(header.first, "Transfer-Encoding")) {
+            chunked = true;
+        }
         request << header.first << ": " << header.second << "\r\n";
     }
     if (!has_host) {
         request << "Host: localhost\r\n";
     }
-    if (!has_content_length) {
+    if (!has_content_length && !chunked) {
         if (!body.empty()) {
             request << "Content-Length: " << body.size() << "\r\n";
         } else if (iequals(method, "POST")) {
@@ -372,6 +389,231 @@ HttpResponseMessage perform_http_request_message(
     return parse_http_response(raw);
 }
 
+// Decodes a gzip or zlib-wrapped deflate body; empty when it is neither.
+std::string inflate_body(const std::string& encoded) {
+    z_stream stream{};
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        return {};
+    }
+    std::string decoded;
+    char chunk[16384];
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(encoded.data()));
+    stream.avail_in = static_cast<uInt>(encoded.size());
+    int status = Z_OK;
+    while (status == Z_OK) {
+        stream.next_out = reinterpret_cast<Bytef*>(chunk);
+        stream.avail_out = sizeof(chunk);
+        status = inflate(&stream, Z_NO_FLUSH);
+        decoded.append(chunk, sizeof(chunk) - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    return status == Z_STREAM_END ? decoded : std::string();
+}
+
+int find_free_port() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(fd >= 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    REQUIRE(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    socklen_t len = sizeof(addr);
+    REQUIRE(getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) == 0);
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+// Opens a loopback connection; every read and write gives up after five
+// seconds so a stuck server fails the test instead of hanging it.
+int connect_loopback(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    timeval timeout{};
+    timeout.tv_sec = 5;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool send_text(int fd, const std::string& data) {
+    std::size_t offset = 0;
+    while (offset < data.size()) {
+        ssize_t sent = send(fd, data.data() + offset, data.size() - offset, 0);
+        if (sent <= 0) {
+            return false;
+        }
+        offset += static_cast<std::size_t>(sent);
+    }
+    return true;
+}
+
+std::string read_until_closed(int fd) {
+    std::string data;
+    char chunk[4096];
+    while (true) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            break;
+        }
+        data.append(chunk, static_cast<std::size_t>(n));
+    }
+    return data;
+}
+
+// Reads exactly one Content-Length delimited response, leaving the
+// connection open.
+std::string read_one_response(int fd) {
+    std::string data;
+    char ch;
+    while (data.find("\r\n\r\n") == std::string::npos) {
+        if (recv(fd, &ch, 1, 0) != 1) {
+            return data;
+        }
+        data.push_back(ch);
+    }
+    auto response = parse_http_response(data);
+    std::size_t length = static_cast<std::size_t>(std::stoul(response.header_value("Content-Length")));
+    std::string body(length, '\0');
+    std::size_t received = 0;
+    while (received < length) {
+        ssize_t n = recv(fd, body.data() + received, length - received, 0);
+        if (n <= 0) {
+            break;
+        }
+        received += static_cast<std::size_t>(n);
+    }
+    return data + body.substr(0, received);
+}
+
+// Reads one chunked response through its terminating zero-length chunk,
+// leaving the connection open. The body stays chunk-framed.
+std::string read_chunked_response(int fd) {
+    std::string data;
+    char chunk[4096];
+    while (true) {
+        auto head_end = data.find("\r\n\r\n");
+        if (head_end != std::string::npos && data.size() >= head_end + 9 &&
+            data.compare(data.size() - 5, 5, "0\r\n\r\n") == 0) {
+            return data;
+        }
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return data;
+        }
+        data.append(chunk, static_cast<std::size_t>(n));
+    }
+}
+
+// Undoes chunked framing; nullopt when the body is malformed or lacks the
+// terminating chunk.
+std::optional<std::string> decode_chunked(const std::string& body) {
+    std::string decoded;
+    std::size_t pos = 0;
+    while (true) {
+        auto line_end = body.find("\r\n", pos);
+        if (line_end == std::string::npos) {
+            return std::nullopt;
+        }
+        std::size_t size = std::stoul(body.substr(pos, line_end - pos), nullptr, 16);
+        pos = line_end + 2;
+        if (size == 0) {
+            return body.compare(pos, std::string::npos, "\r\n") == 0 ? std::optional<std::string>(decoded)
+                                                                        : std::nullopt;
+        }
+        if (body.size() < pos + size + 2 || body.compare(pos + size, 2, "\r\n") != 0) {
+            return std::nullopt;
+        }
+        decoded += body.substr(pos, size);
+        pos += size + 2;
+    }
+}
+
+// `polonio serve` running in a child process until the object goes away.
+class ServeProcess {
+public:
+    // A nonzero `max_files` caps the server's open descriptors.
+    ServeProcess(const std::filesystem::path& root, const std::vector<std::string>& extra_args = {},
+                 rlim_t max_files = 0)
+        : port_(find_free_port()) {
+        auto binary = (std::filesystem::current_path() / "build/polonio").string();
+        std::vector<std::string> args = {binary, "serve", "--root", root.string(), "--port", std::to_string(port_)};
+        args.insert(args.end(), extra_args.begin(), extra_args.end());
+        pid_ = fork();
+        REQUIRE(pid_ != -1);
+        if (pid_ == 0) {
+            std::vector<char*> argv;
+            for (auto& arg : args) {
+                argv.push_back(arg.data());
+            }
+            argv.push_back(nullptr);
+            int null_fd = open("/dev/null", O_WRONLY);
+            dup2(null_fd, STDOUT_FILENO);
+            // Without POLONIO_STORAGE_PATH the server stores under its root.
+            unsetenv("POLONIO_STORAGE_PATH");
+            if (max_files > 0) {
+                rlimit limit{max_files, max_files};
+                setrlimit(RLIMIT_NOFILE, &limit);
+            }
+            execv(binary.c_str(), argv.data());
+            _exit(127);
+        }
+        for (int attempt = 0; attempt < 200; ++attempt) {
+            int fd = connect_loopback(port_);
+            if (fd >= 0) {
+                close(fd);
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        FAIL("serve did not start listening");
+    }
+
+    ~ServeProcess() { stop(); }
+
+    // Stops the server and returns the CPU seconds it used.
+    double stop() {
+        if (pid_ < 0) {
+            return 0.0;
+        }
+        kill(pid_, SIGTERM);
+        int status = 0;
+        rusage usage{};
+        wait4(pid_, &status, 0, &usage);
+        pid_ = -1;
+        return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+               static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    }
+
+    ServeProcess(const ServeProcess&) = delete;
+    ServeProcess& operator=(const ServeProcess&) = delete;
+
+    int port() const { return port_; }
+
+    std::string get(const std::string& target) const {
+        int fd = connect_loopback(port_);
+        REQUIRE(fd >= 0);
+        send_text(fd, "GET " + target + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n");
+        std::string response = read_until_closed(fd);
+        close(fd);
+        return response;
+    }
+
+private:
+    int port_;
+    pid_t pid_ = -1;
+};
+
 } // namespace
 
 TEST_CASE("CLI: run executes interpreter output") {
@@ -673,6 +915,28 @@ TEST_CASE("Includes share interpreter state") {
     std::filesystem::remove_all(dir);
 }
 
+TEST_CASE("Return in an included file leaves the including function") {
+    auto dir = std::filesystem::temp_directory_path() / "polonio_include_return";
+    std::filesystem::create_directories(dir);
+    auto main_path = (dir / "main.pol").string();
+    {
+        std::ofstream f(main_path);
+        f << "<% function pick(n) for v in [1, 2] include \"part.pol\" end return \"none\" end %>"
+             "<% echo pick(2) .. \",\" .. pick(5) %>";
+    }
+    {
+        std::ofstream f((dir / "part.pol").string());
+        f << "<% if v == n return \"got\" .. v end %>";
+    }
+    for (const char* engine : {"--engine=ast", "--engine=vm"}) {
+        CAPTURE(engine);
+        auto result = run_polonio({"run", engine, main_path});
+        CHECK(result.exit_code == 0);
+        CHECK(result.stdout_output == "got2,none");
+    }
+    std::filesystem::remove_all(dir);
+}
+
 TEST_CASE("Nested includes resolve relative paths") {
     auto dir = std::filesystem::temp_directory_path() / "polonio_include_nested";
     std::filesystem::create_directories(dir / "a");
@@ -731,6 +995,42 @@ TEST_CASE("Missing include file reports error") {
     std::filesystem::remove_all(dir);
 }
 
+TEST_CASE("Template cache reuses parsed files until they change") {
+    auto dir = std::filesystem::path(create_temp_directory("polonio_template_cache"));
+    auto page = dir / "page.pol";
+    auto part = dir / "part.pol";
+    write_text_file(page, "<% include \"part.pol\" %>A");
+    write_text_file(part, "B");
+    polonio::clear_template_cache();
+    auto render = [&]() {
+        polonio::Interpreter interpreter(std::make_shared<polonio::Env>(), page.string());
+        return polonio::render_template_file(page.string(), interpreter);
+    };
+
+    CHECK(render() == "BA");
+    auto stats = polonio::template_cache_stats();
+    CHECK(stats.misses == 2);
+    CHECK(stats.hits == 0);
+    CHECK(stats.entries == 2);
+
+    CHECK(render() == "BA");
+    CHECK(polonio::template_cache_stats().hits == 2);
+
+    auto stamp = std::filesystem::last_write_time(part);
+    write_text_file(part, "C");
+    std::filesystem::last_write_time(part, stamp + std::chrono::seconds(2));
+    CHECK(render() == "CA");
+    stats = polonio::template_cache_stats();
+    CHECK(stats.hits == 3);
+    CHECK(stats.misses == 3);
+    CHECK(stats.entries == 2);
+
+    write_text_file(page, "<% echo 1 +");
+    CHECK_THROWS_AS(render(), polonio::PolonioError);
+    polonio::clear_template_cache();
+    std::filesystem::remove_all(dir);
+}
+
 namespace {
 
 CommandResult run_polonio_cgi(const std::vector<std::pair<std::string, std::string>>& env,
@@ -985,6 +1285,212 @@ TEST_CASE("Dev server serves static files") {
     std::filesystem::remove_all(root);
 }
 
+TEST_CASE("HTTP dates and entity tag matching") {
+    CHECK(polonio::http::format_http_date(784111777) == "Sun, 06 Nov 1994 08:49:37 GMT");
+    CHECK(polonio::http::format_http_date(0) == "Thu, 01 Jan 1970 00:00:00 GMT");
+    CHECK(polonio::http::parse_http_date("Sun, 06 Nov 1994 08:49:37 GMT") == std::optional<std::int64_t>(784111777));
+    CHECK(polonio::http::parse_http_date("Thu, 29 Feb 2024 23:59:59 GMT") == std::optional<std::int64_t>(1709251199));
+    CHECK_FALSE(polonio::http::parse_http_date("Sunday, 06-Nov-94 08:49:37 GMT").has_value());
+    CHECK_FALSE(polonio::http::parse_http_date("Sun, 06 Nov 1994 08:49:37 PST").has_value());
+    CHECK(polonio::http::if_none_match_matches("\"a\", W/\"b\"", "\"b\""));
+    CHECK(polonio::http::if_none_match_matches("*", "\"anything\""));
+    CHECK_FALSE(polonio::http::if_none_match_matches("\"a\"", "\"ab\""));
+}
+
+TEST_CASE("Dev server answers conditional static requests with 304") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_conditional"));
+    write_text_file(root / "hello.txt", "hello");
+    auto first = perform_http_request_message(root, "GET", "/hello.txt", {});
+    REQUIRE(first.status == 200);
+    std::string etag = first.header_value("ETag");
+    std::string last_modified = first.header_value("Last-Modified");
+    CHECK(etag.size() > 2);
+    CHECK(etag.front() == '"');
+    CHECK(first.header_value("Cache-Control") == "no-cache");
+    CHECK(polonio::http::parse_http_date(last_modified).has_value());
+
+    auto by_tag = perform_http_request_message(root, "GET", "/hello.txt", {{"If-None-Match", etag}});
+    CHECK(by_tag.status == 304);
+    CHECK(by_tag.body.empty());
+    CHECK(by_tag.header_value("Content-Length").empty());
+    CHECK(by_tag.header_value("ETag") == etag);
+
+    auto other_tag = perform_http_request_message(root, "GET", "/hello.txt", {{"If-None-Match", "\"stale\""}});
+    CHECK(other_tag.status == 200);
+    CHECK(other_tag.body == "hello");
+
+    auto by_date = perform_http_request_message(root, "GET", "/hello.txt", {{"If-Modified-Since", last_modified}});
+    CHECK(by_date.status == 304);
+    CHECK(by_date.body.empty());
+
+    auto old_date = perform_http_request_message(root, "GET", "/hello.txt",
+                                                 {{"If-Modified-Since", "Sun, 06 Nov 1994 08:49:37 GMT"}});
+    CHECK(old_date.status == 200);
+    CHECK(old_date.body == "hello");
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server templates skip rendering when http_etag matches") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_etag"));
+    write_text_file(root / "page.pol", "<% if not http_etag(\"v1\") %>rendered<% end %>");
+    auto fresh = perform_http_request_message(root, "GET", "/page.pol", {});
+    CHECK(fresh.status == 200);
+    CHECK(fresh.body == "rendered");
+    CHECK(fresh.header_value("ETag") == "\"v1\"");
+
+    auto cached = perform_http_request_message(root, "GET", "/page.pol", {{"If-None-Match", "W/\"v1\""}});
+    CHECK(cached.status == 304);
+    CHECK(cached.body.empty());
+    CHECK(cached.header_value("ETag") == "\"v1\"");
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server compresses text for clients that accept it") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_gzip"));
+    std::string css;
+    for (int i = 0; i < 200; ++i) {
+        css += ".rule-" + std::to_string(i) + " { color: #333; margin: 0 auto; }\n";
+    }
+    write_text_file(root / "site.css", css);
+    write_text_file(root / "tiny.css", "p { margin: 0; }");
+
+    auto gzipped = perform_http_request_message(root, "GET", "/site.css", {{"Accept-Encoding", "gzip, deflate"}});
+    CHECK(gzipped.status == 200);
+    CHECK(gzipped.header_value("Content-Encoding") == "gzip");
+    CHECK(gzipped.header_value("Vary") == "Accept-Encoding");
+    CHECK(gzipped.header_value("ETag").compare(0, 3, "W/\"") == 0);
+    CHECK(gzipped.body.size() < css.size() / 4);
+    CHECK(inflate_body(gzipped.body) == css);
+
+    auto revalidated = perform_http_request_message(
+        root, "GET", "/site.css", {{"Accept-Encoding", "gzip"}, {"If-None-Match", gzipped.header_value("ETag")}});
+    CHECK(revalidated.status == 304);
+
+    auto deflated = perform_http_request_message(root, "GET", "/site.css", {{"Accept-Encoding", "gzip;q=0, deflate"}});
+    CHECK(deflated.header_value("Content-Encoding") == "deflate");
+    CHECK(inflate_body(deflated.body) == css);
+
+    auto plain = perform_http_request_message(root, "GET", "/site.css", {});
+    CHECK(plain.header_value("Content-Encoding").empty());
+    CHECK(plain.body == css);
+
+    auto tiny = perform_http_request_message(root, "GET", "/tiny.css", {{"Accept-Encoding", "gzip"}});
+    CHECK(tiny.header_value("Content-Encoding").empty());
+    CHECK(tiny.body == "p { margin: 0; }");
+
+    std::string page = "<% for i in range(300) %><li>item <% echo i %></li><% end %>";
+    write_text_file(root / "list.pol", page);
+    auto rendered = perform_http_request_message(root, "GET", "/list.pol", {{"Accept-Encoding", "gzip"}});
+    CHECK(rendered.status == 200);
+    CHECK(rendered.header_value("Content-Encoding") == "gzip");
+    std::string html = inflate_body(rendered.body);
+    CHECK(html.find("<li>item 0</li>") == 0);
+    CHECK(html.find("<li>item 299</li>") != std::string::npos);
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server prefers a precompressed .gz sibling") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_gz_sibling"));
+    write_text_file(root / "app.js", "console.log('plain');");
+    write_text_file(root / "app.js.gz", "prebuilt-gzip-bytes");
+    auto gzipped = perform_http_request_message(root, "GET", "/app.js", {{"Accept-Encoding", "gzip"}});
+    CHECK(gzipped.status == 200);
+    CHECK(gzipped.body == "prebuilt-gzip-bytes");
+    CHECK(gzipped.header_value("Content-Encoding") == "gzip");
+    CHECK(gzipped.header_value("Content-Type") == "application/javascript");
+
+    auto plain = perform_http_request_message(root, "GET", "/app.js", {{"Accept-Encoding", "identity"}});
+    CHECK(plain.body == "console.log('plain');");
+    CHECK(plain.header_value("Content-Encoding").empty());
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server ignores a .gz sibling older than its original") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_gz_stale"));
+    std::string css = "body { color: red; }\n";
+    while (css.size() < 4096) {
+        css += ".edited { margin: 0; }\n";
+    }
+    write_text_file(root / "app.css.gz", "stale-gzip-bytes");
+    write_text_file(root / "app.css", css);
+    std::filesystem::last_write_time(root / "app.css.gz",
+                                     std::filesystem::last_write_time(root / "app.css") - std::chrono::seconds(10));
+    auto gzipped = perform_http_request_message(root, "GET", "/app.css", {{"Accept-Encoding", "gzip"}});
+    CHECK(gzipped.status == 200);
+    CHECK(gzipped.header_value("Content-Encoding") == "gzip");
+    CHECK(inflate_body(gzipped.body) == css);
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server does not follow a .gz sibling out of the root") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_gz_link"));
+    auto outside = std::filesystem::path(create_temp_directory("polonio_serve_gz_outside"));
+    std::string css = "body { color: red; }\n";
+    while (css.size() < 4096) {
+        css += ".plain { margin: 0; }\n";
+    }
+    write_text_file(root / "app.css", css);
+    write_text_file(outside / "secret.gz", "outside-the-root");
+    std::filesystem::create_symlink(outside / "secret.gz", root / "app.css.gz");
+    auto gzipped = perform_http_request_message(root, "GET", "/app.css", {{"Accept-Encoding", "gzip"}});
+    CHECK(gzipped.status == 200);
+    CHECK(gzipped.body.find("outside-the-root") == std::string::npos);
+    CHECK(inflate_body(gzipped.body) == css);
+    std::filesystem::remove_all(root);
+    std::filesystem::remove_all(outside);
+}
+
+TEST_CASE("Byte ranges resolve against the representation size") {
+    using polonio::http::ByteRange;
+    auto range = polonio::http::resolve_byte_range("bytes=2-5", 10);
+    CHECK(range.kind == ByteRange::Kind::Partial);
+    CHECK(range.offset == 2);
+    CHECK(range.length == 4);
+    CHECK(polonio::http::content_range_value(range, 10) == "bytes 2-5/10");
+    range = polonio::http::resolve_byte_range("bytes=-3", 10);
+    CHECK(range.offset == 7);
+    CHECK(range.length == 3);
+    range = polonio::http::resolve_byte_range("bytes=4-100", 10);
+    CHECK(range.length == 6);
+    CHECK(polonio::http::resolve_byte_range("bytes=10-", 10).kind == ByteRange::Kind::Unsatisfiable);
+    CHECK(polonio::http::resolve_byte_range("bytes=-0", 10).kind == ByteRange::Kind::Unsatisfiable);
+    CHECK(polonio::http::resolve_byte_range("bytes=0-1,4-5", 10).kind == ByteRange::Kind::Whole);
+    CHECK(polonio::http::resolve_byte_range("items=0-1", 10).kind == ByteRange::Kind::Whole);
+    CHECK(polonio::http::resolve_byte_range("bytes=5-2", 10).kind == ByteRange::Kind::Whole);
+}
+
+TEST_CASE("Dev server answers byte ranges for static files") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_range"));
+    write_text_file(root / "digits.txt", "0123456789");
+    auto whole = perform_http_request_message(root, "GET", "/digits.txt", {});
+    CHECK(whole.header_value("Accept-Ranges") == "bytes");
+
+    auto partial = perform_http_request_message(root, "GET", "/digits.txt", {{"Range", "bytes=2-5"}});
+    CHECK(partial.status == 206);
+    CHECK(partial.body == "2345");
+    CHECK(partial.header_value("Content-Range") == "bytes 2-5/10");
+    CHECK(partial.header_value("Content-Length") == "4");
+
+    auto tail = perform_http_request_message(root, "GET", "/digits.txt", {{"Range", "bytes=7-"}});
+    CHECK(tail.status == 206);
+    CHECK(tail.body == "789");
+
+    auto beyond = perform_http_request_message(root, "GET", "/digits.txt", {{"Range", "bytes=20-"}});
+    CHECK(beyond.status == 416);
+    CHECK(beyond.body.empty());
+    CHECK(beyond.header_value("Content-Range") == "bytes */10");
+
+    auto current = perform_http_request_message(root, "GET", "/digits.txt",
+                                                {{"Range", "bytes=0-0"}, {"If-Range", whole.header_value("ETag")}});
+    CHECK(current.status == 206);
+    CHECK(current.body == "0");
+    auto stale = perform_http_request_message(root, "GET", "/digits.txt",
+                                              {{"Range", "bytes=0-0"}, {"If-Range", "\"stale\""}});
+    CHECK(stale.status == 200);
+    CHECK(stale.body == "0123456789");
+    std::filesystem::remove_all(root);
+}
+
 TEST_CASE("Dev server renders index.pol at root") {
     auto root = std::filesystem::path(create_temp_directory("polonio_serve_index"));
     write_text_file(root / "index.pol", "<h1>Hello</h1>");
@@ -1015,6 +1521,49 @@ TEST_CASE("Dev server handles POST form submissions") {
     std::filesystem::remove_all(root);
 }
 
+TEST_CASE("Dev server decodes chunked request bodies") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_chunked"));
+    write_text_file(root / "form.pol",
+                    "<% echo get(_POST, \"name\") %>|<% echo _SERVER[\"CONTENT_LENGTH\"] %>");
+    write_text_file(root / "json.pol", "<% echo get(request_json(), \"n\") %>");
+    std::vector<std::pair<std::string, std::string>> form_headers = {
+        {"Content-Type", "application/x-www-form-urlencoded"},
+        {"Transfer-Encoding", "chunked"},
+    };
+    auto form = perform_http_request_message(root, "POST", "/form.pol", form_headers,
+                                             "5;ext=1\r\nname=\r\n3\r\nAda\r\n0\r\nX-Trailer: t\r\n\r\n");
+    CHECK(form.status == 200);
+    CHECK(form.body == "Ada|8");
+
+    std::vector<std::pair<std::string, std::string>> json_headers = {
+        {"Content-Type", "application/json"},
+        {"Transfer-Encoding", "chunked"},
+    };
+    auto json = perform_http_request_message(root, "POST", "/json.pol", json_headers, "4\r\n{\"n\"\r\n3\r\n:42\r\n1\r\n}\r\n0\r\n\r\n");
+    CHECK(json.status == 200);
+    CHECK(json.body == "42");
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("RequestBody spools large bodies to disk") {
+    polonio::RequestBody body;
+    std::string expected;
+    std::string piece(10000, 'x');
+    for (int i = 0; i < 10; ++i) {
+        piece[0] = static_cast<char>('a' + i);
+        body.append(piece.data(), piece.size());
+        expected += piece;
+        if (expected.size() <= polonio::RequestBody::kDefaultMemoryLimit) {
+            CHECK_FALSE(body.spooled());
+        }
+    }
+    CHECK(body.spooled());
+    CHECK(body.size() == expected.size());
+    CHECK(body.view() == expected);
+    polonio::RequestBody copy = body;
+    CHECK(copy.str() == expected);
+}
+
 TEST_CASE("Dev server handles multipart uploads") {
     auto root = std::filesystem::path(create_temp_directory("polonio_serve_upload"));
     write_text_file(root / "upload.pol", "<% echo _FILES[\"file\"][\"name\"] %>");
@@ -1104,6 +1653,307 @@ TEST_CASE("Dev server rejects unsupported HTTP methods") {
     std::filesystem::remove_all(root);
 }
 
+TEST_CASE("Dev server keeps answering while a client stalls mid-request") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_workers"));
+    write_text_file(root / "hello.pol", "<% echo \"hi\" %>");
+    {
+        ServeProcess server(root, {"--workers", "2"});
+        int stalled = connect_loopback(server.port());
+        REQUIRE(stalled >= 0);
+        CHECK(send_text(stalled, "GET /hello.pol HTTP/1.1\r\n"));
+
+        auto response = parse_http_response(server.get("/hello.pol"));
+        CHECK(response.status == 200);
+        CHECK(response.body == "hi");
+
+        CHECK(send_text(stalled, "Host: localhost\r\nConnection: close\r\n\r\n"));
+        auto late = parse_http_response(read_until_closed(stalled));
+        close(stalled);
+        CHECK(late.status == 200);
+        CHECK(late.body == "hi");
+    }
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server waits for a free descriptor without spinning") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_emfile"));
+    write_text_file(root / "hello.txt", "hello");
+    {
+        ServeProcess server(root, {"--workers", "1"}, 24);
+        std::vector<int> clients;
+        for (int i = 0; i < 40; ++i) {
+            int fd = connect_loopback(server.port());
+            if (fd >= 0) {
+                clients.push_back(fd);
+            }
+        }
+        // Connections past the limit wait in the backlog meanwhile.
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        for (int fd : clients) {
+            close(fd);
+        }
+        auto response = parse_http_response(server.get("/hello.txt"));
+        CHECK(response.status == 200);
+        CHECK(response.body == "hello");
+        CHECK(server.stop() < 0.5);
+    }
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server keeps connections open between requests") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_keepalive"));
+    write_text_file(root / "a.pol", "<% echo \"A\" %>");
+    write_text_file(root / "b.txt", "B");
+    {
+        ServeProcess server(root);
+        int fd = connect_loopback(server.port());
+        REQUIRE(fd >= 0);
+        CHECK(send_text(fd, "GET /a.pol HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+        auto first = parse_http_response(read_one_response(fd));
+        CHECK(first.status == 200);
+        CHECK(first.body == "A");
+        CHECK(first.header_value("Connection") == "keep-alive");
+
+        CHECK(send_text(fd, "GET /b.txt HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n"));
+        auto second = parse_http_response(read_until_closed(fd));
+        close(fd);
+        CHECK(second.status == 200);
+        CHECK(second.body == "B");
+        CHECK(second.header_value("Connection") == "close");
+    }
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server streams flushed template output in chunks") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_stream"));
+    write_text_file(root / "page.pol", "<% http_header(\"X-Early\", \"yes\") %><h1>start</h1><% http_flush() %>rest");
+    write_text_file(root / "late.pol", "before<% http_flush() %><% http_status(404) %>");
+    auto response = perform_http_request_message(root, "GET", "/page.pol", {});
+    CHECK(response.status == 200);
+    CHECK(response.header_value("Transfer-Encoding") == "chunked");
+    CHECK(response.header_value("Content-Length").empty());
+    CHECK(response.header_value("X-Early") == "yes");
+    CHECK(response.body == "e\r\n<h1>start</h1>\r\n4\r\nrest\r\n0\r\n\r\n");
+
+    auto late = perform_http_request_message(root, "GET", "/late.pol", {});
+    CHECK(late.status == 200);
+    CHECK(late.body.find("before") != std::string::npos);
+    CHECK(late.body.find("headers already sent") != std::string::npos);
+    CHECK(late.body.find("0\r\n\r\n") == std::string::npos);
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server keeps a streamed connection alive") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_stream_live"));
+    write_text_file(root / "big.pol",
+                    "<% http_flush() %><% for i in range(3000) %><p>row <% echo i %></p><% end %>");
+    write_text_file(root / "b.txt", "B");
+    std::string expected;
+    for (int i = 0; i < 3000; ++i) {
+        expected += "<p>row " + std::to_string(i) + "</p>";
+    }
+    {
+        ServeProcess server(root);
+        int fd = connect_loopback(server.port());
+        REQUIRE(fd >= 0);
+        CHECK(send_text(fd, "GET /big.pol HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+        auto first = parse_http_response(read_chunked_response(fd));
+        CHECK(first.status == 200);
+        CHECK(first.header_value("Connection") == "keep-alive");
+        auto decoded = decode_chunked(first.body);
+        REQUIRE(decoded.has_value());
+        CHECK(*decoded == expected);
+
+        CHECK(send_text(fd, "GET /b.txt HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n"));
+        auto second = parse_http_response(read_until_closed(fd));
+        close(fd);
+        CHECK(second.status == 200);
+        CHECK(second.body == "B");
+    }
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server answers pipelined requests in order") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_pipeline"));
+    write_text_file(root / "echo.pol", "<% echo request_body() %>");
+    write_text_file(root / "last.txt", "last");
+    {
+        ServeProcess server(root);
+        int fd = connect_loopback(server.port());
+        REQUIRE(fd >= 0);
+        CHECK(send_text(fd,
+                        "POST /echo.pol HTTP/1.1\r\nHost: localhost\r\nContent-Length: 5\r\n\r\nfirst"
+                        "POST /echo.pol HTTP/1.1\r\nHost: localhost\r\nContent-Length: 6\r\n\r\nsecond"
+                        "GET /last.txt HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n"));
+        std::vector<std::string> bodies;
+        for (int i = 0; i < 3; ++i) {
+            bodies.push_back(parse_http_response(read_one_response(fd)).body);
+        }
+        CHECK(read_until_closed(fd).empty());
+        close(fd);
+        CHECK(bodies == std::vector<std::string>{"first", "second", "last"});
+    }
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server accepts large chunked uploads") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_chunked_upload"));
+    write_text_file(root / "upload.pol", "<% echo _FILES[\"file\"][\"size\"] %>");
+    std::string data;
+    for (std::size_t i = 0; i < 300 * 1024; ++i) {
+        data.push_back(static_cast<char>('a' + (i * 7) % 26));
+    }
+    MultipartPart part;
+    part.name = "file";
+    part.is_file = true;
+    part.filename = "large.txt";
+    part.data = data;
+    std::string boundary = "----PolonioBoundaryChunked";
+    std::string body = build_multipart_body(boundary, {part});
+    {
+        ServeProcess server(root);
+        int fd = connect_loopback(server.port());
+        REQUIRE(fd >= 0);
+        CHECK(send_text(fd, "POST /upload.pol HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n"
+                            "Content-Type: multipart/form-data; boundary=" +
+                                boundary + "\r\nTransfer-Encoding: chunked\r\n\r\n"));
+        for (std::size_t pos = 0; pos < body.size(); pos += 7000) {
+            std::string piece = body.substr(pos, 7000);
+            char size_line[32];
+            std::snprintf(size_line, sizeof(size_line), "%zx\r\n", piece.size());
+            CHECK(send_text(fd, size_line + piece + "\r\n"));
+        }
+        CHECK(send_text(fd, "0\r\n\r\n"));
+        auto response = parse_http_response(read_until_closed(fd));
+        close(fd);
+        CHECK(response.status == 200);
+        CHECK(response.body == std::to_string(data.size()));
+
+        fd = connect_loopback(server.port());
+        REQUIRE(fd >= 0);
+        CHECK(send_text(fd, "POST /upload.pol HTTP/1.1\r\nHost: localhost\r\n"
+                            "Transfer-Encoding: chunked\r\n\r\nzz\r\n"));
+        auto malformed = parse_http_response(read_until_closed(fd));
+        close(fd);
+        CHECK(malformed.status == 500);
+    }
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server keeps bodies read whole at the buffered limit") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_body_limit"));
+    write_text_file(root / "form.pol", "<% echo count(keys(_POST)) %>");
+    write_text_file(root / "raw.pol", "<% echo len(request_body()) %>");
+    MultipartPart part;
+    part.name = "file";
+    part.is_file = true;
+    part.filename = "large.bin";
+    part.data = std::string(polonio::RequestBody::kMaxBufferedBytes + 1024, 'x');
+    write_text_file(root / "upload.pol",
+                    "<% echo _FILES[\"file\"][\"size\"] == " + std::to_string(part.data.size()) + " %>");
+    std::string boundary = "----PolonioBoundaryLimit";
+    std::string body = build_multipart_body(boundary, {part});
+    auto post = [&](int port, const std::string& target, const std::string& content_type, const std::string& payload) {
+        int fd = connect_loopback(port);
+        REQUIRE(fd >= 0);
+        send_text(fd, "POST " + target + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\nContent-Type: " +
+                          content_type + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + payload);
+        auto response = parse_http_response(read_until_closed(fd));
+        close(fd);
+        return response;
+    };
+    {
+        ServeProcess server(root);
+        // Refused from the headers alone.
+        CHECK(post(server.port(), "/form.pol", "application/x-www-form-urlencoded", "").status == 500);
+
+        const std::string multipart = "multipart/form-data; boundary=" + boundary;
+        auto upload = post(server.port(), "/upload.pol", multipart, body);
+        CHECK(upload.status == 200);
+        CHECK(upload.body == "true");
+
+        auto raw = post(server.port(), "/raw.pol", multipart, body);
+        CHECK(raw.status == 500);
+        CHECK(raw.body.find("request body too large") != std::string::npos);
+    }
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server sends large static files intact and notices edits") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_sendfile"));
+    std::string large;
+    large.reserve(3 * 1024 * 1024 + 7);
+    for (std::size_t i = 0; i < 3 * 1024 * 1024 + 7; ++i) {
+        large.push_back(static_cast<char>('a' + (i * 7) % 26));
+    }
+    write_text_file(root / "large.txt", large);
+    write_text_file(root / "style.css", "body{}");
+    {
+        ServeProcess server(root);
+        auto response = parse_http_response(server.get("/large.txt"));
+        CHECK(response.status == 200);
+        CHECK(response.header_value("Content-Length") == std::to_string(large.size()));
+        CHECK(response.body == large);
+
+        CHECK(parse_http_response(server.get("/style.css")).body == "body{}");
+        write_text_file(root / "style.css", "body{color:red}");
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        auto edited = parse_http_response(server.get("/style.css"));
+        CHECK(edited.body == "body{color:red}");
+        CHECK(edited.header_value("Content-Length") == "15");
+    }
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server idle connections do not hold up a single worker") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_idle"));
+    write_text_file(root / "hello.pol", "<% echo \"hi\" %>");
+    {
+        ServeProcess server(root, {"--workers", "1"});
+        std::vector<int> idle;
+        for (int i = 0; i < 64; ++i) {
+            int fd = connect_loopback(server.port());
+            REQUIRE(fd >= 0);
+            CHECK(send_text(fd, "GET /hello.pol HTTP/1.1\r\nHost: local"));
+            idle.push_back(fd);
+        }
+        auto response = parse_http_response(server.get("/hello.pol"));
+        CHECK(response.status == 200);
+        CHECK(response.body == "hi");
+        for (int fd : idle) {
+            close(fd);
+        }
+    }
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Dev server workers run requests concurrently with per-request storage") {
+    auto root = std::filesystem::path(create_temp_directory("polonio_serve_concurrent"));
+    write_text_file(root / "echo.pol",
+                    "<% var marker = _GET[\"m\"] %>"
+                    "<% file_write(\"seen-\" .. marker .. \".txt\", marker) %>"
+                    "<% echo file_read(\"seen-\" .. marker .. \".txt\") %>");
+    {
+        ServeProcess server(root, {"--workers", "3"});
+        std::vector<std::string> bodies(6);
+        std::vector<std::thread> clients;
+        for (std::size_t i = 0; i < bodies.size(); ++i) {
+            clients.emplace_back([&server, &bodies, i] {
+                bodies[i] = parse_http_response(server.get("/echo.pol?m=r" + std::to_string(i))).body;
+            });
+        }
+        for (auto& client : clients) {
+            client.join();
+        }
+        for (std::size_t i = 0; i < bodies.size(); ++i) {
+            CAPTURE(i);
+            CHECK(bodies[i] == "r" + std::to_string(i));
+            CHECK(std::filesystem::exists(root / ("seen-r" + std::to_string(i) + ".txt")));
+        }
+    }
+    std::filesystem::remove_all(root);
+}
+
 TEST_CASE("CGI redirect builtin sets Location header") {
     auto path = create_temp_file_with_content("polonio_cgi_redirect", "<% redirect(\"/login\") %>");
     std::vector<std::pair<std::string, std::string>> env = {
@@ -1829,6 +2679,195 @@ TEST_CASE("db_connect insert and query") {
     std::filesystem::remove_all(dir);
 }
 
+TEST_CASE("db statements are reused from the connection cache") {
+    auto dir = std::filesystem::path(create_temp_directory("polonio_sqlite_statement_cache"));
+    std::filesystem::create_directories(dir / "data");
+    auto page = dir / "page.pol";
+    write_text_file(page,
+                    "<% db_connect(\"data/app.db\") %>"
+                    "<% db_exec(\"create table t (n integer)\") %>"
+                    "<% for i in range(20) %><% db_exec(\"insert into t(n) values(?)\", [i]) %><% end %>"
+                    "<% for i in range(5) %><% echo count(db_query(\"select n from t where n < ?\", [i])) %><% end %>"
+                    "<% attempt db_query(\"select missing from t\") recover error end %>");
+    polonio::Interpreter interpreter(std::make_shared<polonio::Env>(), page.string());
+    interpreter.set_storage_root(dir.string());
+    CHECK(polonio::render_template_file(page.string(), interpreter) == "01234");
+    auto stats = interpreter.db_connection()->statement_cache_stats();
+    CHECK(stats.misses == 4);
+    CHECK(stats.hits == 23);
+    CHECK(stats.entries == 3);
+
+    interpreter.db_connection()->close();
+    CHECK(interpreter.db_connection()->statement_cache_stats().entries == 0);
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("db connections are pooled across interpreters") {
+    auto dir = std::filesystem::path(create_temp_directory("polonio_sqlite_pool"));
+    std::filesystem::create_directories(dir / "data");
+    auto run = [&](const std::string& source) {
+        auto page = dir / "page.pol";
+        write_text_file(page, source);
+        polonio::Interpreter interpreter(std::make_shared<polonio::Env>(), page.string());
+        interpreter.set_storage_root(dir.string());
+        return polonio::render_template_file(page.string(), interpreter);
+    };
+
+    auto before = polonio::DatabasePool::shared().stats();
+    CHECK(run("<% db_connect(\"data/app.db\") %><% db_exec(\"create table t (n integer)\") %>ok") == "ok");
+    // A transaction left open is rolled back when the handle is returned.
+    CHECK(run("<% db_connect(\"data/app.db\") %><% db_begin() %>"
+              "<% db_exec(\"insert into t(n) values(1)\") %>open") == "open");
+    CHECK(run("<% db_connect(\"data/app.db\") %><% db_begin() %>"
+              "<% echo count(db_query(\"select n from t\")) %><% db_commit() %>") == "0");
+    auto after = polonio::DatabasePool::shared().stats();
+    CHECK(after.opened == before.opened + 1);
+    CHECK(after.reused == before.reused + 2);
+
+    // A pooled handle is not reused once its file has been replaced.
+    std::filesystem::remove(dir / "data" / "app.db");
+    CHECK(run("<% db_connect(\"data/app.db\") %><% echo count(db_query(\"select name from sqlite_master\")) %>") ==
+          "0");
+    CHECK(polonio::DatabasePool::shared().stats().opened == after.opened + 1);
+
+    polonio::DatabasePool capped(1, std::chrono::milliseconds(20));
+    auto path = (dir / "data" / "capped.db").string();
+    polonio::DatabasePool::Handle first;
+    polonio::DatabasePool::Handle second;
+    REQUIRE(capped.acquire(path, first) == polonio::DatabasePool::Status::Ok);
+    CHECK(capped.acquire(path, second) == polonio::DatabasePool::Status::Exhausted);
+    sqlite3* db = first.db;
+    capped.release(path, std::move(first));
+    REQUIRE(capped.acquire(path, second) == polonio::DatabasePool::Status::Ok);
+    CHECK(second.db == db);
+    capped.release(path, std::move(second));
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("db pooled handles start each request clean") {
+    auto dir = std::filesystem::path(create_temp_directory("polonio_sqlite_pool_clean"));
+    std::filesystem::create_directories(dir / "data");
+    auto run = [&](const std::string& source) {
+        auto page = dir / "page.pol";
+        write_text_file(page, "<% db_connect(\"data/app.db\") %>" + source);
+        polonio::Interpreter interpreter(std::make_shared<polonio::Env>(), page.string());
+        interpreter.set_storage_root(dir.string());
+        return polonio::render_template_file(page.string(), interpreter);
+    };
+
+    CHECK(run("<% db_exec(\"create table t (n integer)\") %><% db_exec(\"insert into t(n) values(1)\") %>"
+              "<% echo db_last_insert_id() %>") == "1");
+    auto before = polonio::DatabasePool::shared().stats();
+    CHECK(run("<% echo db_last_insert_id() %>,<% echo db_exec(\"select n from t\") %>") == "0,0");
+    CHECK(polonio::DatabasePool::shared().stats().reused == before.reused + 1);
+
+    // Handles holding TEMP objects, attached databases, or changed PRAGMAs
+    // are closed instead of lent to the next request.
+    before = polonio::DatabasePool::shared().stats();
+    CHECK(run("<% db_exec(\"create temp table scratch (n integer)\") %>temp") == "temp");
+    CHECK(run("<% echo count(db_query(\"select name from temp.sqlite_master\")) %>") == "0");
+    CHECK(run("<% db_exec(\"attach database ':memory:' as extra\") %>attached") == "attached");
+    CHECK(run("<% echo count(db_query(\"pragma database_list\")) %>") == "1");
+    CHECK(run("<% db_exec(\"pragma foreign_keys = on\") %>pragma") == "pragma");
+    CHECK(run("<% echo db_query(\"pragma foreign_keys\")[0][\"foreign_keys\"] %>") == "0");
+    auto after = polonio::DatabasePool::shared().stats();
+    CHECK(after.opened == before.opened + 3);
+    CHECK(after.reused == before.reused + 3);
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("db_connect applies performance options") {
+    auto dir = std::filesystem::temp_directory_path() / "polonio_sqlite_options";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    auto env = storage_env(dir.string());
+    auto pragma = [](const std::string& name) {
+        // PRAGMA busy_timeout names its result column "timeout".
+        std::string column = name == "busy_timeout" ? "timeout" : name;
+        return "<% echo db_query(\"pragma " + name + "\")[0][\"" + column + "\"] %>,";
+    };
+    auto defaults = create_temp_file_with_content(
+        "polonio_sqlite_options_defaults",
+        "<% dir_create(\"data\") %><% db_connect(\"data/app.db\") %>" + pragma("journal_mode") +
+            pragma("synchronous") + pragma("busy_timeout") + pragma("temp_store") + pragma("cache_size"));
+    auto result = run_polonio({"run", defaults}, env);
+    CHECK(result.exit_code == 0);
+    CHECK(result.stdout_output == "wal,1,5000,2,-8192,");
+
+    auto custom = create_temp_file_with_content(
+        "polonio_sqlite_options_custom",
+        "<% db_connect(\"data/other.db\", {\"journal_mode\": \"DELETE\", \"synchronous\": \"full\", "
+        "\"busy_timeout\": 250, \"cache_size\": 500, \"mmap_size\": 0, \"temp_store\": \"file\"}) %>" +
+            pragma("journal_mode") + pragma("synchronous") + pragma("busy_timeout") + pragma("temp_store") +
+            pragma("cache_size") + pragma("mmap_size"));
+    result = run_polonio({"run", custom}, env);
+    CHECK(result.exit_code == 0);
+    CHECK(result.stdout_output == "delete,2,250,1,500,0,");
+
+    auto invalid = create_temp_file_with_content(
+        "polonio_sqlite_options_invalid", "<% db_connect(\"data/app.db\", {\"synchronous\": \"sometimes\"}) %>");
+    result = run_polonio({"run", invalid}, env);
+    CHECK(result.exit_code != 0);
+    CHECK(result.stderr_output.find("synchronous must be one of off, normal, full, extra") != std::string::npos);
+    std::filesystem::remove(defaults);
+    std::filesystem::remove(custom);
+    std::filesystem::remove(invalid);
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("db rows follow the statement's sorted column layout, last duplicate winning") {
+    auto dir = std::filesystem::temp_directory_path() / "polonio_sqlite_row_schema";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    auto env = storage_env(dir.string());
+    auto program = create_temp_file_with_content(
+        "polonio_sqlite_row_schema_program",
+        "<% dir_create(\"data\") %>"
+        "<% db_connect(\"data/app.db\") %>"
+        "<% var rows = db_query(\"select 1 as b, 2 as a, 3 as b union all select 4, 5, 6\") %>"
+        "<% var first = rows[0] %><% set(first, \"c\", 7) %>"
+        "<% for k, v in first %><% echo k .. v %><% end %>,"
+        "<% for k, v in rows[1] %><% echo k .. v %><% end %>|"
+        "<% for row in db_cursor(\"select 'x' as z, 'y' as w\") %><% for k, v in row %><% echo k .. v %><% end %><% end %>");
+    auto result = run_polonio({"run", program}, env);
+    CHECK(result.exit_code == 0);
+    CHECK(result.stdout_output == "a2b3c7,a5b6|wyzx");
+    std::filesystem::remove(program);
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("db_cursor streams rows through for loops") {
+    auto dir = std::filesystem::temp_directory_path() / "polonio_sqlite_cursor";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    auto env = storage_env(dir.string());
+    auto program = create_temp_file_with_content(
+        "polonio_sqlite_cursor_program",
+        "<% dir_create(\"data\") %>"
+        "<% db_connect(\"data/app.db\") %>"
+        "<% db_exec(\"create table t (n integer)\") %>"
+        "<% db_begin() %>"
+        "<% for i in range(1500) %><% db_exec(\"insert into t(n) values(?)\", [i]) %><% end %>"
+        "<% db_commit() %>"
+        "<% var rows = db_cursor(\"select n from t where n >= ? order by n\", [500]) %>"
+        "<% echo type(rows) %>,"
+        "<% var total = 0 %><% var last = -1 %>"
+        "<% for i, row in rows %><% total = total + row[\"n\"] %><% last = i %><% end %>"
+        "<% echo total %>,<% echo last %>,"
+        "<% var again = 0 %><% for row in rows %><% again = again + 1 %><% end %>"
+        "<% echo again %>,"
+        "<% function first(cursor) for row in cursor return row[\"n\"] end return -1 end %>"
+        "<% var partial = db_cursor(\"select n from t order by n\") %>"
+        "<% echo first(partial) %>,"
+        "<% db_close() %>"
+        "<% attempt for row in partial end recover error echo error[\"message\"] end %>");
+    auto result = run_polonio({"run", program}, env);
+    CHECK(result.exit_code == 0);
+    CHECK(result.stdout_output == "cursor,999500,999,0,0,db_cursor: database connection closed");
+    std::filesystem::remove(program);
+    std::filesystem::remove_all(dir);
+}
+
 TEST_CASE("db_last_insert_id returns value") {
     auto dir = std::filesystem::temp_directory_path() / "polonio_sqlite_last_id";
     std::filesystem::remove_all(dir);
@@ -2128,6 +3167,72 @@ TEST_CASE("send_file serves basic text file via CGI") {
     std::filesystem::remove_all(dir);
 }
 
+TEST_CASE("send_file answers byte ranges via CGI") {
+    auto dir = std::filesystem::temp_directory_path() / "polonio_send_file_range";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "files");
+    {
+        std::ofstream file(dir / "files/digits.txt", std::ios::binary);
+        file << "0123456789";
+    }
+    const std::string program = "<% send_file(\"files/digits.txt\") %>";
+    auto env = storage_env(dir.string());
+    env.push_back({"HTTP_RANGE", "bytes=3-5"});
+    auto partial = run_cgi_template("polonio_send_file_range_partial", program, env);
+    CHECK(partial.stdout_output.find("Status: 206") != std::string::npos);
+    CHECK(partial.stdout_output.find("Content-Range: bytes 3-5/10") != std::string::npos);
+    CHECK(response_body(partial.stdout_output) == "345");
+
+    env.back() = {"HTTP_RANGE", "bytes=10-"};
+    auto unsatisfiable = run_cgi_template("polonio_send_file_range_416", program, env);
+    CHECK(unsatisfiable.stdout_output.find("Status: 416") != std::string::npos);
+    CHECK(unsatisfiable.stdout_output.find("Content-Range: bytes */10") != std::string::npos);
+    CHECK(response_body(unsatisfiable.stdout_output).empty());
+
+    env.back() = {"HTTP_RANGE", "bytes=-4"};
+    env.push_back({"HTTP_IF_RANGE", "\"old\""});
+    auto conditional = run_cgi_template("polonio_send_file_range_if_range", program, env);
+    CHECK(conditional.stdout_output.find("Status: 206") == std::string::npos);
+    CHECK(response_body(conditional.stdout_output) == "0123456789");
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("send_file_range stops at a file truncated while served") {
+    auto dir = std::filesystem::path(create_temp_directory("polonio_send_file_truncated"));
+    auto path = dir / "grow.txt";
+    write_text_file(path, std::string(4096, 'x'));
+    polonio::FileCache cache;
+    auto file = cache.open(path);
+    REQUIRE(file);
+    std::filesystem::resize_file(path, 10);
+
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    CHECK(polonio::send_file_range(fds[0], *file, 100, 1000) == 0);
+    CHECK(polonio::send_file_range(fds[0], *file, 0, 1000) == 10);
+    char buffer[16];
+    CHECK(::recv(fds[1], buffer, sizeof(buffer), 0) == 10);
+    ::close(fds[0]);
+    ::close(fds[1]);
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("CompressedCache reads a file truncated while compressed without faulting") {
+    auto dir = std::filesystem::path(create_temp_directory("polonio_compress_truncated"));
+    auto path = dir / "site.css";
+    write_text_file(path, std::string(1024 * 1024, 'x'));
+    polonio::FileCache files;
+    auto file = files.open(path);
+    REQUIRE(file);
+    std::filesystem::resize_file(path, 10);
+
+    polonio::CompressedCache cache;
+    auto bytes = cache.get(path.string(), *file, polonio::ContentCoding::Gzip);
+    REQUIRE(bytes);
+    CHECK(inflate_body(*bytes) == std::string(10, 'x'));
+    std::filesystem::remove_all(dir);
+}
+
 TEST_CASE("send_file supports custom content type") {
     auto dir = std::filesystem::temp_directory_path() / "polonio_send_file_ct";
     std::filesystem::remove_all(dir);
@@ -2586,6 +3691,101 @@ echo file_exists(f["tmp_path"])
     std::filesystem::remove_all(dir);
 }
 
+TEST_CASE("MultipartParser finds boundaries split across pieces") {
+    std::string boundary = "----PolonioBoundaryParser";
+    std::string tricky = "line\r\n----PolonioBoundaryPars\r\n--" + std::string(5000, 'z');
+    auto body = build_multipart_body(boundary, {
+        {"note", false, "", "", "hello"},
+        {"upload", true, "a.bin", "application/octet-stream", tricky},
+    });
+    for (std::size_t piece : {std::size_t(1), std::size_t(7), std::size_t(4096), body.size()}) {
+        std::vector<std::pair<polonio::http::MultipartParser::PartHeaders, std::string>> parts;
+        polonio::http::MultipartParser::Handler handler;
+        handler.begin_part = [&](const polonio::http::MultipartParser::PartHeaders& headers) {
+            parts.emplace_back(headers, std::string());
+        };
+        handler.part_data = [&](const char* data, std::size_t size) { parts.back().second.append(data, size); };
+        handler.end_part = [] {};
+        polonio::http::MultipartParser parser(boundary, handler);
+        for (std::size_t pos = 0; pos < body.size(); pos += piece) {
+            parser.feed(body.data() + pos, std::min(piece, body.size() - pos));
+        }
+        parser.finish();
+        REQUIRE(parts.size() == 2);
+        CHECK(parts[0].first.name == "note");
+        CHECK(parts[0].second == "hello");
+        CHECK(parts[1].first.filename == "a.bin");
+        CHECK(parts[1].first.content_type == "application/octet-stream");
+        CHECK(parts[1].second == tricky);
+    }
+
+    polonio::http::MultipartParser::Handler ignore;
+    ignore.begin_part = [](const polonio::http::MultipartParser::PartHeaders&) {};
+    ignore.part_data = [](const char*, std::size_t) {};
+    ignore.end_part = [] {};
+    polonio::http::MultipartParser truncated(boundary, ignore);
+    truncated.feed(body.data(), body.size() / 2);
+    CHECK_THROWS_AS(truncated.finish(), std::runtime_error);
+    polonio::http::MultipartParser wrong_start(boundary, ignore);
+    CHECK_THROWS_AS(wrong_start.feed("--other-boundary\r\n", 19), std::runtime_error);
+}
+
+TEST_CASE("multipart truncated body is rejected") {
+    auto dir = std::filesystem::temp_directory_path() / "polonio_multipart_truncated";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    std::string boundary = "----PolonioBoundaryTest";
+    auto body = build_multipart_body(boundary, {{"upload", true, "a.txt", "text/plain", std::string(1000, 'a')}});
+    body.resize(body.size() - 40);
+    std::vector<std::pair<std::string, std::string>> env = {
+        {"REQUEST_METHOD", "POST"},
+        {"CONTENT_TYPE", std::string("multipart/form-data; boundary=") + boundary},
+        {"CONTENT_LENGTH", std::to_string(body.size())},
+        {"POLONIO_STORAGE_PATH", dir.string()},
+    };
+    auto result = run_cgi_template("polonio_multipart_truncated", "<% echo \"noop\" %>", env, body);
+    CHECK(result.exit_code != 0);
+    CHECK(result.stdout_output.find("invalid multipart body") != std::string::npos);
+    CHECK(std::filesystem::is_empty(dir / "tmp" / "uploads"));
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("CGI http_etag answers 304 without a body") {
+    const std::string program = "<% if not http_etag(\"W/\\\"rev-7\\\"\") %>full page<% end %>";
+    auto fresh = run_cgi_template("polonio_cgi_etag_fresh", program, {});
+    auto parsed = parse_cgi_output(fresh.stdout_output);
+    CHECK(parsed.headers.find("ETag: W/\"rev-7\"") != std::string::npos);
+    CHECK(parsed.body == "full page");
+
+    auto cached = run_cgi_template("polonio_cgi_etag_cached", program, {{"HTTP_IF_NONE_MATCH", "\"rev-7\""}});
+    auto cached_parsed = parse_cgi_output(cached.stdout_output);
+    CHECK(cached_parsed.headers.find("Status: 304") != std::string::npos);
+    CHECK(cached_parsed.body.empty());
+
+    auto posted = run_cgi_template("polonio_cgi_etag_post", program,
+                                   {{"REQUEST_METHOD", "POST"}, {"HTTP_IF_NONE_MATCH", "\"rev-7\""}});
+    auto posted_parsed = parse_cgi_output(posted.stdout_output);
+    CHECK(posted_parsed.headers.find("Status: 304") == std::string::npos);
+    CHECK(posted_parsed.body == "full page");
+
+    auto invalid = run_cgi_template("polonio_cgi_etag_invalid", "<% http_etag(\"a b\") %>", {});
+    CHECK(invalid.stdout_output.find("http_etag: invalid tag") != std::string::npos);
+}
+
+TEST_CASE("CGI http_flush sends headers before the rest of the page") {
+    auto result = run_cgi_template("polonio_cgi_flush",
+                                   "<% http_content_type(\"text/plain\") %>one<% http_flush() %>two"
+                                   "<% http_header(\"X-Late\", \"no\") %>");
+    auto parsed = parse_cgi_output(result.stdout_output);
+    CHECK(parsed.headers.find("Content-Type: text/plain") != std::string::npos);
+    CHECK(parsed.body.find("onetwo") == 0);
+    CHECK(parsed.body.find("headers already sent") != std::string::npos);
+    CHECK(result.stdout_output.find("Status: 500") == std::string::npos);
+
+    CHECK(run_program_output("attempt http_flush() recover error echo get(error, \"category\") end") ==
+          "CapabilityError");
+}
+
 TEST_CASE("CGI header builtin validates syntax") {
     auto path = create_temp_file_with_content("polonio_cgi_header_bad",
                                               "<% http_header(\"bad header\") %>");
@@ -2719,6 +3919,8 @@ TEST_CASE("CLI: serve --help prints serve help without starting") {
     CHECK(result.stdout_output.find("Usage: polonio serve") != std::string::npos);
     CHECK(result.stdout_output.find("--root DIR") != std::string::npos);
     CHECK(result.stdout_output.find("--port N") != std::string::npos);
+    CHECK(result.stdout_output.find("--workers N") != std::string::npos);
+    CHECK(result.stdout_output.find("--no-compress") != std::string::npos);
 }
 
 TEST_CASE("CLI: serve -h prints serve help") {
@@ -2736,6 +3938,10 @@ TEST_CASE("CLI: serve rejects invalid options, ports, and roots") {
     CHECK(invalid_port.exit_code != 0);
     CHECK(invalid_port.stderr_output.find("port must be") != std::string::npos);
 
+    auto invalid_workers = run_polonio({"serve", "--workers", "0"});
+    CHECK(invalid_workers.exit_code != 0);
+    CHECK(invalid_workers.stderr_output.find("workers must be") != std::string::npos);
+
     auto missing_root = run_polonio({"serve", "--root", "/tmp/polonio-missing-root-for-cli-test"});
     CHECK(missing_root.exit_code != 0);
     CHECK(missing_root.stderr_output.find("root directory not found") != std::string::npos);
@@ -2755,6 +3961,19 @@ TEST_CASE("CLI: run with extra args errors") {
     CHECK(result.stderr_output.find("Usage:") != std::string::npos);
 }
 
+TEST_CASE("CLI: run --engine selects the execution engine") {
+    auto script = create_temp_file_with_content("polonio_cli_engine", "function sq(n) return n * n end echo sq(7)");
+    auto vm = run_polonio({"run", "--engine=vm", script});
+    CHECK(vm.exit_code == 0);
+    CHECK(vm.stdout_output == "49");
+    auto ast = run_polonio({"run", "--engine=ast", script});
+    CHECK(ast.stdout_output == "49");
+    auto unknown = run_polonio({"run", "--engine=jit", script});
+    CHECK(unknown.exit_code != 0);
+    CHECK(unknown.stderr_output.find("unknown engine") != std::string::npos);
+    std::filesystem::remove(script);
+}
+
 TEST_CASE("CLI: flag-like arg is treated as unknown command") {
     auto result = run_polonio({"--help"});
     CHECK(result.exit_code != 0);
@@ -3186,6 +4405,95 @@ TEST_CASE("Parser parses object literals") {
           "object(\"name\": str(\"Juan\"), \"age\": num(42))");
 }
 
+TEST_CASE("Parser decodes literal constants once") {
+    auto parse = [](const std::string& input) {
+        polonio::Lexer lexer(input, "<expr>");
+        polonio::Parser parser(lexer.scan_all(), "<expr>");
+        return parser.parse_expression();
+    };
+    auto number = std::dynamic_pointer_cast<polonio::LiteralExpr>(parse("12.5"));
+    REQUIRE(number);
+    CHECK(number->value() == polonio::Value(12.5));
+    CHECK(number->dump() == "num(12.5)");
+    auto text = std::dynamic_pointer_cast<polonio::LiteralExpr>(parse("\"a\\tb\""));
+    REQUIRE(text);
+    CHECK(text->value() == polonio::Value("a\tb"));
+    CHECK(text->dump() == "str(\"a\\tb\")");
+    auto flag = std::dynamic_pointer_cast<polonio::LiteralExpr>(parse("false"));
+    REQUIRE(flag);
+    CHECK(flag->value() == polonio::Value(false));
+    auto object = std::dynamic_pointer_cast<polonio::ObjectLiteralExpr>(parse("{\"a\\nb\": null}"));
+    REQUIRE(object);
+    CHECK(object->keys() == std::vector<std::string>{"a\nb"});
+    CHECK_THROWS_AS(parse(std::string(400, '9')), polonio::PolonioError);
+}
+
+TEST_CASE("AST nodes carry their node kind") {
+    polonio::Lexer lexer("var x = 1 x += f(2)[0] for v in [] end", "test.pol");
+    polonio::Parser parser(lexer.scan_all(), "test.pol");
+    auto program = parser.parse_program();
+    REQUIRE(program.statements().size() == 3);
+    CHECK(program.statements()[0]->kind() == polonio::StmtKind::VarDecl);
+    CHECK(program.statements()[1]->kind() == polonio::StmtKind::Expr);
+    CHECK(program.statements()[2]->kind() == polonio::StmtKind::For);
+    const auto& stmt = static_cast<const polonio::ExprStmt&>(*program.statements()[1]);
+    REQUIRE(stmt.expr()->kind() == polonio::ExprKind::Assignment);
+    const auto& assignment = static_cast<const polonio::AssignmentExpr&>(*stmt.expr());
+    CHECK(assignment.target()->kind() == polonio::ExprKind::Identifier);
+    CHECK(assignment.value()->kind() == polonio::ExprKind::Index);
+}
+
+TEST_CASE("Parser resolves operators once") {
+    auto parse = [](const std::string& input) {
+        polonio::Lexer lexer(input, "<expr>");
+        polonio::Parser parser(lexer.scan_all(), "<expr>");
+        return parser.parse_expression();
+    };
+    auto concat = std::static_pointer_cast<polonio::BinaryExpr>(parse("a .. -b"));
+    CHECK(concat->op() == polonio::BinaryOp::Concat);
+    CHECK(std::static_pointer_cast<polonio::UnaryExpr>(concat->right())->op() == polonio::UnaryOp::Negate);
+    auto compound = std::static_pointer_cast<polonio::AssignmentExpr>(parse("total ..= 1 % 2"));
+    CHECK(compound->op() == polonio::AssignOp::Concat);
+    CHECK(std::static_pointer_cast<polonio::BinaryExpr>(compound->value())->op() == polonio::BinaryOp::Modulo);
+    CHECK(compound->dump() == "assign(ident(total), ..=, (% num(1) num(2)))");
+}
+
+TEST_CASE("Resolver assigns slots to function and loop locals") {
+    polonio::Lexer lexer("var g = 1 function f(a) var b = a for v in [b] echo v .. a .. g end end", "test.pol");
+    polonio::Parser parser(lexer.scan_all(), "test.pol");
+    auto program = parser.parse_program();
+    auto global = std::static_pointer_cast<polonio::VarDeclStmt>(program.statements()[0]);
+    CHECK(global->slot().index == polonio::SlotRef::kOutside);
+    auto fn = std::static_pointer_cast<polonio::FunctionStmt>(program.statements()[1]);
+    REQUIRE(fn->scope());
+    CHECK(fn->scope()->names == std::vector<std::string>{"a", "f", "b"});
+    CHECK(fn->scope()->bindings == std::vector<std::uint32_t>{0, 1});
+    auto loop = std::static_pointer_cast<polonio::ForStmt>(fn->body()[1]);
+    REQUIRE(loop->scope());
+    auto echo = std::static_pointer_cast<polonio::EchoStmt>(loop->body()[0]);
+    auto outer = std::static_pointer_cast<polonio::BinaryExpr>(echo->expr());
+    auto inner = std::static_pointer_cast<polonio::BinaryExpr>(outer->left());
+    auto v = std::static_pointer_cast<polonio::IdentifierExpr>(inner->left())->slot();
+    auto a = std::static_pointer_cast<polonio::IdentifierExpr>(inner->right())->slot();
+    auto g = std::static_pointer_cast<polonio::IdentifierExpr>(outer->right())->slot();
+    CHECK((v.depth == 0 && v.index == 0));
+    CHECK((a.depth == 1 && a.index == 0));
+    CHECK((g.depth == 2 && g.index == polonio::SlotRef::kOutside));
+}
+
+TEST_CASE("Resolved locals keep dynamic scoping rules") {
+    CHECK(run_program_output("var x = \"g\" function f() if false var x = \"l\" end return x end echo f()") == "g");
+    CHECK(run_program_output("function f() var out = \"\" var i = 0 while i < 2 if i > 0 out ..= x end var x = i i += 1 end return out end echo f()") == "0");
+    CHECK(run_program_output("function f(a, a) return a end echo f(1, 2)") == "2");
+    CHECK(run_program_output("var x = 1 function f() x = 2 end f() echo x") == "2");
+}
+
+TEST_CASE("For loops start each iteration with a clean scope") {
+    CHECK(run_program_output("var x = \"g\" for v in [1, 2] if v == 2 echo x end var x = v end") == "g");
+    CHECK(run_program_output("var fs = [] for v in [1, 2, 3] if v != 2 function get() return v end push(fs, get) end end "
+                             "echo fs[0]() .. fs[1]()") == "13");
+}
+
 TEST_CASE("Parser handles nested array/object combinations") {
     CHECK(parse_expr("[{\"name\": \"Juan\"}, 42]") ==
           "array(object(\"name\": str(\"Juan\")), num(42))");
@@ -3277,6 +4585,61 @@ std::string run_program_output(const std::string& input) {
     return interpreter.output();
 }
 
+polonio::Program parse_test_program(const std::string& input) {
+    polonio::Lexer lexer(input, "test.pol");
+    auto tokens = lexer.scan_all();
+    polonio::Parser parser(tokens, "test.pol");
+    return parser.parse_program();
+}
+
+TEST_CASE("Interpreters share a frozen builtin scope") {
+    auto program = parse_test_program("len = 7\necho len");
+    polonio::Interpreter first;
+    first.exec_program(program);
+    CHECK(first.output() == "7");
+
+    polonio::Interpreter second;
+    second.exec_program(parse_test_program("echo len(\"ab\")"));
+    CHECK(second.output() == "2");
+    CHECK(polonio::builtin_environment()->frozen());
+    CHECK(std::holds_alternative<polonio::BuiltinFunction>(
+        polonio::builtin_environment()->find("len")->storage()));
+
+    // Linking is the caller's choice, not inferred from the names in scope.
+    auto globals = std::make_shared<polonio::Env>();
+    globals->set_local("type", polonio::Value("mine"));
+    auto scope = std::make_shared<polonio::Env>(globals);
+    polonio::Interpreter nested(scope);
+    nested.exec_program(parse_test_program("echo type .. len(\"abc\")"));
+    CHECK(nested.output() == "mine3");
+    CHECK(globals->parent() == polonio::builtin_environment());
+
+    polonio::Interpreter bare(std::make_shared<polonio::Env>(), "bare.pol", false);
+    CHECK_THROWS_AS(bare.exec_program(parse_test_program("echo len(\"ab\")")), polonio::PolonioError);
+}
+
+TEST_CASE("Interpreter pool resets interpreters between leases") {
+    polonio::InterpreterPool pool(1);
+    {
+        auto lease = pool.acquire("first.pol");
+        lease->exec_program(parse_test_program("var secret = \"kept\"\necho secret"));
+        CHECK(lease->output() == "kept");
+        CHECK(lease->path() == "first.pol");
+    }
+    CHECK(pool.idle() == 1);
+    {
+        auto lease = pool.acquire("second.pol");
+        CHECK(pool.idle() == 0);
+        CHECK(lease->path() == "second.pol");
+        CHECK(lease->output().empty());
+        CHECK(lease->env()->find("secret") == nullptr);
+        auto other = pool.acquire("third.pol");
+        other->exec_program(parse_test_program("echo len(\"abc\")"));
+        CHECK(other->output() == "3");
+    }
+    CHECK(pool.idle() == 1);
+}
+
 TEST_CASE("RFC 0007 lexer reserves attempt and recover without reserving substrings") {
     polonio::Lexer lexer("attempt recover attempt_count recovery recoverable Attempt");
     CHECK(kinds(lexer.scan_all()) == std::vector<polonio::TokenKind>{
@@ -3835,6 +5198,104 @@ echo x(1)
     CHECK(threw);
 }
 
+TEST_CASE("VM engine matches the AST interpreter") {
+    auto run = [](const std::string& input, polonio::ExecutionEngine engine) {
+        polonio::Lexer lexer(input, "test.pol");
+        auto tokens = lexer.scan_all();
+        polonio::Parser parser(tokens, "test.pol");
+        auto program = parser.parse_program();
+        polonio::Interpreter interpreter(std::make_shared<polonio::Env>(), "test.pol");
+        interpreter.set_engine(engine);
+        try {
+            interpreter.exec_program(program);
+        } catch (const polonio::PolonioError& err) {
+            return interpreter.output() + "!" + err.message();
+        }
+        return interpreter.output();
+    };
+    const std::vector<std::string> programs = {
+        "var x = 7 x += 3 x -= 1 x *= 2 x /= 3 x %= 4 var s = \"a\" s ..= 1 echo x .. s .. (-x) .. (not x)",
+        "echo (1 < 2) .. (2 <= 1) .. (\"b\" > \"a\") .. (1 == 1) .. ([1] != [1]) .. (false or 0) .. (1 and null)",
+        "function fib(n) if n < 2 return n end return fib(n - 1) + fib(n - 2) end echo fib(15)",
+        "var total = 0 for i, v in [4, 5, 6] total += i * v end for k, v in {\"b\": 2, \"a\": 1} echo k .. v end echo total",
+        "var a = [1] for v in a if len(a) < 4 push(a, v + 1) end echo v end var n = 0 while n < 3 n += 1 echo n end",
+        "function f() for v in [1, 2, 3] attempt if v == 2 return v * 10 end file_read(\"nope.txt\") recover e echo e[\"category\"] end end end echo f()",
+        "var o = {\"x\": [1, {\"y\": \"z\"}]} echo o[\"x\"][1][\"y\"] .. o[\"missing\"] .. type(o) .. json_encode(o)",
+        "attempt var v = file_read(\"nope.txt\") recover error echo error[\"function\"] end attempt echo \"ok\" recover echo \"no\" end",
+        "attempt var v = [1][5] recover echo \"no\" end",
+        "function make() var n = 0 function next() n += 1 return n end return next end var c = make() echo c() .. c()",
+        "echo 1 echo 1 / 0",
+        "echo 1 + \"a\"",
+        "return 1",
+        "var arr = [1] arr[0] = 2",
+        "echo missing",
+        "for v in 3 end",
+        "var x = 1 echo x(1)",
+        "echo \"a\" < 1",
+        "var x = \"g\" function f(n) if n var x = \"l\" end return x end echo f(false) .. f(true) .. x",
+        "var fs = [] for v in [1, 2] function get() return v end push(fs, get) end echo fs[0]() .. fs[1]()",
+        "var x = \"g\" for k, v in {\"a\": 1, \"b\": 2} if v == 2 echo x .. k end var x = v end",
+        "function f(a, b) if b var t = a end return a .. b .. t end echo f(1, 2) .. f(3) .. f(4, 5) .. f()",
+        "function keep(n) function get() return n end return get end var g = keep(1) keep(2) keep(3) echo g() .. keep(4)()",
+        "var y = 1 function f() return y end echo f() var y = 2 echo f() y += 1 echo f() .. len(\"ab\") .. len(\"abc\")",
+    };
+    for (const auto& program : programs) {
+        CAPTURE(program);
+        CHECK(run(program, polonio::ExecutionEngine::Vm) == run(program, polonio::ExecutionEngine::Ast));
+    }
+    CHECK(run("function f(n) return n * 2 end echo f(21)", polonio::ExecutionEngine::Vm) == "42");
+    CHECK(polonio::parse_execution_engine("vm") == polonio::ExecutionEngine::Vm);
+    CHECK_FALSE(polonio::parse_execution_engine("jit").has_value());
+}
+
+TEST_CASE("Objects keep their entries in key order") {
+    polonio::Value::Object object{{"b", polonio::Value(2)}, {"a", polonio::Value(1)}, {"b", polonio::Value(3)}};
+    REQUIRE(object.size() == 2);
+    CHECK(object.begin()->first == "a");
+    CHECK(object.at("b") == polonio::Value(3));
+    object["0"] = polonio::Value(true);
+    object.emplace("c", polonio::Value(4));
+    std::string order;
+    for (const auto& entry : object) order += entry.first;
+    CHECK(order == "0abc");
+    CHECK(object.erase("a") == 1);
+    CHECK(object.find("a") == object.end());
+    CHECK(run_program_output("var o = {\"b\": 1, \"a\": 2} for k, v in o if k == \"a\" set(o, \"c\", 3) end echo k .. v end") ==
+          "a2b1");
+    CHECK(run_program_output("var o = {\"a\": 1, \"b\": 2} for k, v in o set(o, k .. \"x\", v) end echo count(o)") == "4");
+    auto on_error = [](const std::string& message) { FAIL(message); };
+    auto decoded = polonio::parse_json_string(R"({"z": 1, "y": 2, "z": 3})", on_error);
+    CHECK(polonio::serialize_json_value(decoded, on_error) == R"({"y":2,"z":3})");
+}
+
+TEST_CASE("Objects built key by key stay ordered past the flat insert limit") {
+    const int count = 20000;
+    polonio::Value::Object object;
+    for (int i = 0; i < count; ++i) {
+        int scattered = (i * 7919) % count;
+        object["k" + std::to_string(scattered)] = polonio::Value(scattered);
+    }
+    REQUIRE(object.size() == static_cast<std::size_t>(count));
+    CHECK(object.at("k12345") == polonio::Value(12345));
+    CHECK(object.erase("k0") == 1);
+    CHECK(object.erase("k19999") == 1);
+    CHECK(object.count("k19999") == 0);
+    object.emplace("k19999", polonio::Value(-1));
+    std::string previous;
+    bool ordered = true;
+    for (const auto& entry : object) {
+        ordered = ordered && previous < entry.first;
+        previous = entry.first;
+    }
+    CHECK(ordered);
+    CHECK(object.size() == static_cast<std::size_t>(count - 1));
+    CHECK(object.at("k19999") == polonio::Value(-1));
+
+    CHECK(run_program_output("var o = {} var i = 0 while i < 5000 set(o, \"k\" .. (i * 7919) % 5000, i) i += 1 end "
+                             "echo count(o) .. \" \" .. o[\"k7\"] .. \" \" .. keys(o)[0] .. \" \" .. keys(o)[4999]") ==
+          "5000 3753 k0 k999");
+}
+
 TEST_CASE("Builtin type returns correct strings") {
     const char* src = R"(
 echo type(null)
@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+# Times every bench/*.pol template under each execution engine and records the
+# best of BENCH_RUNS runs (default 5) in bench_output.txt. Compare the file
+# across revisions to see the effect of an interpreter change.
+set -euo pipefail
+bin=${POLONIO_BIN:-build/polonio}
+runs=${BENCH_RUNS:-5}
+output=bench_output.txt
+[[ -x "$bin" ]] || { echo "missing $bin; run make first"; exit 1; }
+TIMEFORMAT=%R
+: > "$output"
+for template in bench/*.pol; do
+  for engine in ast vm; do
+    best=""
+    for ((run = 0; run < runs; run++)); do
+      elapsed=$( { time "$bin" run --engine="$engine" "$template" > /dev/null; } 2>&1 )
+      if [[ -z "$best" ]] || awk -v a="$elapsed" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+        best=$elapsed
+      fi
+    done
+    printf '%-28s %-4s %ss\n' "$(basename "$template")" "$engine" "$best" | tee -a "$output"
+  done
+done